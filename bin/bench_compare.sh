@@ -0,0 +1,37 @@
+#!/bin/sh
+# Compare two `analyser bench` JSON files and flag benchmarks that got slower.
+# usage: bin/bench_compare.sh baseline.json current.json [threshold_percent]
+# Exits 1 if any benchmark regressed by more than the threshold (default 10%).
+
+BASELINE=$1
+CURRENT=$2
+THRESHOLD=${3:-10}
+
+if [ ! -f "$BASELINE" ] || [ ! -f "$CURRENT" ]; then
+  echo "usage: $0 baseline.json current.json [threshold_percent]"
+  exit 2
+fi
+
+extract() {
+  sed -n 's/.*"name": "\([^"]*\)", "ns_per_op": \([0-9.e+-]*\).*/\1 \2/p' "$1"
+}
+
+extract "$BASELINE" > /tmp/bench_baseline.$$
+extract "$CURRENT" > /tmp/bench_current.$$
+
+awk -v threshold="$THRESHOLD" '
+  NR == FNR { baseline[$1] = $2; next }
+  {
+    if (!($1 in baseline)) { printf "%-40s %12.1f ns   (new)\n", $1, $2; next }
+    change = ($2 - baseline[$1]) / baseline[$1] * 100
+    flag = ""
+    if (change > threshold) { flag = "  REGRESSION"; regressions++ }
+    printf "%-40s %12.1f ns  %+7.1f%%%s\n", $1, $2, change, flag
+  }
+  END {
+    if (regressions > 0) { printf "%d benchmark(s) slower than baseline by more than %s%%\n", regressions, threshold; exit 1 }
+  }
+' /tmp/bench_baseline.$$ /tmp/bench_current.$$
+STATUS=$?
+rm -f /tmp/bench_baseline.$$ /tmp/bench_current.$$
+exit $STATUS
@@ -29,11 +29,14 @@
 #include <oscpp/detail/stream.hpp>
 #include <oscpp/util.hpp>
 
+#include <cassert>
 #include <cstdint>
+#include <cstring>
 #include <limits>
 #include <sstream>
 #include <stdexcept>
 #include <type_traits>
+#include <vector>
 
 namespace OSCPP { namespace Client {
 
@@ -41,14 +44,29 @@ namespace OSCPP { namespace Client {
 /*!
  * Construct a valid OSC packet for transmitting over a transport
  * medium.
+ *
+ * With Checks::Throwing (Packet) every call checks the buffer and the
+ * packet's structure and throws on errors. With Checks::Unchecked
+ * (UncheckedPacket) reserve() checks the buffer once for a packet of a
+ * size computed beforehand (see Size and Schema) and returns a Status,
+ * and the calls after it don't check or throw, only assert.
  */
-class Packet
+template <Checks C> class BasicPacket
 {
-    int32_t ptrDiff(const char* a, const char* b)
+    typedef BasicWriteStream<NetworkByteOrder, C> WriteStream;
+
+    static constexpr bool kNoexcept = C == Checks::Unchecked;
+
+    int32_t ptrDiff(const char* a, const char* b) noexcept(kNoexcept)
     {
         // Make sure pointer difference fits into int32_t
         const intptr_t diff = a - b;
-        if (diff < std::numeric_limits<int32_t>::min() ||
+        if constexpr (C == Checks::Unchecked)
+        {
+            assert(diff >= std::numeric_limits<int32_t>::min() &&
+                   diff <= std::numeric_limits<int32_t>::max());
+        }
+        else if (diff < std::numeric_limits<int32_t>::min() ||
             diff > std::numeric_limits<int32_t>::max())
         {
             std::stringstream s;
@@ -59,10 +77,12 @@ class Packet
         return static_cast<int32_t>(diff);
     }
 
-    int32_t calcSize(const char* begin, const char* end)
+    int32_t calcSize(const char* begin, const char* end) noexcept(kNoexcept)
     {
         const int32_t size = ptrDiff(end, begin) - 4;
-        if (size < 0)
+        if constexpr (C == Checks::Unchecked)
+            assert(size >= 0);
+        else if (size < 0)
         {
             throw std::logic_error("Calculated size is negative");
         }
@@ -73,7 +93,7 @@ public:
     //! Constructor.
     /*!
      */
-    Packet()
+    BasicPacket()
     {
         reset(0, 0);
     }
@@ -81,13 +101,13 @@ public:
     //! Constructor.
     /*!
      */
-    Packet(void* buffer, size_t size)
+    BasicPacket(void* buffer, size_t size)
     {
         reset(buffer, size);
     }
 
     //! Destructor.
-    virtual ~Packet()
+    virtual ~BasicPacket()
     {}
 
     //! Get packet buffer address.
@@ -114,10 +134,21 @@ public:
         return m_args.consumed();
     }
 
+    //! Check the buffer once for a packet of size bytes.
+    /*!
+     * For an UncheckedPacket, nothing may be written unless this returns
+     * Status::Ok for at least the size of the packet.
+     */
+    Status reserve(size_t size) const noexcept
+    {
+        return checkBuffer(m_buffer, m_capacity, size);
+    }
+
     //! Reset packet state.
     void reset(void* buffer, size_t size)
     {
-        checkAlignment(&m_buffer, kAlignment);
+        if constexpr (C == Checks::Throwing)
+            checkAlignment(&m_buffer, kAlignment);
         m_buffer = buffer;
         m_capacity = size;
         m_args = WriteStream(m_buffer, m_capacity);
@@ -130,7 +161,7 @@ public:
         reset(m_buffer, m_capacity);
     }
 
-    Packet& openBundle(uint64_t time)
+    BasicPacket& openBundle(uint64_t time) noexcept(kNoexcept)
     {
         if (m_inBundle > 0)
         {
@@ -144,6 +175,10 @@ public:
             std::memcpy(curPos, &offset, 4);
             m_sizePosB = curPos;
         }
+        else if constexpr (C == Checks::Unchecked)
+        {
+            assert(m_args.pos() == m_args.begin());
+        }
         else if (m_args.pos() != m_args.begin())
         {
             throw std::logic_error(
@@ -156,7 +191,7 @@ public:
         return *this;
     }
 
-    Packet& closeBundle()
+    BasicPacket& closeBundle() noexcept(kNoexcept)
     {
         if (m_inBundle > 0)
         {
@@ -184,6 +219,10 @@ public:
             }
             m_inBundle--;
         }
+        else if constexpr (C == Checks::Unchecked)
+        {
+            assert(false && "closeBundle() without matching openBundle()");
+        }
         else
         {
             throw std::logic_error(
@@ -192,7 +231,7 @@ public:
         return *this;
     }
 
-    Packet& openMessage(const char* addr, size_t numTags)
+    BasicPacket& openMessage(const char* addr, size_t numTags) noexcept(kNoexcept)
     {
         if (m_inBundle > 0)
         {
@@ -209,7 +248,7 @@ public:
         return *this;
     }
 
-    Packet& closeMessage()
+    BasicPacket& closeMessage() noexcept(kNoexcept)
     {
         if (m_inBundle > 0)
         {
@@ -237,21 +276,39 @@ public:
      *
      * \throw OSCPP::XRunError stream buffer xrun.
      */
-    Packet& int32(int32_t arg)
+    BasicPacket& int32(int32_t arg) noexcept(kNoexcept)
     {
         m_tags.putChar('i');
         m_args.putInt32(arg);
         return *this;
     }
 
-    Packet& float32(float arg)
+    BasicPacket& float32(float arg) noexcept(kNoexcept)
     {
         m_tags.putChar('f');
         m_args.putFloat32(arg);
         return *this;
     }
 
-    Packet& string(const char* arg)
+    //! Write a run of float message arguments.
+    /*!
+     * Write count 32 bit float arguments at once: their tags with one
+     * memset and their values with one byte swapping pass. The same on
+     * the wire as count calls to float32, not an OSC array.
+     *
+     * \pre openMessage must have been called before with no intervening
+     * closeMessage, with the run counted in its numTags.
+     *
+     * \throw OSCPP::XRunError stream buffer xrun.
+     */
+    BasicPacket& float32Array(const float* args, size_t count) noexcept(kNoexcept)
+    {
+        m_tags.putChars('f', count);
+        m_args.putFloat32Array(args, count);
+        return *this;
+    }
+
+    BasicPacket& string(const char* arg) noexcept(kNoexcept)
     {
         m_tags.putChar('s');
         m_args.putString(arg);
@@ -260,9 +317,13 @@ public:
 
     // @throw std::invalid_argument if blob size is greater than
     // std::numeric_limits<int32_t>::max()
-    Packet& blob(const Blob& arg)
+    BasicPacket& blob(const Blob& arg) noexcept(kNoexcept)
     {
-        if (arg.size() > (size_t)std::numeric_limits<int32_t>::max())
+        if constexpr (C == Checks::Unchecked)
+        {
+            assert(arg.size() <= (size_t)std::numeric_limits<int32_t>::max());
+        }
+        else if (arg.size() > (size_t)std::numeric_limits<int32_t>::max())
         {
             throw std::invalid_argument("Blob size greater than maximum "
                                         "value representable by int32_t");
@@ -273,26 +334,37 @@ public:
         return *this;
     }
 
-    Packet& openArray()
+    BasicPacket& openArray() noexcept(kNoexcept)
     {
         m_tags.putChar('[');
         return *this;
     }
 
-    Packet& closeArray()
+    BasicPacket& closeArray() noexcept(kNoexcept)
     {
         m_tags.putChar(']');
         return *this;
     }
 
-    template <typename T> Packet& put(T)
+    template <typename T> BasicPacket& put(T x)
     {
-        T::OSC_Client_Packet_put_unimplemented;
-        return *this;
+        if constexpr (std::is_same<T, int32_t>::value)
+            return int32(x);
+        else if constexpr (std::is_same<T, float>::value)
+            return float32(x);
+        else if constexpr (std::is_same<T, const char*>::value)
+            return string(x);
+        else if constexpr (std::is_same<T, Blob>::value)
+            return blob(x);
+        else
+        {
+            T::OSC_Client_Packet_put_unimplemented;
+            return *this;
+        }
     }
 
     template <typename InputIterator>
-    Packet& put(InputIterator begin, InputIterator end)
+    BasicPacket& put(InputIterator begin, InputIterator end)
     {
         for (auto it = begin; it != end; it++)
         {
@@ -302,7 +374,7 @@ public:
     }
 
     template <typename InputIterator>
-    Packet& putArray(InputIterator begin, InputIterator end)
+    BasicPacket& putArray(InputIterator begin, InputIterator end)
     {
         openArray();
         put<InputIterator>(begin, end);
@@ -320,22 +392,8 @@ private:
     size_t      m_inBundle; // bundle nesting depth
 };
 
-template <> inline Packet& Packet::put<int32_t>(int32_t x)
-{
-    return int32(x);
-}
-template <> inline Packet& Packet::put<float>(float x)
-{
-    return float32(x);
-}
-template <> inline Packet& Packet::put<const char*>(const char* x)
-{
-    return string(x);
-}
-template <> inline Packet& Packet::put<Blob>(Blob x)
-{
-    return blob(x);
-}
+typedef BasicPacket<Checks::Throwing>  Packet;
+typedef BasicPacket<Checks::Unchecked> UncheckedPacket;
 
 template <size_t buffer_size> class StaticPacket : public Packet
 {
@@ -363,6 +421,276 @@ public:
     }
 };
 
+//! Precompiled packet layout.
+/*!
+ * The bytes of a packet whose addresses, type tags, padding and size
+ * fields never change, recorded once by a TemplateBuilder, with the
+ * offset of every int32 and float32 argument, float32Array run and bundle
+ * time tag as a slot. A TemplatePatcher then makes each packet of that
+ * layout by copying the bytes and storing the new values at the slots.
+ */
+class PacketTemplate
+{
+public:
+    //! Get the template's packet size.
+    size_t size() const
+    {
+        return m_skeleton.size();
+    }
+
+    //! Get the number of value slots.
+    size_t slots() const
+    {
+        return m_offsets.size();
+    }
+
+    //! Get the byte offset of a slot's value in the packet.
+    size_t offset(size_t slot) const
+    {
+        return m_offsets[slot];
+    }
+
+private:
+    friend class TemplateBuilder;
+    friend class TemplatePatcher;
+
+    std::vector<char>     m_skeleton;
+    std::vector<uint32_t> m_offsets;
+};
+
+//! Packet template recording.
+/*!
+ * Builds a packet exactly as Packet does, with the same calls, and
+ * records where each value went. Strings and blobs become part of the
+ * layout rather than slots.
+ */
+class TemplateBuilder
+{
+public:
+    TemplateBuilder(void* buffer, size_t size)
+    : m_packet(buffer, size)
+    {}
+
+    //! Get the size of the packet built so far.
+    size_t size() const
+    {
+        return m_packet.size();
+    }
+
+    TemplateBuilder& openBundle(uint64_t time)
+    {
+        m_packet.openBundle(time);
+        record(8);
+        return *this;
+    }
+
+    TemplateBuilder& closeBundle()
+    {
+        m_packet.closeBundle();
+        return *this;
+    }
+
+    TemplateBuilder& openMessage(const char* addr, size_t numTags)
+    {
+        m_packet.openMessage(addr, numTags);
+        return *this;
+    }
+
+    TemplateBuilder& closeMessage()
+    {
+        m_packet.closeMessage();
+        return *this;
+    }
+
+    TemplateBuilder& int32(int32_t arg)
+    {
+        m_packet.int32(arg);
+        record(4);
+        return *this;
+    }
+
+    TemplateBuilder& float32(float arg)
+    {
+        m_packet.float32(arg);
+        record(4);
+        return *this;
+    }
+
+    TemplateBuilder& float32Array(const float* args, size_t count)
+    {
+        m_packet.float32Array(args, count);
+        record(4 * count);
+        return *this;
+    }
+
+    TemplateBuilder& string(const char* arg)
+    {
+        m_packet.string(arg);
+        return *this;
+    }
+
+    TemplateBuilder& blob(const Blob& arg)
+    {
+        m_packet.blob(arg);
+        return *this;
+    }
+
+    TemplateBuilder& openArray()
+    {
+        m_packet.openArray();
+        return *this;
+    }
+
+    TemplateBuilder& closeArray()
+    {
+        m_packet.closeArray();
+        return *this;
+    }
+
+    //! Get the template of the packet built.
+    PacketTemplate finish() const
+    {
+        PacketTemplate result;
+        const char* begin = static_cast<const char*>(m_packet.data());
+        result.m_skeleton.assign(begin, begin + m_packet.size());
+        result.m_offsets = m_offsets;
+        return result;
+    }
+
+private:
+    // the value just written, of size bytes, is a slot
+    void record(size_t size)
+    {
+        m_offsets.push_back(static_cast<uint32_t>(m_packet.size() - size));
+    }
+
+    Packet                m_packet;
+    std::vector<uint32_t> m_offsets;
+};
+
+//! Packet template filling.
+/*!
+ * Copies a template's bytes into a buffer on construction, then takes the
+ * same calls as the TemplateBuilder that recorded it, in the same order:
+ * the values go to their slots, byte swapped, and the rest are no-ops.
+ * Nothing throws: the buffer is checked once on construction, and there
+ * are no checks after it, so the calls must match the template's layout.
+ */
+class TemplatePatcher
+{
+public:
+    //! Constructor.
+    /*!
+     * Copies the template into buffer if it fits and the buffer is
+     * aligned, as status() tells. Nothing may be patched otherwise.
+     */
+    TemplatePatcher(const PacketTemplate& layout, void* buffer, size_t size) noexcept
+    : m_buffer(static_cast<char*>(buffer))
+    , m_offsets(layout.m_offsets.data())
+    , m_size(layout.size())
+    , m_status(checkBuffer(buffer, size, m_size))
+    {
+        if (m_status == Status::Ok)
+            std::memcpy(m_buffer, layout.m_skeleton.data(), m_size);
+#ifndef NDEBUG
+        m_end = m_status == Status::Ok ? m_offsets + layout.slots() : m_offsets;
+#endif
+    }
+
+    //! Get whether the template was copied into the buffer.
+    Status status() const noexcept
+    {
+        return m_status;
+    }
+
+    //! Get the packet size.
+    size_t size() const
+    {
+        return m_size;
+    }
+
+    TemplatePatcher& openBundle(uint64_t time) noexcept
+    {
+        const uint64_t un = convert64<NetworkByteOrder>(time);
+        std::memcpy(next(), &un, 8);
+        return *this;
+    }
+
+    TemplatePatcher& closeBundle() noexcept
+    {
+        return *this;
+    }
+
+    TemplatePatcher& openMessage(const char*, size_t) noexcept
+    {
+        return *this;
+    }
+
+    TemplatePatcher& closeMessage() noexcept
+    {
+        return *this;
+    }
+
+    TemplatePatcher& int32(int32_t arg) noexcept
+    {
+        uint32_t uh;
+        std::memcpy(&uh, &arg, 4);
+        const uint32_t un = convert32<NetworkByteOrder>(uh);
+        std::memcpy(next(), &un, 4);
+        return *this;
+    }
+
+    TemplatePatcher& float32(float arg) noexcept
+    {
+        uint32_t uh;
+        std::memcpy(&uh, &arg, 4);
+        const uint32_t un = convert32<NetworkByteOrder>(uh);
+        std::memcpy(next(), &un, 4);
+        return *this;
+    }
+
+    TemplatePatcher& float32Array(const float* args, size_t count) noexcept
+    {
+        convert32<NetworkByteOrder>(next(), args, count);
+        return *this;
+    }
+
+    TemplatePatcher& string(const char*) noexcept
+    {
+        return *this;
+    }
+
+    TemplatePatcher& blob(const Blob&) noexcept
+    {
+        return *this;
+    }
+
+    TemplatePatcher& openArray() noexcept
+    {
+        return *this;
+    }
+
+    TemplatePatcher& closeArray() noexcept
+    {
+        return *this;
+    }
+
+private:
+    char* next()
+    {
+        assert(m_offsets < m_end);
+        return m_buffer + *m_offsets++;
+    }
+
+    char*           m_buffer;
+    const uint32_t* m_offsets; // the next slot's
+    size_t          m_size;
+    Status          m_status;
+#ifndef NDEBUG
+    const uint32_t* m_end;
+#endif
+};
+
 }} // namespace OSCPP::Client
 
 #endif // OSCPP_CLIENT_HPP_INCLUDED
@@ -27,9 +27,19 @@
 
 #include <oscpp/detail/endian.hpp>
 
+#include <cstddef>
 #include <cstdint>
+#include <cstring>
 #include <stdexcept>
 
+#if defined(__SSSE3__)
+#    include <tmmintrin.h>
+#elif defined(__SSE2__)
+#    include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#    include <arm_neon.h>
+#endif
+
 namespace OSCPP {
 #if defined(__GNUC__)
 inline static uint32_t bswap32(uint32_t x)
@@ -95,6 +105,69 @@ template <> inline uint32_t convert32<HostByteOrder>(uint32_t x)
     return x;
 }
 
+//! Convert count 32 bit words from src to dst.
+/*!
+ * dst and src may be the same but mustn't otherwise overlap. Neither has
+ * to be aligned. Byte swapping goes four words at a time with SSSE3, SSE2
+ * or NEON where the build has them.
+ */
+template <ByteOrder B>
+inline void convert32(void* dst, const void* src, size_t count);
+
+template <>
+inline void convert32<NetworkByteOrder>(void* dst, const void* src,
+                                        size_t count)
+{
+#if defined(OSCPP_LITTLE_ENDIAN)
+    char*       out = static_cast<char*>(dst);
+    const char* in = static_cast<const char*>(src);
+    const char* end = in + 4 * count;
+#    if defined(__SSSE3__)
+    const __m128i order =
+        _mm_set_epi8(12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3);
+    for (; end - in >= 16; in += 16, out += 16)
+    {
+        const __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out),
+                         _mm_shuffle_epi8(x, order));
+    }
+#    elif defined(__SSE2__)
+    for (; end - in >= 16; in += 16, out += 16)
+    {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in));
+        // swap the bytes of each half word, then the half words
+        x = _mm_or_si128(_mm_slli_epi16(x, 8), _mm_srli_epi16(x, 8));
+        x = _mm_shufflelo_epi16(x, _MM_SHUFFLE(2, 3, 0, 1));
+        x = _mm_shufflehi_epi16(x, _MM_SHUFFLE(2, 3, 0, 1));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out), x);
+    }
+#    elif defined(__ARM_NEON)
+    for (; end - in >= 16; in += 16, out += 16)
+    {
+        const uint8x16_t x = vld1q_u8(reinterpret_cast<const uint8_t*>(in));
+        vst1q_u8(reinterpret_cast<uint8_t*>(out), vrev32q_u8(x));
+    }
+#    endif
+    for (; in != end; in += 4, out += 4)
+    {
+        uint32_t x;
+        std::memcpy(&x, in, 4);
+        x = bswap32(x);
+        std::memcpy(out, &x, 4);
+    }
+#else
+    if (dst != src)
+        std::memcpy(dst, src, 4 * count);
+#endif
+}
+
+template <>
+inline void convert32<HostByteOrder>(void* dst, const void* src, size_t count)
+{
+    if (dst != src)
+        std::memcpy(dst, src, 4 * count);
+}
+
 template <ByteOrder B> inline uint64_t convert64(uint64_t)
 {
     throw std::logic_error("Invalid byte order");
@@ -138,8 +138,17 @@ protected:
     char* m_pos;
 };
 
-template <ByteOrder B> class BasicWriteStream : public Stream
+//! Write stream.
+/*!
+ * With Checks::Throwing every write checks its room and alignment and
+ * throws on errors. With Checks::Unchecked the writer has checked up front
+ * (see checkBuffer), so writes only assert and don't throw.
+ */
+template <ByteOrder B, Checks C = Checks::Throwing>
+class BasicWriteStream : public Stream
 {
+    static constexpr bool kNoexcept = C == Checks::Unchecked;
+
 public:
     BasicWriteStream()
     : Stream()
@@ -153,38 +162,56 @@ public:
     : Stream(stream)
     {}
 
-    BasicWriteStream(const BasicWriteStream& stream, size_t size)
-    : Stream(stream, size)
-    {}
+    // throw (UnderrunError)
+    BasicWriteStream(const BasicWriteStream& stream, size_t size) noexcept(kNoexcept)
+    : Stream(stream)
+    {
+        m_end = m_begin + size;
+        if constexpr (C == Checks::Unchecked)
+            assert(m_end <= stream.m_end);
+        else if (m_end > stream.m_end)
+            throw UnderrunError();
+    }
 
     // throw (OverflowError)
-    inline void checkWritable(size_t n) const
+    inline void checkWritable(size_t n) const noexcept(kNoexcept)
     {
-        if (consumable() < n)
+        if constexpr (C == Checks::Unchecked)
+            assert(consumable() >= n);
+        else if (consumable() < n)
             throw OverflowError(n - consumable());
     }
 
-    void skip(size_t n)
+    // throw (std::runtime_error)
+    inline void checkAlignment(size_t n) const noexcept(kNoexcept)
+    {
+        if constexpr (C == Checks::Unchecked)
+            assert(isAligned(pos(), n));
+        else
+            Stream::checkAlignment(n);
+    }
+
+    void skip(size_t n) noexcept(kNoexcept)
     {
         checkWritable(n);
         advance(n);
     }
 
-    void zero(size_t n)
+    void zero(size_t n) noexcept(kNoexcept)
     {
         checkWritable(n);
         std::memset(m_pos, 0, n);
         advance(n);
     }
 
-    void putChar(char c)
+    void putChar(char c) noexcept(kNoexcept)
     {
         checkWritable(1);
         *pos() = c;
         advance(1);
     }
 
-    void putInt32(int32_t x)
+    void putInt32(int32_t x) noexcept(kNoexcept)
     {
         checkWritable(4);
         checkAlignment(4);
@@ -195,7 +222,7 @@ public:
         advance(4);
     }
 
-    void putUInt64(uint64_t x)
+    void putUInt64(uint64_t x) noexcept(kNoexcept)
     {
         checkWritable(8);
         const uint64_t un = convert64<B>(x);
@@ -203,7 +230,7 @@ public:
         advance(8);
     }
 
-    void putFloat32(float f)
+    void putFloat32(float f) noexcept(kNoexcept)
     {
         checkWritable(4);
         checkAlignment(4);
@@ -214,7 +241,15 @@ public:
         advance(4);
     }
 
-    void putFloat64(double f)
+    void putFloat32Array(const float* values, size_t count) noexcept(kNoexcept)
+    {
+        checkWritable(4 * count);
+        checkAlignment(4);
+        convert32<B>(pos(), values, count);
+        advance(4 * count);
+    }
+
+    void putFloat64(double f) noexcept(kNoexcept)
     {
         checkWritable(8);
         checkAlignment(4);
@@ -225,7 +260,14 @@ public:
         advance(8);
     }
 
-    void putData(const void* data, size_t size)
+    void putChars(char c, size_t count) noexcept(kNoexcept)
+    {
+        checkWritable(count);
+        std::memset(pos(), c, count);
+        advance(count);
+    }
+
+    void putData(const void* data, size_t size) noexcept(kNoexcept)
     {
         const size_t padding = OSCPP::padding(size);
         const size_t n = size + padding;
@@ -235,7 +277,7 @@ public:
         advance(n);
     }
 
-    void putString(const char* s)
+    void putString(const char* s) noexcept(kNoexcept)
     {
         putData(s, strlen(s) + 1);
     }
@@ -335,6 +377,15 @@ public:
         return f;
     }
 
+    // throw (UnderrunError)
+    inline void getFloat32Array(float* values, size_t count)
+    {
+        checkReadable(4 * count);
+        checkAlignment(4);
+        convert32<B>(values, pos(), count);
+        advance(4 * count);
+    }
+
     // throw (UnderrunError)
     inline double getFloat64()
     {
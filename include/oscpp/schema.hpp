@@ -0,0 +1,255 @@
+// oscpp library
+//
+// Copyright (c) 2004-2013 Stefan Kersten <sk@k-hornz.de>
+//
+// Permission is hereby granted, free of charge, to any person or organization
+// obtaining a copy of the software and accompanying documentation covered by
+// this license (the "Software") to use, reproduce, display, distribute,
+// execute, and transmit the Software, and to prepare derivative works of the
+// Software, and to permit third-parties to whom the Software is furnished to
+// do so, all subject to the following:
+//
+// The copyright notices in the Software and this entire statement, including
+// the above license grant, this restriction and the following disclaimer,
+// must be included in all copies of the Software, in whole or in part, and
+// all derivative works of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE, TITLE AND NON-INFRINGEMENT. IN NO EVENT
+// SHALL THE COPYRIGHT HOLDERS OR ANYONE DISTRIBUTING THE SOFTWARE BE LIABLE
+// FOR ANY DAMAGES OR OTHER LIABILITY, WHETHER IN CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+
+#ifndef OSCPP_SCHEMA_HPP_INCLUDED
+#define OSCPP_SCHEMA_HPP_INCLUDED
+
+#include <oscpp/detail/host.hpp>
+#include <oscpp/error.hpp>
+#include <oscpp/server.hpp>
+#include <oscpp/util.hpp>
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <tuple>
+#include <type_traits>
+
+namespace OSCPP { namespace Schema {
+
+//! Struct member argument.
+/*!
+ * One argument taken from, and decoded into, the member M.
+ */
+template <auto M> struct Member
+{
+    static constexpr size_t count = 1;
+
+    template <typename S> static auto* values(S& s)
+    {
+        return &(s.*M);
+    }
+};
+
+//! Indexed element arguments.
+/*!
+ * N arguments taken from, and decoded into, elements I to I + N - 1 of an
+ * indexable struct (a std::array, say) with contiguous elements.
+ */
+template <size_t I, size_t N = 1> struct Elements
+{
+    static constexpr size_t count = N;
+
+    template <typename S> static auto* values(S& s)
+    {
+        return &s[I];
+    }
+};
+
+namespace detail {
+
+template <typename T> struct Arg
+{
+    static_assert(sizeof(T) == 0, "OSCPP::Schema arguments are int32_t, uint32_t or float");
+};
+
+template <> struct Arg<int32_t>
+{
+    static constexpr char tag = 'i';
+    template <typename Packet> static void write(Packet& packet, int32_t x)
+    {
+        packet.int32(x);
+    }
+};
+
+template <> struct Arg<uint32_t>
+{
+    static constexpr char tag = 'i';
+    template <typename Packet> static void write(Packet& packet, uint32_t x)
+    {
+        packet.int32(static_cast<int32_t>(x));
+    }
+};
+
+template <> struct Arg<float>
+{
+    static constexpr char tag = 'f';
+    template <typename Packet> static void write(Packet& packet, float x)
+    {
+        packet.float32(x);
+    }
+};
+
+template <typename Struct, typename Field>
+using FieldType = std::remove_cv_t<
+    std::remove_pointer_t<decltype(Field::values(std::declval<Struct&>()))>>;
+
+// ',' and each argument's tag, padded
+template <typename Struct, typename... Fields>
+constexpr std::array<char, align((Fields::count + ... + 0) + 2)> tags()
+{
+    std::array<char, align((Fields::count + ... + 0) + 2)> result{};
+    const char   fieldTags[] = {Arg<FieldType<Struct, Fields>>::tag..., 0};
+    const size_t counts[] = {Fields::count..., 0};
+    size_t       pos = 0;
+    result[pos++] = ',';
+    for (size_t f = 0; f < sizeof...(Fields); f++)
+    {
+        for (size_t n = 0; n < counts[f]; n++)
+            result[pos++] = fieldTags[f];
+    }
+    return result;
+}
+
+} // namespace detail
+
+//! OSC message schema.
+/*!
+ * A message at Address whose arguments are Struct's Fields in order,
+ * declared once so its encoder and decoder can't disagree, and its type
+ * tags and size are known at compile time.
+ *
+ * Arguments are int32_t, uint32_t (sent as int32) and float, each 4
+ * bytes, so every argument's offset in the message is fixed.
+ */
+template <const char* Address, typename Struct, typename... Fields>
+class Message
+{
+public:
+    typedef Struct Values;
+
+    static constexpr const char* address = Address;
+    static constexpr size_t addressLength = std::char_traits<char>::length(Address);
+
+    //! Number of arguments.
+    static constexpr size_t numArgs = (Fields::count + ... + 0);
+
+    //! Type tag string, with its ',' and padding.
+    static constexpr std::array<char, align(numArgs + 2)> tags =
+        detail::tags<Struct, Fields...>();
+
+    //! Size of the arguments.
+    static constexpr size_t argumentsSize = Size::int32(numArgs);
+
+    //! Size of the message under an address of the given length.
+    static constexpr size_t size(size_t length)
+    {
+        return Size::string(length) + tags.size() + argumentsSize;
+    }
+
+    //! Size of the message under its address.
+    static constexpr size_t size()
+    {
+        return size(addressLength);
+    }
+
+    //! Write the message to packet.
+    /*!
+     * Packet is anything with the Client::Packet message interface, so
+     * Client::Packet itself or a Client::TemplateBuilder or TemplatePatcher.
+     */
+    template <typename Packet> static void write(Packet& packet, const Struct& values)
+    {
+        write(packet, Address, values);
+    }
+
+    //! Write the message to packet under another address.
+    template <typename Packet>
+    static void write(Packet& packet, const char* address, const Struct& values)
+    {
+        packet.openMessage(address, numArgs);
+        (writeField<Fields>(packet, values), ...);
+        packet.closeMessage();
+    }
+
+    //! Whether message's arguments are this schema's.
+    /*!
+     * The type tags must match exactly and the arguments fit in the
+     * message. The address isn't checked.
+     */
+    static bool matches(const Server::Message& message)
+    {
+        ReadStream messageTags, args;
+        std::tie(messageTags, args) = message.args().state();
+        return messageTags.capacity() == numArgs &&
+               std::memcmp(messageTags.pos(), tags.data() + 1, numArgs) == 0 &&
+               args.consumable() >= argumentsSize;
+    }
+
+    //! Decode message's arguments into values.
+    /*!
+     * The message is checked once, then each argument is read from its
+     * fixed offset in the packet.
+     *
+     * \throw OSCPP::ParseError the message doesn't match the schema.
+     */
+    static void decode(const Server::Message& message, Struct& values)
+    {
+        if (!matches(message))
+            throw ParseError("Message doesn't match its schema");
+        const char* arg = std::get<1>(message.args().state()).pos();
+        (readField<Fields>(arg, values), ...);
+    }
+
+private:
+    template <typename Field, typename Packet>
+    static void writeField(Packet& packet, const Struct& values)
+    {
+        typedef detail::FieldType<Struct, Field> T;
+        const T*                                 field = Field::values(values);
+        if constexpr (std::is_same<T, float>::value && Field::count > 1)
+        {
+            packet.float32Array(field, Field::count);
+        }
+        else
+        {
+            for (size_t i = 0; i < Field::count; i++)
+                detail::Arg<T>::write(packet, field[i]);
+        }
+    }
+
+    template <typename Field>
+    static void readField(const char*& arg, Struct& values)
+    {
+        convert32<NetworkByteOrder>(Field::values(values), arg, Field::count);
+        arg += Size::int32(Field::count);
+    }
+};
+
+//! OSC bundle schema.
+/*!
+ * A bundle of Messages, for its size at compile time.
+ */
+template <typename... Messages> struct Bundle
+{
+    static constexpr size_t size()
+    {
+        return Size::bundle(sizeof...(Messages)) + (Messages::size() + ... + 0);
+    }
+};
+
+}} // namespace OSCPP::Schema
+
+#endif // OSCPP_SCHEMA_HPP_INCLUDED
@@ -179,6 +179,37 @@ public:
         }
     }
 
+    //! Get a run of float arguments.
+    /*!
+     * Read the next count arguments, which must all be tagged 'f', into
+     * values with one byte swapping pass. Unlike float32, integers aren't
+     * converted.
+     *
+     * \exception OSCPP::UnderrunError stream buffer underrun.
+     * \exception OSCPP::ParseError an argument isn't a float.
+     */
+    void float32Array(float* values, size_t count)
+    {
+        m_tags.checkReadable(count);
+        const char* tags = m_tags.pos();
+        size_t      i = 0;
+        // eight tags at a time
+        for (; i + 8 <= count; i += 8)
+        {
+            uint64_t word;
+            std::memcpy(&word, tags + i, 8);
+            if (word != 0x6666666666666666) // "ffffffff"
+                break;
+        }
+        for (; i < count; i++)
+        {
+            if (tags[i] != 'f')
+                throw ParseError("Cannot read argument as float");
+        }
+        m_args.getFloat32Array(values, count);
+        m_tags.skip(count);
+    }
+
     //* Return a stream corresponding to an array argument.
     ArgStream array()
     {
@@ -60,6 +60,32 @@ inline void checkAlignment(const void* ptr, size_t n)
     }
 }
 
+//! Error handling of packet construction.
+enum class Checks
+{
+    //! Every write checks its room and alignment, throwing on errors.
+    Throwing,
+    //! Room and alignment are checked once up front, returning a Status,
+    //! and writes are only checked by assertions.
+    Unchecked
+};
+
+//! Result of an up front packet check.
+enum class Status
+{
+    Ok,
+    Overflow, //!< the packet doesn't fit in the buffer
+    Unaligned //!< the buffer isn't aligned to kAlignment
+};
+
+//! Check a buffer for a packet of size bytes without throwing.
+inline Status checkBuffer(const void* buffer, size_t capacity, size_t size) noexcept
+{
+    if (!isAligned(buffer, kAlignment))
+        return Status::Unaligned;
+    return size <= capacity ? Status::Ok : Status::Overflow;
+}
+
 namespace Tags {
 
 constexpr size_t int32()
@@ -0,0 +1,260 @@
+#include "accuracy.hpp"
+#include <algorithm>
+#include <cmath>
+#include <filesystem>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <sstream>
+#include "analysis.hpp"
+#include "features.hpp"
+#include "wavfile.hpp"
+
+namespace fs = std::filesystem;
+
+namespace {
+
+const char* REFERENCE_ENGINE = "gist";
+
+// Differences an engine makes on purpose, reported but not failed
+struct divergence_t {
+  const char* engine;
+  std::vector<Feature> features;
+  const char* why;
+};
+const std::vector<divergence_t> DIVERGENCES = {
+  { "gist-persistent",
+    { ENERGY_DIFFERENCE, SPECTRAL_DIFFERENCE, SPECTRAL_DIFFERENCE_HWR, COMPLEX_SPECTRAL_DIFFERENCE },
+    "onset functions compare against the previous window, the reference against silence" },
+  { "gist-stereo",
+    { ENERGY_DIFFERENCE, SPECTRAL_DIFFERENCE, SPECTRAL_DIFFERENCE_HWR, COMPLEX_SPECTRAL_DIFFERENCE },
+    "onset functions compare against the previous window, the reference against silence" },
+};
+
+// Which FeatureGroup a feature is computed in
+unsigned featureGroup(size_t feature) {
+  if (feature < SPECTRAL_CENTROID) return TIME_FEATURES;
+  if (feature < ENERGY_DIFFERENCE) return FREQ_FEATURES;
+  if (feature < PITCH) return ONSET_FEATURES;
+  if (feature < MFCC_0) return PITCH_FEATURES;
+  return MFCC_FEATURES;
+}
+
+bool divergent(const std::string& engine, size_t feature) {
+  for (const auto& d : DIVERGENCES) {
+    if (engine == d.engine && std::find(d.features.begin(), d.features.end(), feature) != d.features.end()) return true;
+  }
+  return false;
+}
+
+// A signal analysed as consecutive windows through one engine instance, so
+// stateful engines see the same history as they would live
+struct sequence_t {
+  std::string label;
+  std::vector<float> samples;
+};
+
+struct tolerance_t {
+  double absolute;
+  double relative;
+};
+
+struct worst_t {
+  double excess = 0; // error / allowed error, > 1 is a failure
+  double error = 0;
+  float expected = 0;
+  float actual = 0;
+  std::string where;
+  size_t failures = 0;
+};
+
+// Synthesise as int16 and convert like the live path, so the corpus is quantised like Jamulus audio
+sequence_t synthesise(const std::string& label, size_t length, const std::function<double(size_t)>& signal) {
+  std::vector<int16_t> pcm(length);
+  for (size_t i = 0; i < length; i++) {
+    pcm[i] = static_cast<int16_t>(std::lround(std::clamp(signal(i), -1.0, 32767.0 / 32768.0) * 32768.0));
+  }
+  sequence_t sequence{ label, std::vector<float>(length) };
+  convertFrame(pcm.data(), sequence.samples.data(), length);
+  return sequence;
+}
+
+std::vector<sequence_t> syntheticCorpus(size_t windowSize) {
+  const size_t length = windowSize * 16;
+  const double rate = SAMPLE_RATE;
+  std::vector<sequence_t> corpus;
+  corpus.push_back(synthesise("silence", length, [](size_t) { return 0.0; }));
+  for (double hz : { 55.0, 440.0, 1000.0, 4186.0, 15000.0 }) {
+    for (double gain : { 0.5, 0.001 }) {
+      std::ostringstream label;
+      label << "sine " << hz << "Hz x" << gain;
+      corpus.push_back(synthesise(label.str(), length,
+                                  [=](size_t i) { return gain * std::sin(2 * M_PI * hz * i / rate); }));
+    }
+  }
+  corpus.push_back(synthesise("square 220Hz full scale", length,
+                              [=](size_t i) { return std::sin(2 * M_PI * 220 * i / rate) >= 0 ? 1.0 : -1.0; }));
+  corpus.push_back(synthesise("chirp 20Hz-20kHz", length * 2, [=](size_t i) {
+    double t = i / rate, duration = length * 2 / rate;
+    return 0.5 * std::sin(2 * M_PI * (20 * t + (20000 - 20) * t * t / (2 * duration)));
+  }));
+  corpus.push_back(synthesise("impulses every 300", length, [](size_t i) { return i % 300 == 0 ? 0.9 : 0.0; }));
+  std::mt19937 random(1234);
+  std::normal_distribution<double> gaussian(0.0, 0.2);
+  std::vector<double> noise(length);
+  for (auto& x : noise) x = gaussian(random);
+  corpus.push_back(synthesise("gaussian noise", length, [&](size_t i) { return noise[i]; }));
+  // onsets: silence then a tone that starts mid-window
+  corpus.push_back(synthesise("tone onset", length, [=](size_t i) {
+    return i < length / 2 + windowSize / 3 ? 0.0 : 0.3 * std::sin(2 * M_PI * 330 * i / rate);
+  }));
+  return corpus;
+}
+
+void addRecording(const fs::path& path, const accuracyConfig_t& config, std::vector<sequence_t>& corpus) {
+  MappedWav wav;
+  if (!wav.open(path.string())) return;
+  size_t count = std::min(wav.frames(), config.windowSize * config.maxRecordedWindows);
+  const int16_t* interleaved = wav.frameView(0, count);
+  std::vector<int16_t> mono(count);
+  for (size_t i = 0; i < count; i++) {
+    int sum = 0; // mixed down, as batch does
+    for (int c = 0; c < wav.channels(); c++) sum += interleaved[i * wav.channels() + c];
+    mono[i] = static_cast<int16_t>(sum / wav.channels());
+  }
+  sequence_t sequence{ path.filename().string(), std::vector<float>(count) };
+  convertFrame(mono.data(), sequence.samples.data(), count);
+  corpus.push_back(std::move(sequence));
+}
+
+std::vector<tolerance_t> parseTolerances(const std::string& spec) {
+  std::vector<tolerance_t> tolerances(FEATURE_COUNT, tolerance_t{ 1e-6, 1e-5 });
+  std::istringstream in("default=1e-6:1e-5,pitch=0.01:0," + spec);
+  std::string entry;
+  while (std::getline(in, entry, ',')) {
+    size_t equals = entry.find('='), colon = entry.find(':');
+    if (equals == std::string::npos || colon == std::string::npos || colon < equals) {
+      if (!entry.empty()) std::cerr << "ignoring tolerance '" << entry << "', expected feature=abs:rel" << std::endl;
+      continue;
+    }
+    std::string key = entry.substr(0, equals);
+    tolerance_t tolerance{ std::atof(entry.substr(equals + 1, colon - equals - 1).c_str()),
+                           std::atof(entry.substr(colon + 1).c_str()) };
+    // a key covers every feature it prefixes, so "mfcc" sets all the coefficients
+    for (size_t f = 0; f < FEATURE_COUNT; f++) {
+      if (key == "default" || featureName(f).compare(0, key.size(), key) == 0) tolerances[f] = tolerance;
+    }
+  }
+  return tolerances;
+}
+
+// Returns error / allowed error, with NaN only matching NaN
+double excess(float expected, float actual, const tolerance_t& tolerance, double& error) {
+  if (std::isnan(expected) || std::isnan(actual)) {
+    error = std::isnan(expected) && std::isnan(actual) ? 0 : std::numeric_limits<double>::infinity();
+    return error;
+  }
+  error = std::fabs(static_cast<double>(expected) - actual);
+  if (error == 0) return 0;
+  double allowed = tolerance.absolute + tolerance.relative * std::fabs(expected);
+  return allowed > 0 ? error / allowed : std::numeric_limits<double>::infinity();
+}
+
+// The engine computes just groups, the reference everything, so a subset of
+// groups checks any shortcut an engine takes for it
+bool compareEngine(const std::string& engineName, unsigned groups, const std::vector<sequence_t>& corpus,
+                   const std::vector<tolerance_t>& tolerances, size_t windowSize) {
+  std::vector<worst_t> worst(FEATURE_COUNT);
+  size_t windows = 0;
+  features_t expected, actual;
+  for (const auto& sequence : corpus) {
+    auto reference = makeFeatureEngine(REFERENCE_ENGINE, SAMPLE_RATE);
+    auto engine = makeFeatureEngine(engineName, SAMPLE_RATE);
+    for (size_t start = 0; start + windowSize <= sequence.samples.size(); start += windowSize, windows++) {
+      reference->analyse(sequence.samples.data() + start, windowSize, ALL_FEATURES, expected);
+      engine->analyse(sequence.samples.data() + start, windowSize, groups, actual);
+      for (size_t f = 0; f < FEATURE_COUNT; f++) {
+        if (!(featureGroup(f) & groups)) continue;
+        double error;
+        double e = excess(expected[f], actual[f], tolerances[f], error);
+        if (e > 1) worst[f].failures++;
+        if (e > worst[f].excess) {
+          worst[f] = { e, error, expected[f], actual[f],
+                       sequence.label + " window " + std::to_string(start / windowSize), worst[f].failures };
+        }
+      }
+    }
+  }
+
+  bool ok = true;
+  std::cout << "analyser: " << engineName << (groups == TIME_FEATURES ? " time features only" : "")
+            << " vs " << REFERENCE_ENGINE << " over " << windows << " windows" << std::endl;
+  for (size_t f = 0; f < FEATURE_COUNT; f++) {
+    if (!(featureGroup(f) & groups)) continue;
+    const worst_t& w = worst[f];
+    bool expectedDifference = divergent(engineName, f);
+    const char* verdict = w.failures == 0 ? "ok" : expectedDifference ? "differs (expected)" : "FAIL";
+    if (w.failures > 0 && !expectedDifference) ok = false;
+    std::cout << "  " << std::left << std::setw(28) << featureName(f) << std::setw(20) << verdict << std::right;
+    if (w.excess > 0) {
+      std::cout << " worst " << w.error << " (" << w.excess << "x tolerance) at " << w.where
+                << ": " << w.expected << " vs " << w.actual;
+      if (w.failures > 0) std::cout << ", " << w.failures << " windows out";
+    }
+    std::cout << std::endl;
+  }
+  for (const auto& d : DIVERGENCES) {
+    const bool compared = std::any_of(d.features.begin(), d.features.end(), [&](Feature f) { return featureGroup(f) & groups; });
+    if (engineName == d.engine && compared) std::cout << "  expected differences: " << d.why << std::endl;
+  }
+  return ok;
+}
+
+} // namespace
+
+bool runAccuracy(const accuracyConfig_t& config) {
+  std::vector<std::string> engines = config.engines;
+  if (engines.empty()) {
+    for (const auto& name : featureEngineNames()) {
+      if (name != REFERENCE_ENGINE) engines.push_back(name);
+    }
+  }
+  for (const auto& name : engines) {
+    if (!makeFeatureEngine(name, SAMPLE_RATE)) {
+      std::cerr << "unknown engine '" << name << "'" << std::endl;
+      return false;
+    }
+  }
+
+  std::vector<sequence_t> corpus = syntheticCorpus(config.windowSize);
+  for (const auto& recording : config.recordings) {
+    std::error_code error;
+    if (fs::is_directory(recording, error)) {
+      std::vector<fs::path> files;
+      for (const auto& entry : fs::recursive_directory_iterator(recording, error)) {
+        if (entry.is_regular_file() && entry.path().extension() == ".wav") files.push_back(entry.path());
+      }
+      std::sort(files.begin(), files.end());
+      for (const auto& file : files) addRecording(file, config, corpus);
+    } else {
+      addRecording(recording, config, corpus);
+    }
+  }
+
+  std::vector<tolerance_t> tolerances = parseTolerances(config.tolerances);
+  bool ok = true;
+  for (const auto& name : engines) {
+    ok = compareEngine(name, ALL_FEATURES, corpus, tolerances, config.windowSize) && ok;
+  }
+  // Load shedding's TIME_ONLY skips the FFT, and /time mustn't change when it does
+  if (std::find(engines.begin(), engines.end(), REFERENCE_ENGINE) == engines.end()) {
+    engines.insert(engines.begin(), REFERENCE_ENGINE);
+  }
+  for (const auto& name : engines) {
+    ok = compareEngine(name, TIME_FEATURES, corpus, tolerances, config.windowSize) && ok;
+  }
+  std::cout << "analyser: accuracy " << (ok ? "ok" : "FAILED") << std::endl;
+  return ok;
+}
@@ -0,0 +1,25 @@
+#ifndef ANALYSER_ACCURACY_HPP
+#define ANALYSER_ACCURACY_HPP
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Golden-output check for feature engines (see features.hpp): a corpus of
+// synthetic signals, plus any recordings given, goes through the reference
+// engine and each engine under test window by window, and every feature is
+// compared with its own tolerance. Reports the worst error per feature and
+// the window it happened in. Each engine, the reference too, is also run for
+// TIME_FEATURES alone, which load shedding asks for without the FFT.
+struct accuracyConfig_t {
+  std::vector<std::string> engines;     // empty means every engine but the reference
+  std::vector<std::string> recordings;  // .wav files or directories of them
+  std::string tolerances;               // e.g. "default=1e-6:1e-5,pitch=0.01:0,mfcc=1e-4:1e-4"
+  size_t windowSize;
+  size_t maxRecordedWindows;            // per recording
+};
+
+// Returns false if any engine is out of tolerance on a feature it should match
+bool runAccuracy(const accuracyConfig_t& config);
+
+#endif // ANALYSER_ACCURACY_HPP
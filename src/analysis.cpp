@@ -0,0 +1,493 @@
+#include "analysis.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <unordered_map>
+#include <oscpp/client.hpp>
+#include "config.hpp"
+#include "oscschema.hpp"
+#include "trace.hpp"
+
+const std::string analysisEngine = envString("ANALYSER_ENGINE", "gist");
+
+const ResamplerQuality resamplerQuality =
+  resamplerQualityFromName(envString("ANALYSER_RESAMPLER_QUALITY", "medium"), ResamplerQuality::medium);
+
+static int pitchRateFromEnv() {
+  int rate = std::clamp<long>(envLong("ANALYSER_PITCH_RATE", SAMPLE_RATE), 8000, SAMPLE_RATE);
+  if (!makeResampler(SAMPLE_RATE, rate, resamplerQuality)) {
+    std::cerr << "can't decimate to ANALYSER_PITCH_RATE " << rate << ", using " << SAMPLE_RATE << std::endl;
+    return SAMPLE_RATE;
+  }
+  return rate;
+}
+const int analysisPitchRate = pitchRateFromEnv();
+
+static unsigned stereoTargetsFromEnv() {
+  unsigned targets = stereoTargetsFromSpec(envString("ANALYSER_STEREO_TARGETS", "mid"));
+  return targets != 0 ? targets : 1u << TARGET_MID;
+}
+const unsigned stereoTargets = stereoTargetsFromEnv();
+
+const bool loudnessEnabled = envLong("ANALYSER_LOUDNESS", 1) != 0;
+
+const bool onsetEventsEnabled = envLong("ANALYSER_ONSET_EVENTS", 1) != 0;
+const onsetConfig_t onsetConfig = onsetConfigFromEnv(SAMPLE_RATE);
+
+const bool tempoEnabled = envLong("ANALYSER_TEMPO", 1) != 0;
+const tempoConfig_t tempoConfig = tempoConfigFromEnv();
+
+const spectrumConfig_t spectrumConfig = spectrumConfigFromEnv(MAX_OSC_PACKET_SIZE);
+
+const size_t analysisHop = std::clamp<long>(envLong("ANALYSER_HOP_SAMPLES", SAMPLES_PER_SUPERFRAME),
+                                            MIN_FRAME_SAMPLES, SAMPLES_PER_SUPERFRAME);
+
+int degradationLevel = FULL_ANALYSIS;
+static const float quietRms = envDouble("ANALYSER_QUIET_RMS", 100); // int16 scale, about -50dBFS
+
+gateStats_t gateStats;
+
+static float dbfsToLevel(double dbfs) {
+  return 32768.0 * std::pow(10.0, dbfs / 20.0); // samples stay at int16 scale
+}
+static const bool gateEnabled = envLong("ANALYSER_GATE", 1) != 0;
+static const float gateOpenRms = dbfsToLevel(envDouble("ANALYSER_GATE_OPEN_DBFS", -50));
+static const float gateCloseRms = dbfsToLevel(envDouble("ANALYSER_GATE_CLOSE_DBFS", -56));
+static const float GATE_PEAK_HEADROOM = std::pow(10.0, 15.0 / 20.0);
+// counted down once per analysed window, so in hops
+static const uint32_t gateHoldWindows =
+  envDouble("ANALYSER_GATE_HOLD_MS", 400) * SAMPLE_RATE / 1000.0 / analysisHop;
+
+unsigned degradedFeatureGroups(int level) {
+  if (level >= TIME_ONLY) return TIME_FEATURES;
+  unsigned groups = ALL_FEATURES;
+  if (level >= NO_PITCH) groups &= ~PITCH_FEATURES;
+  if (level >= NO_MFCC) groups &= ~MFCC_FEATURES;
+  return groups;
+}
+
+static_assert(FeatureBundle::size() <= MAX_OSC_PACKET_SIZE, "a mono bundle must fit");
+static_assert(maxStereoBundleSize() <= MAX_OSC_PACKET_SIZE, "a stereo bundle of every target must fit");
+
+// Per message, in group order
+using featureAddresses_t = std::array<std::string, 5>;
+static const featureAddresses_t MONO_ADDRESSES = {
+  TimeMessage::address, FreqMessage::address, OnsetMessage::address, PitchMessage::address, MfccMessage::address
+};
+static const std::array<featureAddresses_t, STEREO_TARGET_COUNT> TARGET_ADDRESSES = [] {
+  std::array<featureAddresses_t, STEREO_TARGET_COUNT> addresses;
+  for (size_t t = 0; t < STEREO_TARGET_COUNT; t++) {
+    for (size_t m = 0; m < MONO_ADDRESSES.size(); m++) {
+      addresses[t][m] = std::string("/") + stereoTargetName(t) + MONO_ADDRESSES[m];
+    }
+  }
+  return addresses;
+}();
+
+template <typename Packet>
+static void addFeatureMessages(Packet& packet, const featureAddresses_t& addresses,
+                               const features_t& features, unsigned groups) {
+  if (groups & TIME_FEATURES) TimeMessage::write(packet, addresses[0].c_str(), features);
+  if (groups & FREQ_FEATURES) FreqMessage::write(packet, addresses[1].c_str(), features);
+  if (groups & ONSET_FEATURES) OnsetMessage::write(packet, addresses[2].c_str(), features);
+  if (groups & PITCH_FEATURES) PitchMessage::write(packet, addresses[3].c_str(), features);
+  if (groups & MFCC_FEATURES) MfccMessage::write(packet, addresses[4].c_str(), features);
+}
+
+template <typename Packet>
+static void addLoudnessMessage(Packet& packet, const loudness_t* loudness) {
+  if (loudness) LoudnessMessage::write(packet, *loudness);
+}
+
+template <typename Packet>
+static void addTempoMessage(Packet& packet, const tempo_t* tempo) {
+  if (tempo) TempoMessage::write(packet, *tempo);
+}
+
+template <typename Packet>
+static void addOnsetEventMessage(Packet& packet, const onsetEvent_t* onsetEvent) {
+  if (onsetEvent) OnsetEventMessage::write(packet, *onsetEvent);
+}
+
+// Use the frameSequence as OSC timestamp, which is not correct, but might be enough
+template <typename Packet>
+static void openFeatureBundle(Packet& packet, int channelId, uint64_t frameSequence, int degradation) {
+//  const auto now = std::chrono::system_clock::now();
+//  unsigned long long timestamp = std::chrono::nanoseconds(now - startTime).count(); // TODO: this should be a 64bit NTP Timestamp
+  oscMeta_t meta;
+  meta.channelId = channelId;
+  meta.degradation = degradation;
+  packet
+    //.openBundle(timestamp)
+    .openBundle(frameSequence);
+  MetaMessage::write(packet, meta);
+}
+
+// Packets of one shape (which messages, so which addresses and tags) differ
+// only in their values, so each shape is encoded in full once, as a
+// template, and after that its bytes are copied and the values stored at
+// their offsets, with no checks or exceptions past the one that the
+// template fits. Per thread, as batch encodes on several.
+template <typename Encode>
+static size_t encodeWithTemplate(uint32_t shape, char* oscBuffer, Encode encode) {
+  static thread_local std::unordered_map<uint32_t, OSCPP::Client::PacketTemplate> templates;
+  const auto found = templates.find(shape);
+  if (found == templates.end()) {
+    OSCPP::Client::TemplateBuilder builder(oscBuffer, MAX_OSC_PACKET_SIZE);
+    encode(builder);
+    templates.emplace(shape, builder.finish());
+    return builder.size();
+  }
+  OSCPP::Client::TemplatePatcher patcher(found->second, oscBuffer, MAX_OSC_PACKET_SIZE);
+  if (patcher.status() != OSCPP::Status::Ok) return 0;
+  encode(patcher);
+  return patcher.size();
+}
+
+enum packetKind_t { FEATURE_PACKET, STEREO_PACKET, ONSET_EVENT_PACKET, TEMPO_PACKET, SILENT_PACKET };
+
+static uint32_t packetShape(packetKind_t kind, unsigned targets, unsigned groups, const loudness_t* loudness,
+                            const tempo_t* tempo, const onsetEvent_t* onsetEvent) {
+  static_assert(STEREO_TARGET_COUNT <= 8, "targets take 8 bits of the shape");
+  return kind | (groups & 0xff) << 4 | (targets & 0xff) << 12 | (loudness != nullptr) << 20 |
+         (tempo != nullptr) << 21 | (onsetEvent != nullptr) << 22;
+}
+
+size_t makeOscPacket(char* oscBuffer, int channelId, uint64_t frameSequence, const features_t& features,
+                     unsigned groups, int degradation, const loudness_t* loudness, const tempo_t* tempo,
+                     const onsetEvent_t* onsetEvent) {
+  const uint32_t shape = packetShape(FEATURE_PACKET, 0, groups, loudness, tempo, onsetEvent);
+  return encodeWithTemplate(shape, oscBuffer, [&](auto& packet) {
+    openFeatureBundle(packet, channelId, frameSequence, degradation);
+    addFeatureMessages(packet, MONO_ADDRESSES, features, groups);
+    addLoudnessMessage(packet, loudness);
+    addTempoMessage(packet, tempo);
+    addOnsetEventMessage(packet, onsetEvent);
+    packet.closeBundle();
+  });
+}
+
+size_t makeStereoOscPacket(char* oscBuffer, int channelId, uint64_t frameSequence, const stereoFeatures_t& features,
+                           unsigned targets, unsigned groups, int degradation, const loudness_t* loudness,
+                           const tempo_t* tempo, const onsetEvent_t* onsetEvent) {
+  const uint32_t shape = packetShape(STEREO_PACKET, targets, groups, loudness, tempo, onsetEvent);
+  return encodeWithTemplate(shape, oscBuffer, [&](auto& packet) {
+    openFeatureBundle(packet, channelId, frameSequence, degradation);
+    const bool single = (targets & (targets - 1)) == 0;
+    for (size_t t = 0; t < STEREO_TARGET_COUNT; t++) {
+      if (!(targets & (1u << t))) continue;
+      addFeatureMessages(packet, single ? MONO_ADDRESSES : TARGET_ADDRESSES[t], features[t], groups);
+    }
+    addLoudnessMessage(packet, loudness);
+    addTempoMessage(packet, tempo);
+    addOnsetEventMessage(packet, onsetEvent);
+    packet.closeBundle();
+  });
+}
+
+size_t makeOnsetEventPacket(char* oscBuffer, int channelId, uint64_t frameSequence, const onsetEvent_t& onsetEvent,
+                            int degradation) {
+  const uint32_t shape = packetShape(ONSET_EVENT_PACKET, 0, 0, nullptr, nullptr, &onsetEvent);
+  return encodeWithTemplate(shape, oscBuffer, [&](auto& packet) {
+    openFeatureBundle(packet, channelId, frameSequence, degradation);
+    addOnsetEventMessage(packet, &onsetEvent);
+    packet.closeBundle();
+  });
+}
+
+size_t makeTempoPacket(char* oscBuffer, int channelId, uint64_t frameSequence, const tempo_t& tempo, int degradation) {
+  const uint32_t shape = packetShape(TEMPO_PACKET, 0, 0, nullptr, &tempo, nullptr);
+  return encodeWithTemplate(shape, oscBuffer, [&](auto& packet) {
+    openFeatureBundle(packet, channelId, frameSequence, degradation);
+    addTempoMessage(packet, &tempo);
+    packet.closeBundle();
+  });
+}
+
+size_t makeSilentPacket(char* oscBuffer, int channelId, uint64_t frameSequence, float rms, float peak,
+                        int degradation, const onsetEvent_t* onsetEvent) {
+  const uint32_t shape = packetShape(SILENT_PACKET, 0, 0, nullptr, nullptr, onsetEvent);
+  return encodeWithTemplate(shape, oscBuffer, [&](auto& packet) {
+    openFeatureBundle(packet, channelId, frameSequence, degradation);
+    oscSilence_t silence;
+    silence.rms = rms;
+    silence.peak = peak;
+    SilentMessage::write(packet, silence);
+    addOnsetEventMessage(packet, onsetEvent);
+    packet.closeBundle();
+  });
+}
+
+void convertFrame(const int16_t* samples, float* data, int sampleCount) {
+  for(int i = 0; i < sampleCount; i++) {
+    *data++ = static_cast<float>(samples[i]); // little-endian int16_t to float32
+  }
+}
+
+void convertFrame(const int16_t* samples, float* data, int sampleCount, float& sumSquares, float& peak) {
+  float sum = 0;
+  int16_t maxSample = 0, minSample = 0;
+  for(int i = 0; i < sampleCount; i++) {
+    float x = static_cast<float>(samples[i]);
+    data[i] = x;
+    sum += x * x;
+    maxSample = std::max(maxSample, samples[i]);
+    minSample = std::min(minSample, samples[i]);
+  }
+  sumSquares += sum;
+  peak = std::max(peak, std::max(static_cast<float>(maxSample), -static_cast<float>(minSample)));
+}
+
+// convertFrame's level, for samples that were resampled after conversion
+static void accumulateLevel(const float* data, size_t count, float& sumSquares, float& peak) {
+  float sum = 0;
+  for (size_t i = 0; i < count; i++) {
+    sum += data[i] * data[i];
+    peak = std::max(peak, std::fabs(data[i]));
+  }
+  sumSquares += sum;
+}
+
+// The channel's resamplers, stereo window, loudness meter, onset detector and tempo tracker, on its first frame
+static void startChannel(channelState_t& channel, int channelId) {
+  if (channel.inputChannels == 2 && channel.superFrameRight.empty()) {
+    channel.superFrameRight.assign(SAMPLES_PER_SUPERFRAME, 0.0f);
+  }
+  if (channel.inputRate != SAMPLE_RATE && !channel.resampler) {
+    channel.resampler = makeResampler(channel.inputRate, SAMPLE_RATE, resamplerQuality);
+    if (!channel.resampler) {
+      std::cerr << "can't resample channel " << channelId << " from " << channel.inputRate << "Hz, analysing it as "
+                << SAMPLE_RATE << "Hz" << std::endl;
+      channel.inputRate = SAMPLE_RATE;
+    } else if (channel.inputChannels == 2) {
+      channel.rightResampler = makeResampler(channel.inputRate, SAMPLE_RATE, resamplerQuality);
+    }
+  }
+  if (loudnessEnabled && !channel.loudness) channel.loudness = std::make_unique<LoudnessMeter>(SAMPLE_RATE);
+  if ((onsetEventsEnabled || tempoEnabled) && !channel.onsets) {
+    channel.onsets = std::make_unique<OnsetDetector>(onsetConfig);
+  }
+  if (tempoEnabled && !channel.tempo) channel.tempo = std::make_unique<TempoTracker>(tempoConfig, SAMPLE_RATE);
+  if (spectrumConfig.streams && !channel.spectrum) {
+    channel.spectrum = std::make_unique<SpectrumStreamer>(spectrumConfig, SAMPLE_RATE, SAMPLES_PER_SUPERFRAME);
+  }
+  // stereo takes pitch from each target's full window
+  if (analysisPitchRate != SAMPLE_RATE && channel.inputChannels == 1 && !channel.pitchResampler) {
+    channel.pitchResampler = makeResampler(SAMPLE_RATE, analysisPitchRate, resamplerQuality);
+    channel.pitchWindow.assign(SAMPLES_PER_SUPERFRAME * analysisPitchRate / SAMPLE_RATE, 0.0f);
+    channel.pitchPosition = 0;
+  }
+}
+
+// Decimate samples new to the window into the pitch sub-stream's ring
+static void decimateForPitch(channelState_t& channel, const float* samples, size_t count) {
+  std::vector<float>& ring = channel.pitchWindow;
+  for (size_t used = 0; count > 0; samples += used, count -= used) {
+    size_t produced = channel.pitchResampler->process(samples, count, ring.data() + channel.pitchPosition,
+                                                      ring.size() - channel.pitchPosition, used);
+    channel.pitchPosition = (channel.pitchPosition + produced) % ring.size();
+  }
+}
+
+// ANALYSER_ENGINE, or gist if that's unknown
+static std::unique_ptr<FeatureEngine> makeEngine(int sampleRate) {
+  auto engine = makeFeatureEngine(analysisEngine, sampleRate);
+  if (!engine) {
+    std::cerr << "unknown ANALYSER_ENGINE '" << analysisEngine << "', using gist" << std::endl;
+    engine = makeFeatureEngine("gist", sampleRate);
+  }
+  return engine;
+}
+
+// Returns whether the channel should be analysed this window
+static bool updateGate(channelState_t& channel, float rms, float peak) {
+  if (rms >= gateOpenRms || peak >= gateOpenRms * GATE_PEAK_HEADROOM) {
+    channel.gateOpen = true;
+    channel.gateHold = gateHoldWindows;
+  } else if (rms < gateCloseRms && peak < gateCloseRms * GATE_PEAK_HEADROOM) {
+    if (channel.gateHold == 0) channel.gateOpen = false;
+    else channel.gateHold--;
+  } else {
+    channel.gateHold = gateHoldWindows; // in the hysteresis band, stay as we are
+  }
+  return channel.gateOpen;
+}
+
+void reportGateStats(std::ostream& out) {
+  uint64_t superFrames = gateStats.superFrames.exchange(0);
+  uint64_t gated = gateStats.gated.exchange(0);
+  uint64_t analysed = gateStats.analysed.exchange(0);
+  uint64_t nanoseconds = gateStats.analysisNanoseconds.exchange(0);
+  if (superFrames == 0) return;
+  double meanMs = analysed > 0 ? nanoseconds / 1e6 / analysed : 0;
+  out << "analyser: silence gate skipped " << gated << " of " << superFrames << " superframes ("
+      << 100 * gated / superFrames << "%), saving ~" << static_cast<uint64_t>(gated * meanMs)
+      << "ms CPU at " << meanMs << "ms per analysis" << std::endl;
+}
+
+// Analyse a full superframe window into oscBuffer, with any onsetEvent, returning the bundle size or 0
+static size_t analyseWindow(channelState_t& channel, int channelId, uint64_t frameSequence, char* oscBuffer,
+                            const onsetEvent_t* onsetEvent) {
+  // level of the samples new since the last window, for the silence gate
+  float rms = std::sqrt(channel.sumSquares / std::max<size_t>(channel.levelSamples, 1));
+  float peak = channel.peak;
+  channel.sumSquares = 0;
+  channel.peak = 0;
+  channel.levelSamples = 0;
+  gateStats.superFrames.fetch_add(1, std::memory_order_relaxed);
+
+  int degradation = degradationLevel;
+  if (gateEnabled && !updateGate(channel, rms, peak)) {
+    gateStats.gated.fetch_add(1, std::memory_order_relaxed);
+    channel.features[RMS] = rms;
+    TraceScope trace(TraceStage::encode, channelId, frameSequence);
+    return makeSilentPacket(oscBuffer, channelId, frameSequence, rms, peak, degradation, onsetEvent);
+  }
+
+  // Under load, quiet channels are the cheapest to lose detail on
+  if (degradation >= QUIET_HALF_RATE && channel.superFrames++ % 2 == 1 && channel.features[RMS] < quietRms) {
+    return onsetEvent ? makeOnsetEventPacket(oscBuffer, channelId, frameSequence, *onsetEvent, degradation) : 0;
+  }
+  unsigned groups = degradedFeatureGroups(degradation);
+  const bool pitchSubStream = channel.pitchResampler && (groups & PITCH_FEATURES);
+
+  // Analyse (with Gist by default) and then make an OSC packet
+  const bool stereo = channel.inputChannels == 2;
+  if (!channel.engine && !stereo) channel.engine = makeEngine(SAMPLE_RATE);
+  if (!channel.stereoEngine && stereo) channel.stereoEngine = makeStereoFeatureEngine(SAMPLE_RATE);
+  {
+    TraceScope trace(TraceStage::features, channelId, frameSequence);
+    auto start = std::chrono::steady_clock::now();
+    if (stereo) {
+      channel.stereoEngine->analyse(channel.superFrame.data(), channel.superFrameRight.data(), SAMPLES_PER_SUPERFRAME,
+                                    groups, stereoTargets, channel.stereoFeatures);
+      // the first target stands in for the channel's level
+      channel.features[RMS] = channel.stereoFeatures[__builtin_ctz(stereoTargets)][RMS];
+    } else {
+      channel.engine->analyse(channel.superFrame.data(), SAMPLES_PER_SUPERFRAME,
+                              pitchSubStream ? groups & ~PITCH_FEATURES : groups, channel.features);
+    }
+    if (pitchSubStream) {
+      if (!channel.pitchEngine) channel.pitchEngine = makeEngine(analysisPitchRate);
+      float window[SAMPLES_PER_SUPERFRAME];
+      const std::vector<float>& ring = channel.pitchWindow;
+      std::rotate_copy(ring.begin(), ring.begin() + channel.pitchPosition, ring.end(), window);
+      channel.pitchEngine->analyse(window, ring.size(), PITCH_FEATURES, channel.features);
+    }
+    gateStats.analysisNanoseconds.fetch_add(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count(),
+      std::memory_order_relaxed);
+    gateStats.analysed.fetch_add(1, std::memory_order_relaxed);
+  }
+  if (channel.spectrum && degradation < NO_MFCC) {
+    TraceScope trace(TraceStage::spectrum, channelId, frameSequence);
+    if (stereo) {
+      float mid[SAMPLES_PER_SUPERFRAME];
+      for (size_t i = 0; i < SAMPLES_PER_SUPERFRAME; i++) {
+        mid[i] = 0.5f * (channel.superFrame[i] + channel.superFrameRight[i]);
+      }
+      channel.spectrum->analyse(mid, channelId, frameSequence, degradation);
+    } else {
+      channel.spectrum->analyse(channel.superFrame.data(), channelId, frameSequence, degradation);
+    }
+  }
+  loudness_t loudness;
+  if (channel.loudness) loudness = channel.loudness->read();
+  tempo_t tempo;
+  if (channel.tempo) tempo = channel.tempo->read();
+  TraceScope trace(TraceStage::encode, channelId, frameSequence);
+  if (stereo) {
+    return makeStereoOscPacket(oscBuffer, channelId, frameSequence, channel.stereoFeatures, stereoTargets, groups,
+                               degradation, channel.loudness ? &loudness : nullptr, channel.tempo ? &tempo : nullptr,
+                               onsetEvent);
+  }
+  return makeOscPacket(oscBuffer, channelId, frameSequence, channel.features, groups, degradation,
+                       channel.loudness ? &loudness : nullptr, channel.tempo ? &tempo : nullptr, onsetEvent);
+}
+
+size_t analyseFrame(channelState_t& channel, int channelId, uint64_t frameSequence,
+                    const int16_t* samples, int sampleCount, size_t& consumed, char* oscBuffer) {
+  startChannel(channel, channelId);
+  // Fill the superframe window by sample count, whatever size frames Jamulus
+  // is sending. Samples from Jamulus are int16_t, Gist wants float32, so convert.
+  float* window = channel.superFrame.data() + channel.superFrameFill;
+  const size_t space = SAMPLES_PER_SUPERFRAME - channel.superFrameFill;
+  size_t produced;
+  {
+    TraceScope trace(TraceStage::convert, channelId, frameSequence);
+    if (channel.inputChannels == 2) {
+      // deinterleave into the pair of windows, through the resamplers if need be
+      float* right = channel.superFrameRight.data() + channel.superFrameFill;
+      const size_t frames = std::min<size_t>(sampleCount / 2, MAX_FRAME_SAMPLES / 2);
+      size_t used;
+      if (!channel.resampler) {
+        used = produced = std::min(frames, space);
+        deinterleave(samples, window, right, produced);
+      } else {
+        float leftInput[MAX_FRAME_SAMPLES / 2], rightInput[MAX_FRAME_SAMPLES / 2];
+        deinterleave(samples, leftInput, rightInput, frames);
+        produced = channel.resampler->process(leftInput, frames, window, space, used);
+        channel.rightResampler->process(rightInput, frames, right, space, used); // in step with the left
+      }
+      consumed = 2 * used;
+      accumulateLevel(window, produced, channel.sumSquares, channel.peak);
+      accumulateLevel(right, produced, channel.sumSquares, channel.peak);
+    } else if (!channel.resampler) {
+      consumed = produced = std::min<size_t>(sampleCount, space);
+      convertFrame(samples, window, consumed, channel.sumSquares, channel.peak);
+    } else {
+      // then to SAMPLE_RATE, straight into the window
+      float input[MAX_FRAME_SAMPLES];
+      const size_t count = std::min<size_t>(sampleCount, MAX_FRAME_SAMPLES);
+      convertFrame(samples, input, count);
+      produced = channel.resampler->process(input, count, window, space, consumed);
+      accumulateLevel(window, produced, channel.sumSquares, channel.peak);
+    }
+    if (channel.pitchResampler) decimateForPitch(channel, window, produced);
+  }
+  if (channel.loudness) {
+    TraceScope trace(TraceStage::loudness, channelId, frameSequence);
+    const float* right = channel.inputChannels == 2 ? channel.superFrameRight.data() + channel.superFrameFill : nullptr;
+    channel.loudness->process(window, right, produced);
+  }
+  onsetEvent_t onsetEvent;
+  bool onset = false;
+  if (channel.onsets && degradationLevel >= TIME_ONLY) {
+    channel.onsets->reset(); // no FFTs, and stale history when they're back
+  } else if (channel.onsets) {
+    TraceScope trace(TraceStage::onset, channelId, frameSequence);
+    if (channel.inputChannels == 2) {
+      const float* right = channel.superFrameRight.data() + channel.superFrameFill;
+      float mid[SAMPLES_PER_SUPERFRAME]; // produced can be more than a frame when resampling up
+      for (size_t i = 0; i < produced; i++) mid[i] = 0.5f * (window[i] + right[i]);
+      onset = channel.onsets->process(mid, produced, onsetEvent);
+    } else {
+      onset = channel.onsets->process(window, produced, onsetEvent);
+    }
+    onset = onset && onsetEventsEnabled;
+    if (channel.tempo) channel.tempo->process(channel.onsets->hopFluxes().data(), channel.onsets->hopFluxes().size());
+  }
+  channel.superFrameFill += produced;
+  channel.levelSamples += produced * channel.inputChannels;
+  if (channel.superFrameFill < SAMPLES_PER_SUPERFRAME) {
+    // keep filling up the superframe, sending any onset now rather than with the window
+    if (!onset) return 0;
+    TraceScope trace(TraceStage::encode, channelId, frameSequence);
+    return makeOnsetEventPacket(oscBuffer, channelId, frameSequence, onsetEvent, degradationLevel);
+  }
+
+  size_t bundleSize = analyseWindow(channel, channelId, frameSequence, oscBuffer, onset ? &onsetEvent : nullptr);
+  // slide on by the hop, keeping any overlap
+  std::copy(channel.superFrame.begin() + analysisHop, channel.superFrame.end(), channel.superFrame.begin());
+  if (channel.inputChannels == 2) {
+    std::copy(channel.superFrameRight.begin() + analysisHop, channel.superFrameRight.end(),
+              channel.superFrameRight.begin());
+  }
+  channel.superFrameFill = SAMPLES_PER_SUPERFRAME - analysisHop;
+  return bundleSize;
+}
+
+size_t nextSpectrumPacket(channelState_t& channel, char* oscBuffer) {
+  return channel.spectrum ? channel.spectrum->nextPacket(oscBuffer) : 0;
+}
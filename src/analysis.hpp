@@ -0,0 +1,178 @@
+#ifndef ANALYSER_ANALYSIS_HPP
+#define ANALYSER_ANALYSIS_HPP
+
+#include <array>
+#include <cstddef>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "features.hpp"
+#include "loudness.hpp"
+#include "onset.hpp"
+#include "resampler.hpp"
+#include "spectrum.hpp"
+#include "stereo.hpp"
+#include "tempo.hpp"
+
+// Shared by live (mq) and batch (wav) analysis so they produce the same bundles
+
+const int SAMPLE_RATE = 48000; // the analysis rate, what Jamulus sends; other sources are resampled to it
+
+constexpr float FRAMES_PER_SUPERFRAME = 8.0; // 25 frames would be 1/15th of a sec
+constexpr float SAMPLES_PER_FRAME = 128.0; // Jamulus' default buffer; 64 and 256 work too
+constexpr size_t SAMPLES_PER_SUPERFRAME = SAMPLES_PER_FRAME * FRAMES_PER_SUPERFRAME; // the analysis window
+constexpr size_t MIN_FRAME_SAMPLES = 64;
+constexpr size_t MAX_FRAME_SAMPLES = 1024; // a whole mq message of int16
+
+// ANALYSER_HOP_SAMPLES between analyses, by default a whole window. Less overlaps the windows.
+extern const size_t analysisHop;
+
+const size_t MAX_OSC_PACKET_SIZE = 1380; // stereo with every target needs maxStereoBundleSize() (oscschema.hpp), checked at compile time; safe max is ethernet packet MTU 1500 (minus overhead gives max 1380) https://superuser.com/questions/1341012/practical-vs-theoretical-max-limit-of-tcp-packet-size
+
+// ANALYSER_ENGINE picks the feature engine, see features.hpp
+extern const std::string analysisEngine;
+
+// Sources not at SAMPLE_RATE are resampled to it before windowing, at
+// ANALYSER_RESAMPLER_QUALITY (fast, medium or best, see resampler.hpp).
+// ANALYSER_PITCH_RATE, e.g. 16000, takes pitch from a sub-stream decimated
+// to that rate instead of the full bandwidth window, which it doesn't need.
+extern const ResamplerQuality resamplerQuality;
+extern const int analysisPitchRate;
+
+// ANALYSER_STEREO_TARGETS for stereo channels, by default just mid (see stereo.hpp)
+extern const unsigned stereoTargets;
+
+// Each channel's loudness (see loudness.hpp) goes in every analysed bundle as
+// /loudness momentary shortTerm integrated truePeak, in LUFS and dBTP. A
+// stereo channel's covers both sides. ANALYSER_LOUDNESS=0 turns it off.
+extern const bool loudnessEnabled;
+
+// Onset events (see onset.hpp) are sent as /onset/event strength latency as
+// soon as each is confirmed, a few ms after the onset, rather than waiting
+// for the window. latency is in samples at SAMPLE_RATE, from the onset back
+// from the end of the frame in the bundle's timestamp. A stereo channel's
+// come from the mid. ANALYSER_ONSET_EVENTS=0 turns them off; TIME_ONLY
+// degradation pauses them.
+extern const bool onsetEventsEnabled;
+extern const onsetConfig_t onsetConfig;
+
+// Each channel's tempo (see tempo.hpp), from its onset flux, goes in every
+// analysed bundle as /tempo bpm confidence phase. Live, with more than one
+// channel, the ensemble's goes to the oscserver too, under /meta
+// ENSEMBLE_CHANNEL_ID. ANALYSER_TEMPO=0 turns it off.
+extern const bool tempoEnabled;
+extern const tempoConfig_t tempoConfig;
+constexpr int ENSEMBLE_CHANNEL_ID = -1;
+
+// Each analysed window's spectrum and mel bands (see spectrum.hpp), of the
+// mid for a stereo channel, when ANALYSER_SPECTRUM asks for them. They're
+// sent in packets of their own after the window's bundle, fragmented when
+// one won't fit in ANALYSER_SPECTRUM_MTU, and paused from NO_MFCC on.
+extern const spectrumConfig_t spectrumConfig;
+
+// Load shedding, set by the DegradationController (loadshed.hpp) and sent in
+// /meta. Each level keeps the savings of the ones before it.
+enum DEGRADATION {
+  FULL_ANALYSIS = 0,
+  QUIET_HALF_RATE = 1,  // channels under ANALYSER_QUIET_RMS skip every other superframe
+  NO_PITCH = 2,
+  NO_MFCC = 3,
+  TIME_ONLY = 4,        // no FFT at all
+  MAX_DEGRADATION = TIME_ONLY
+};
+extern int degradationLevel;
+unsigned degradedFeatureGroups(int level);
+
+// Per-channel analysis state within a session
+struct channelState_t {
+  std::array<float, SAMPLES_PER_SUPERFRAME> superFrame;
+  size_t superFrameFill = 0; // samples
+  std::unique_ptr<FeatureEngine> engine; // created on the first superframe
+  features_t features = {};
+  uint32_t superFrames = 0;
+  // silence gate, see below
+  float sumSquares = 0;
+  float peak = 0;
+  size_t levelSamples = 0;
+  bool gateOpen = false;
+  uint32_t gateHold = 0; // windows left before a quiet channel closes
+  // input format, the rest is set up on the first frame
+  int inputRate = SAMPLE_RATE; // of the samples given to analyseFrame
+  int inputChannels = 1; // or 2 for interleaved stereo, when superFrame holds the left
+  std::vector<float> superFrameRight;
+  std::unique_ptr<StereoFeatureEngine> stereoEngine;
+  stereoFeatures_t stereoFeatures = {};
+  std::unique_ptr<Resampler> resampler; // to SAMPLE_RATE, when inputRate isn't
+  std::unique_ptr<Resampler> rightResampler;
+  std::unique_ptr<Resampler> pitchResampler; // to analysisPitchRate, when it isn't SAMPLE_RATE
+  std::unique_ptr<FeatureEngine> pitchEngine;
+  std::vector<float> pitchWindow; // ring of the latest window of the pitch sub-stream
+  size_t pitchPosition = 0;
+  std::unique_ptr<LoudnessMeter> loudness; // fed every sample, gated or not
+  std::unique_ptr<OnsetDetector> onsets;   // likewise
+  std::unique_ptr<TempoTracker> tempo;     // fed the onset flux
+  std::unique_ptr<SpectrumStreamer> spectrum; // when ANALYSER_SPECTRUM asks
+};
+
+// Samples from Jamulus are int16_t, Gist wants float32
+void convertFrame(const int16_t* samples, float* data, int sampleCount);
+// Also accumulates the level, for the silence gate
+void convertFrame(const int16_t* samples, float* data, int sampleCount, float& sumSquares, float& peak);
+
+// Silence gate: a superframe whose RMS and peak (from conversion) stay under
+// ANALYSER_GATE_CLOSE_DBFS for ANALYSER_GATE_HOLD_MS skips analysis and is
+// sent as a compact bundle of /meta and /silent rms peak. It opens again as
+// soon as the RMS passes ANALYSER_GATE_OPEN_DBFS, or the peak passes it by
+// 15dB. ANALYSER_GATE=0 analyses everything.
+struct gateStats_t {
+  std::atomic<uint64_t> superFrames{ 0 };
+  std::atomic<uint64_t> gated{ 0 };
+  std::atomic<uint64_t> analysed{ 0 };
+  std::atomic<uint64_t> analysisNanoseconds{ 0 }; // engine time over the analysed superframes
+};
+extern gateStats_t gateStats;
+// Gated share and the CPU that saved, estimated from the mean analysis cost; then resets
+void reportGateStats(std::ostream& out);
+
+// Any of these bundles carries an /onset/event last when there's one to send
+size_t makeSilentPacket(char* oscBuffer, int channelId, uint64_t frameSequence, float rms, float peak,
+                        int degradation, const onsetEvent_t* onsetEvent = nullptr);
+// Just /meta and the event, for one confirmed between windows
+size_t makeOnsetEventPacket(char* oscBuffer, int channelId, uint64_t frameSequence, const onsetEvent_t& onsetEvent,
+                            int degradation);
+// Just /meta and /tempo, for the ensemble
+size_t makeTempoPacket(char* oscBuffer, int channelId, uint64_t frameSequence, const tempo_t& tempo, int degradation);
+
+// Only the messages for groups are written. /meta is channelId, degradation level.
+// /loudness and /tempo follow the features when there are those to send.
+size_t makeOscPacket(char* oscBuffer, int channelId, uint64_t frameSequence, const features_t& features,
+                     unsigned groups = ALL_FEATURES, int degradation = FULL_ANALYSIS,
+                     const loudness_t* loudness = nullptr, const tempo_t* tempo = nullptr,
+                     const onsetEvent_t* onsetEvent = nullptr);
+// A single target is sent as a mono channel would be, several each under
+// their own prefix: /L/time, /side/mfcc and so on.
+size_t makeStereoOscPacket(char* oscBuffer, int channelId, uint64_t frameSequence, const stereoFeatures_t& features,
+                           unsigned targets, unsigned groups = ALL_FEATURES, int degradation = FULL_ANALYSIS,
+                           const loudness_t* loudness = nullptr, const tempo_t* tempo = nullptr,
+                           const onsetEvent_t* onsetEvent = nullptr);
+
+// Merge samples from a frame of any size into the channel's superframe,
+// resampled from its inputRate, up to the end of the window, and set
+// consumed to how many were taken. Stereo samples are interleaved pairs,
+// counted as two in sampleCount and consumed. When that completes the
+// window, analyse it into an OSC bundle in oscBuffer (MAX_OSC_PACKET_SIZE)
+// and return its size. Otherwise return the size of an onset event bundle
+// if one was confirmed in the samples, or 0. Call again with the rest of
+// the frame until it's all consumed. Frames must be in sequence, with gaps
+// already concealed (live input goes through a JitterBuffer first).
+size_t analyseFrame(channelState_t& channel, int channelId, uint64_t frameSequence,
+                    const int16_t* samples, int sampleCount, size_t& consumed, char* oscBuffer);
+
+// After each bundle analyseFrame returns, the window's spectrum packets, if
+// any: copies the next into oscBuffer and returns its size, or 0 when done.
+size_t nextSpectrumPacket(channelState_t& channel, char* oscBuffer);
+
+#endif // ANALYSER_ANALYSIS_HPP
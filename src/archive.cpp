@@ -0,0 +1,661 @@
+#include "archive.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <oscpp/client.hpp>
+#include <oscpp/server.hpp>
+#include "oscsfile.hpp"
+
+static const char ARCHIVE_MAGIC[4] = { 'O', 'S', 'C', 'A' };
+static constexpr uint8_t ARCHIVE_VERSION = 3; // 2 had no blob args, 1 also stored Q8 min and max in host (in practice little endian) order
+static constexpr uint8_t RECORD_SCHEMA = 'S';
+static constexpr uint8_t RECORD_FRAME = 'F';
+static constexpr uint8_t NO_WINDOW = 0xff; // predictor has no leading/trailing window yet
+static constexpr size_t WRITE_BLOCK_SIZE = 64 * 1024;
+
+// ---- scalar conversions
+
+static uint32_t floatBits(float x) { uint32_t u; std::memcpy(&u, &x, 4); return u; }
+static float bitsFloat(uint32_t u) { float x; std::memcpy(&x, &u, 4); return x; }
+
+int32_t archiveValueAsInt(float value) {
+  return static_cast<int32_t>(floatBits(value));
+}
+
+// IEEE 754 binary16, rounding half away from zero and saturating at +-65504
+static uint16_t floatToHalf(float x) {
+  uint32_t f = floatBits(x);
+  uint32_t sign = (f >> 16) & 0x8000;
+  uint32_t exponent = (f >> 23) & 0xff;
+  uint32_t mantissa = f & 0x7fffff;
+  if (exponent == 0xff) return sign | 0x7c00 | (mantissa ? 0x200 : 0);
+  int32_t halfExponent = static_cast<int32_t>(exponent) - 127 + 15;
+  if (halfExponent >= 31) return sign | 0x7bff;
+  if (halfExponent <= 0) {
+    if (halfExponent < -10) return sign;
+    mantissa |= 0x800000;
+    uint32_t shift = 14 - halfExponent;
+    return sign | ((mantissa + (1u << (shift - 1))) >> shift);
+  }
+  uint32_t half = sign | (halfExponent << 10) | (mantissa >> 13);
+  if (mantissa & 0x1000) half++; // may carry into the exponent, which is still correct
+  if ((half & 0x7fff) >= 0x7c00) half = sign | 0x7bff;
+  return half;
+}
+
+static float halfToFloat(uint16_t h) {
+  uint32_t sign = static_cast<uint32_t>(h & 0x8000) << 16;
+  uint32_t exponent = (h >> 10) & 0x1f;
+  uint32_t mantissa = h & 0x3ff;
+  if (exponent == 0) {
+    float x = std::ldexp(static_cast<float>(mantissa), -24);
+    return sign ? -x : x;
+  }
+  if (exponent == 31) return bitsFloat(sign | 0x7f800000 | (mantissa << 13));
+  return bitsFloat(sign | ((exponent - 15 + 127) << 23) | (mantissa << 13));
+}
+
+static uint8_t floatToQ8(float x, float min, float max) {
+  if (!(max > min)) return 0;
+  float scaled = (x - min) / (max - min) * 255.0f;
+  if (!(scaled > 0.0f)) return 0; // also catches NaN
+  if (scaled >= 255.0f) return 255;
+  return static_cast<uint8_t>(scaled + 0.5f);
+}
+
+static float q8ToFloat(uint8_t q, float min, float max) {
+  return min + (max - min) * (q / 255.0f);
+}
+
+double archiveErrorBound(const archiveMessage_t& message, float x) {
+  switch (message.encoding) {
+    case ENCODING_XOR:
+      return 0.0;
+    case ENCODING_F16: {
+      double magnitude = std::fabs(x);
+      if (magnitude > 65504.0) return magnitude - 65504.0;
+      return std::max(magnitude / 2048.0, std::ldexp(1.0, -25));
+    }
+    case ENCODING_Q8: {
+      // half a quantisation step, plus float rounding in the decode
+      double step = (static_cast<double>(message.max) - message.min) / 510.0
+        + std::ldexp(std::fabs(message.min) + std::fabs(message.max), -22);
+      if (x < message.min) return (message.min - x) + step;
+      if (x > message.max) return (x - message.max) + step;
+      return step;
+    }
+  }
+  return 0.0;
+}
+
+// ---- encoding spec
+
+ArchiveEncodingSpec::ArchiveEncodingSpec(const std::string& spec) {
+  std::stringstream entries(spec);
+  std::string entry;
+  while (std::getline(entries, entry, ',')) {
+    size_t equals = entry.find('=');
+    if (equals == std::string::npos) {
+      std::cerr << "ignoring archive encoding '" << entry << "', expected address=encoding" << std::endl;
+      continue;
+    }
+    archiveMessage_t m;
+    m.address = entry.substr(0, equals);
+    std::string encoding = entry.substr(equals + 1);
+    double bound = -1;
+    const size_t tilde = encoding.find('~');
+    if (tilde != std::string::npos) {
+      char* end;
+      bound = std::strtod(encoding.c_str() + tilde + 1, &end);
+      if (*end != '\0' || !(bound >= 0)) {
+        std::cerr << "ignoring archive encoding '" << entry << "', expected ~ and a bound of 0 or more" << std::endl;
+        continue;
+      }
+      encoding.resize(tilde);
+    }
+    if (encoding == "xor") {
+      m.encoding = ENCODING_XOR;
+    } else if (encoding == "f16") {
+      m.encoding = ENCODING_F16;
+    } else if (encoding.rfind("q8:", 0) == 0 && std::sscanf(encoding.c_str(), "q8:%f:%f", &m.min, &m.max) == 2 && m.max > m.min) {
+      m.encoding = ENCODING_Q8;
+    } else {
+      std::cerr << "ignoring archive encoding '" << entry << "', expected xor, f16 or q8:min:max" << std::endl;
+      continue;
+    }
+    encodings[m.address] = m;
+    if (bound >= 0) bounds[m.address] = bound;
+  }
+}
+
+double ArchiveEncodingSpec::errorBound(const archiveMessage_t& message, float x) const {
+  auto it = bounds.find(message.address);
+  return it == bounds.end() ? archiveErrorBound(message, x) : it->second;
+}
+
+void ArchiveEncodingSpec::apply(archiveMessage_t& message) const {
+  auto it = encodings.find(message.address);
+  if (it == encodings.end()) return;
+  message.encoding = it->second.encoding;
+  message.min = it->second.min;
+  message.max = it->second.max;
+}
+
+// ---- bit streams
+
+namespace {
+
+class BitWriter {
+public:
+  explicit BitWriter(std::string& out) : out(out) {}
+  void put(uint32_t value, unsigned n) { // n <= 32
+    if (n == 0) return;
+    accumulator = (accumulator << n) | (value & (n == 32 ? 0xffffffffu : ((1u << n) - 1)));
+    count += n;
+    while (count >= 8) {
+      count -= 8;
+      out.push_back(static_cast<char>(accumulator >> count));
+    }
+  }
+  void finish() { // pad to a byte boundary
+    if (count > 0) put(0, 8 - count);
+  }
+private:
+  std::string& out;
+  uint64_t accumulator = 0;
+  unsigned count = 0;
+};
+
+class BitReader {
+public:
+  BitReader(const uint8_t*& pos, const uint8_t* end) : pos(pos), end(end) {}
+  bool get(unsigned n, uint32_t& value) { // n <= 32
+    while (count < n) {
+      if (pos == end) return false;
+      accumulator = (accumulator << 8) | *pos++;
+      count += 8;
+    }
+    count -= n;
+    value = static_cast<uint32_t>(accumulator >> count) & (n == 32 ? 0xffffffffu : ((1u << n) - 1));
+    return true;
+  }
+private:
+  const uint8_t*& pos;
+  const uint8_t* end;
+  uint64_t accumulator = 0;
+  unsigned count = 0;
+};
+
+void putVarint(std::string& out, uint64_t x) {
+  while (x >= 0x80) {
+    out.push_back(static_cast<char>(x | 0x80));
+    x >>= 7;
+  }
+  out.push_back(static_cast<char>(x));
+}
+
+bool getVarint(const uint8_t*& pos, const uint8_t* end, uint64_t& x) {
+  x = 0;
+  for (unsigned shift = 0; shift < 64 && pos < end; shift += 7) {
+    uint8_t b = *pos++;
+    x |= static_cast<uint64_t>(b & 0x7f) << shift;
+    if ((b & 0x80) == 0) return true;
+  }
+  return false;
+}
+
+void putBigEndian32(std::string& out, uint32_t x) {
+  for (int shift = 24; shift >= 0; shift -= 8) out.push_back(static_cast<char>(x >> shift));
+}
+
+uint32_t getBigEndian32(const uint8_t* p) {
+  return static_cast<uint32_t>(p[0]) << 24 | p[1] << 16 | p[2] << 8 | p[3];
+}
+
+uint32_t getLittleEndian32(const uint8_t* p) {
+  return static_cast<uint32_t>(p[3]) << 24 | p[2] << 16 | p[1] << 8 | p[0];
+}
+
+uint64_t zigzag(int64_t x) { return (static_cast<uint64_t>(x) << 1) ^ static_cast<uint64_t>(x >> 63); }
+int64_t unzigzag(uint64_t x) { return static_cast<int64_t>(x >> 1) ^ -static_cast<int64_t>(x & 1); }
+
+void encodeXor(BitWriter& bits, archivePredictor_t& p, size_t i, uint32_t value) {
+  uint32_t x = value ^ p.previous[i];
+  p.previous[i] = value;
+  if (x == 0) {
+    bits.put(0, 1);
+    return;
+  }
+  uint8_t leading = __builtin_clz(x);
+  uint8_t trailing = __builtin_ctz(x);
+  if (p.leading[i] != NO_WINDOW && leading >= p.leading[i] && trailing >= p.trailing[i]) {
+    bits.put(0b10, 2);
+    bits.put(x >> p.trailing[i], 32 - p.leading[i] - p.trailing[i]);
+    return;
+  }
+  unsigned length = 32 - leading - trailing;
+  bits.put(0b11, 2);
+  bits.put(leading, 5);
+  bits.put(length - 1, 5);
+  bits.put(x >> trailing, length);
+  p.leading[i] = leading;
+  p.trailing[i] = trailing;
+}
+
+bool decodeXor(BitReader& bits, archivePredictor_t& p, size_t i, uint32_t& value) {
+  uint32_t flag;
+  if (!bits.get(1, flag)) return false;
+  if (flag == 0) {
+    value = p.previous[i];
+    return true;
+  }
+  if (!bits.get(1, flag)) return false;
+  uint32_t x;
+  if (flag == 0) {
+    if (p.leading[i] == NO_WINDOW) return false;
+    if (!bits.get(32 - p.leading[i] - p.trailing[i], x)) return false;
+    x <<= p.trailing[i];
+  } else {
+    uint32_t leading, length;
+    if (!bits.get(5, leading) || !bits.get(5, length)) return false;
+    length += 1;
+    if (leading + length > 32) return false;
+    if (!bits.get(length, x)) return false;
+    uint32_t trailing = 32 - leading - length;
+    x <<= trailing;
+    p.leading[i] = leading;
+    p.trailing[i] = trailing;
+  }
+  value = p.previous[i] ^ x;
+  p.previous[i] = value;
+  return true;
+}
+
+// Flatten a bundle of int/float/blob messages into a shape signature
+// ("address\0tags\0" per message), its values and its blobs.
+bool flattenBundle(const char* packet, size_t size, uint64_t& time, std::string& signature, std::vector<float>& values,
+                   std::vector<std::string>& blobs) {
+  signature.clear();
+  values.clear();
+  size_t blobCount = 0;
+  try {
+    OSCPP::Server::Packet p(packet, size);
+    if (!p.isBundle()) return false;
+    OSCPP::Server::Bundle bundle(p);
+    time = bundle.time();
+    OSCPP::Server::PacketStream packets(bundle.packets());
+    while (!packets.atEnd()) {
+      OSCPP::Server::Packet element = packets.next();
+      if (!element.isMessage()) return false;
+      OSCPP::Server::Message message(element);
+      signature.append(message.address());
+      signature.push_back('\0');
+      OSCPP::Server::ArgStream args(message.args());
+      while (!args.atEnd()) {
+        char tag = args.tag();
+        if (tag == 'i') {
+          values.push_back(bitsFloat(static_cast<uint32_t>(args.int32())));
+        } else if (tag == 'f') {
+          values.push_back(args.float32());
+        } else if (tag == 'b') {
+          OSCPP::Blob blob = args.blob();
+          if (blobs.size() <= blobCount) blobs.emplace_back();
+          blobs[blobCount++].assign(static_cast<const char*>(blob.data()), blob.size());
+        } else {
+          return false;
+        }
+        signature.push_back(tag);
+      }
+      signature.push_back('\0');
+    }
+  } catch (const OSCPP::Error& e) {
+    return false;
+  }
+  blobs.resize(blobCount); // keeping the rest's capacity
+  return true;
+}
+
+size_t oscBundleSize(const archiveSchema_t& schema) {
+  size_t size = OSCPP::Size::bundle(schema.messages.size());
+  for (const auto& m : schema.messages) {
+    size += OSCPP::Size::string(m.address.size()) + OSCPP::align(m.tags.size() + 2) + OSCPP::Size::int32(m.tags.size());
+  }
+  return size;
+}
+
+void countArgs(archiveSchema_t& schema, const archiveMessage_t& m) {
+  const size_t blobs = std::count(m.tags.begin(), m.tags.end(), 'b');
+  schema.valueCount += m.tags.size() - blobs;
+  schema.blobCount += blobs;
+}
+
+archiveSchema_t schemaFromSignature(const std::string& signature, const ArchiveEncodingSpec& spec) {
+  archiveSchema_t schema;
+  size_t pos = 0;
+  while (pos < signature.size()) {
+    archiveMessage_t m;
+    m.address = std::string(signature.c_str() + pos);
+    pos += m.address.size() + 1;
+    m.tags = std::string(signature.c_str() + pos);
+    pos += m.tags.size() + 1;
+    spec.apply(m);
+    countArgs(schema, m);
+    schema.messages.push_back(m);
+  }
+  schema.packetSize = oscBundleSize(schema);
+  return schema;
+}
+
+void encodeSchema(std::string& out, uint8_t id, const archiveSchema_t& schema) {
+  out.push_back(RECORD_SCHEMA);
+  out.push_back(id);
+  out.push_back(static_cast<char>(schema.messages.size()));
+  for (const auto& m : schema.messages) {
+    out.push_back(static_cast<char>(m.address.size()));
+    out.append(m.address);
+    out.push_back(static_cast<char>(m.tags.size()));
+    out.append(m.tags);
+    out.push_back(m.encoding);
+    if (m.encoding == ENCODING_Q8) {
+      putBigEndian32(out, floatBits(m.min));
+      putBigEndian32(out, floatBits(m.max));
+    }
+  }
+}
+
+bool decodeSchema(const uint8_t*& pos, const uint8_t* end, uint8_t version, archiveSchema_t& schema) {
+  if (end - pos < 1) return false;
+  uint8_t numMessages = *pos++;
+  for (uint8_t i = 0; i < numMessages; i++) {
+    archiveMessage_t m;
+    if (end - pos < 1 || end - pos < 1 + *pos) return false;
+    m.address.assign(reinterpret_cast<const char*>(pos + 1), *pos);
+    pos += 1 + *pos;
+    if (end - pos < 1 || end - pos < 2 + *pos) return false;
+    m.tags.assign(reinterpret_cast<const char*>(pos + 1), *pos);
+    pos += 1 + *pos;
+    m.encoding = static_cast<ArchiveEncoding>(*pos++);
+    if (m.encoding > ENCODING_Q8) return false;
+    if (m.encoding == ENCODING_Q8) {
+      if (end - pos < 8) return false;
+      m.min = bitsFloat(version == 1 ? getLittleEndian32(pos) : getBigEndian32(pos));
+      m.max = bitsFloat(version == 1 ? getLittleEndian32(pos + 4) : getBigEndian32(pos + 4));
+      pos += 8;
+    }
+    for (char t : m.tags) {
+      if (t != 'i' && t != 'f' && (t != 'b' || version < 3)) return false;
+    }
+    countArgs(schema, m);
+    schema.messages.push_back(m);
+  }
+  schema.packetSize = oscBundleSize(schema);
+  return true;
+}
+
+} // namespace
+
+void archivePredictor_t::reset(size_t valueCount) {
+  previous.assign(valueCount, 0);
+  leading.assign(valueCount, NO_WINDOW);
+  trailing.assign(valueCount, 0);
+}
+
+// ---- writer
+
+ArchiveWriter::ArchiveWriter(const std::string& path, const ArchiveEncodingSpec& spec)
+  : spec(spec), out(path, std::ios::binary) {
+  buffer.reserve(WRITE_BLOCK_SIZE * 2);
+  buffer.append(ARCHIVE_MAGIC, 4);
+  buffer.push_back(ARCHIVE_VERSION);
+}
+
+ArchiveWriter::~ArchiveWriter() {
+  flush();
+  if (rejected > 0) {
+    std::cerr << "archive: " << rejected << " bundles couldn't be encoded and are only in the .oscs" << std::endl;
+  }
+}
+
+void ArchiveWriter::flush() {
+  out.write(buffer.data(), buffer.size());
+  totalBytes += buffer.size();
+  buffer.clear();
+  out.flush();
+}
+
+bool ArchiveWriter::write(const char* packet, size_t size) {
+  uint64_t time;
+  if (!flattenBundle(packet, size, time, signature, values, blobs)) {
+    rejected++;
+    return false;
+  }
+
+  uint8_t id;
+  auto it = schemaIds.find(signature);
+  if (it != schemaIds.end()) {
+    id = it->second;
+  } else {
+    if (schemas.size() > 0xff) {
+      rejected++;
+      return false;
+    }
+    id = static_cast<uint8_t>(schemas.size());
+    schemas.push_back(schemaFromSignature(signature, spec));
+    predictors.emplace_back();
+    predictors.back().reset(schemas.back().valueCount);
+    schemaIds[signature] = id;
+    encodeSchema(buffer, id, schemas.back());
+  }
+
+  buffer.push_back(RECORD_FRAME);
+  buffer.push_back(id);
+  putVarint(buffer, zigzag(static_cast<int64_t>(time - previousTime)));
+  previousTime = time;
+
+  const archiveSchema_t& schema = schemas[id];
+  archivePredictor_t& predictor = predictors[id];
+  BitWriter bits(buffer);
+  size_t v = 0;
+  for (const auto& m : schema.messages) {
+    for (char tag : m.tags) {
+      if (tag == 'b') continue;
+      float x = values[v];
+      if (tag == 'i' || m.encoding == ENCODING_XOR) {
+        encodeXor(bits, predictor, v, floatBits(x));
+      } else if (m.encoding == ENCODING_F16) {
+        bits.put(floatToHalf(x), 16);
+      } else {
+        bits.put(floatToQ8(x, m.min, m.max), 8);
+      }
+      v++;
+    }
+  }
+  bits.finish();
+  for (const auto& blob : blobs) {
+    putVarint(buffer, blob.size());
+    buffer.append(blob);
+  }
+
+  if (buffer.size() >= WRITE_BLOCK_SIZE) flush();
+  return true;
+}
+
+// ---- reader
+
+ArchiveReader::ArchiveReader(const char* data, size_t size)
+  : pos(reinterpret_cast<const uint8_t*>(data)), end(reinterpret_cast<const uint8_t*>(data) + size) {
+  version = size >= 5 ? static_cast<uint8_t>(data[4]) : 0;
+  ok = size >= 5 && std::memcmp(data, ARCHIVE_MAGIC, 4) == 0 && version >= 1 && version <= ARCHIVE_VERSION;
+  if (ok) pos += 5;
+}
+
+bool ArchiveReader::next(archiveFrame_t& frame) {
+  while (ok && pos < end) {
+    uint8_t record = *pos++;
+    if (pos == end) break;
+    uint8_t id = *pos++;
+
+    if (record == RECORD_SCHEMA) {
+      if (id != schemas.size()) break;
+      schemas.emplace_back();
+      if (!decodeSchema(pos, end, version, schemas.back())) break;
+      predictors.emplace_back();
+      predictors.back().reset(schemas.back().valueCount);
+      continue;
+    }
+
+    if (record != RECORD_FRAME || id >= schemas.size()) break;
+    uint64_t delta;
+    if (!getVarint(pos, end, delta)) break;
+    previousTime += unzigzag(delta);
+    frame.time = previousTime;
+    frame.schema = &schemas[id];
+    frame.values.resize(frame.schema->valueCount);
+    frame.blobs.resize(frame.schema->blobCount);
+
+    archivePredictor_t& predictor = predictors[id];
+    BitReader bits(pos, end);
+    size_t v = 0;
+    for (const auto& m : frame.schema->messages) {
+      for (char tag : m.tags) {
+        if (tag == 'b') continue;
+        uint32_t x;
+        if (tag == 'i' || m.encoding == ENCODING_XOR) {
+          if (!decodeXor(bits, predictor, v, x)) { ok = false; return false; }
+          frame.values[v] = bitsFloat(x);
+        } else if (m.encoding == ENCODING_F16) {
+          if (!bits.get(16, x)) { ok = false; return false; }
+          frame.values[v] = halfToFloat(static_cast<uint16_t>(x));
+        } else {
+          if (!bits.get(8, x)) { ok = false; return false; }
+          frame.values[v] = q8ToFloat(static_cast<uint8_t>(x), m.min, m.max);
+        }
+        v++;
+      }
+    }
+    for (auto& blob : frame.blobs) {
+      uint64_t length;
+      if (!getVarint(pos, end, length) || length > static_cast<uint64_t>(end - pos)) { ok = false; return false; }
+      blob.assign(reinterpret_cast<const char*>(pos), length);
+      pos += length;
+    }
+    return true;
+  }
+  if (pos < end) {
+    std::cerr << "malformed archive record, stopping" << std::endl;
+  }
+  ok = false;
+  return false;
+}
+
+size_t ArchiveReader::makeOscPacket(const archiveFrame_t& frame, char* buffer, size_t capacity) const {
+  // the schema and blobs give the size, so the buffer is checked once rather than per value
+  size_t size = frame.schema->packetSize;
+  for (const auto& blob : frame.blobs) size += OSCPP::align(blob.size());
+  OSCPP::Client::UncheckedPacket packet(buffer, capacity);
+  if (packet.reserve(size) != OSCPP::Status::Ok) return 0;
+  packet.openBundle(frame.time);
+  size_t v = 0;
+  size_t b = 0;
+  for (const auto& m : frame.schema->messages) {
+    packet.openMessage(m.address.c_str(), m.tags.size());
+    for (char tag : m.tags) {
+      if (tag == 'i') {
+        packet.int32(archiveValueAsInt(frame.values[v++]));
+      } else if (tag == 'f') {
+        packet.float32(frame.values[v++]);
+      } else {
+        const std::string& blob = frame.blobs[b++];
+        packet.blob(OSCPP::Blob(blob.data(), blob.size()));
+      }
+    }
+    packet.closeMessage();
+  }
+  packet.closeBundle();
+  return packet.size();
+}
+
+// ---- offline conversion with round trip check
+
+bool archiveOscsFile(const std::string& oscsPath, const ArchiveEncodingSpec& spec) {
+  std::vector<char> oscs;
+  if (!readWholeFile(oscsPath, oscs)) {
+    std::cerr << "can't read '" << oscsPath << "'" << std::endl;
+    return false;
+  }
+  std::string oscaPath = oscsPath;
+  if (oscaPath.size() > 5 && oscaPath.compare(oscaPath.size() - 5, 5, ".oscs") == 0) oscaPath.resize(oscaPath.size() - 5);
+  oscaPath += ".osca";
+
+  size_t frames = 0;
+  {
+    ArchiveWriter writer(oscaPath, spec);
+    forEachOscsBundle(oscs.data(), oscs.size(), [&](const char* bundle, size_t size) {
+      if (writer.write(bundle, size)) frames++;
+    });
+  }
+
+  std::vector<char> osca;
+  if (!readWholeFile(oscaPath, osca)) {
+    std::cerr << "can't read back '" << oscaPath << "'" << std::endl;
+    return false;
+  }
+  ArchiveReader reader(osca.data(), osca.size());
+  archiveFrame_t frame;
+  uint64_t time;
+  std::string signature;
+  std::vector<float> expected;
+  std::vector<std::string> expectedBlobs;
+  std::unordered_map<std::string, double> worstError; // address -> max abs error
+  size_t decoded = 0;
+  size_t violations = 0;
+  forEachOscsBundle(oscs.data(), oscs.size(), [&](const char* bundle, size_t size) {
+    if (!flattenBundle(bundle, size, time, signature, expected, expectedBlobs)) return;
+    if (!reader.next(frame)) return;
+    decoded++;
+    if (frame.time != time || frame.values.size() != expected.size() || frame.blobs.size() != expectedBlobs.size()) {
+      violations++;
+      return;
+    }
+    size_t v = 0;
+    size_t b = 0;
+    for (const auto& m : frame.schema->messages) {
+      double& worst = worstError[m.address];
+      for (size_t a = 0; a < m.tags.size(); a++) {
+        if (m.tags[a] == 'b') {
+          // blobs are stored as they are
+          if (frame.blobs[b] != expectedBlobs[b]) {
+            worst = std::max(worst, 1.0);
+            violations++;
+          }
+          b++;
+          continue;
+        }
+        double error = (m.tags[a] == 'i')
+          ? (floatBits(frame.values[v]) != floatBits(expected[v]))
+          : std::fabs(static_cast<double>(frame.values[v]) - expected[v]);
+        if (std::isnan(expected[v]) && std::isnan(frame.values[v])) error = 0.0;
+        worst = std::max(worst, error);
+        const double bound = m.tags[a] == 'i' ? 0.0 : spec.errorBound(m, expected[v]);
+        if (!(error <= bound)) violations++;
+        v++;
+      }
+    }
+  });
+
+  std::cout << oscsPath << ": " << frames << " frames, " << oscs.size() << " -> " << osca.size() << " bytes ("
+            << (osca.empty() ? 0.0 : static_cast<double>(oscs.size()) / osca.size()) << "x)" << std::endl;
+  for (const auto& e : worstError) {
+    std::cout << "  " << e.first << " max error " << e.second << std::endl;
+  }
+  if (decoded != frames || violations > 0) {
+    std::cerr << oscaPath << ": round trip failed, decoded " << decoded << "/" << frames
+              << " frames, " << violations << " values outside error bound" << std::endl;
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,131 @@
+#ifndef ANALYSER_ARCHIVE_HPP
+#define ANALYSER_ARCHIVE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Compact archive (.osca) encoding for the per-channel feature stream.
+//
+// The .oscs bundles repeat the same addresses and type tags every frame, so
+// instead the archive writes each bundle shape once as a schema record and
+// then one frame record per bundle holding just the values:
+//
+//   file    := "OSCA" version:u8 record*
+//   record  := 'S' schemaId:u8 numMessages:u8 message*        -- schema
+//            | 'F' schemaId:u8 zigzag-varint(timetag delta) values blob*
+//   message := addressLength:u8 address tagCount:u8 tags encoding:u8 [min:f32be max:f32be]
+//
+// Frame values are a bitstream padded to the next byte. Int args and
+// ENCODING_XOR floats use Gorilla-style XOR against the previous frame of the
+// same schema (lossless); ENCODING_F16 stores IEEE half floats; ENCODING_Q8
+// quantises linearly to 8 bits over the schema's [min, max]. Blob args
+// (spectra and fragments) follow the values as varint(length) bytes, as sent.
+
+enum ArchiveEncoding : uint8_t { ENCODING_XOR = 0, ENCODING_F16, ENCODING_Q8 };
+
+struct archiveMessage_t {
+  std::string address;
+  std::string tags; // 'i', 'f' or 'b' per arg, no leading ','
+  ArchiveEncoding encoding = ENCODING_XOR;
+  float min = 0.0;
+  float max = 1.0;
+};
+
+struct archiveSchema_t {
+  std::vector<archiveMessage_t> messages;
+  size_t valueCount = 0; // 'i' and 'f' args
+  size_t blobCount = 0;
+  size_t packetSize = 0; // of the OSC bundle each frame makes, less its blobs' bytes
+};
+
+// Worst case absolute error for a value x stored with the message's encoding
+double archiveErrorBound(const archiveMessage_t& message, float x);
+
+// Per-address encodings, e.g. "/mfcc=f16,/time=q8:0:32768". Unlisted addresses use XOR.
+// An encoding may end in ~bound, e.g. "/mfcc=f16~0.01", for the absolute
+// error the round trip check allows that address's floats instead of the
+// encoding's own worst case.
+class ArchiveEncodingSpec {
+public:
+  ArchiveEncodingSpec() = default;
+  explicit ArchiveEncodingSpec(const std::string& spec);
+  void apply(archiveMessage_t& message) const;
+  // The error allowed a float x of message, archiveErrorBound unless one was given
+  double errorBound(const archiveMessage_t& message, float x) const;
+private:
+  std::unordered_map<std::string, archiveMessage_t> encodings;
+  std::unordered_map<std::string, double> bounds;
+};
+
+// One decoded bundle. Values and blobs are in schema order; int args are
+// stored as their bit pattern and can be recovered with archiveValueAsInt.
+struct archiveFrame_t {
+  uint64_t time = 0;
+  const archiveSchema_t* schema = nullptr;
+  std::vector<float> values;
+  std::vector<std::string> blobs;
+};
+
+int32_t archiveValueAsInt(float value);
+
+// Gorilla predictor state for one schema; shared by encoder and decoder.
+struct archivePredictor_t {
+  std::vector<uint32_t> previous;
+  std::vector<uint8_t> leading;
+  std::vector<uint8_t> trailing;
+  void reset(size_t valueCount);
+};
+
+class ArchiveWriter {
+public:
+  ArchiveWriter(const std::string& path, const ArchiveEncodingSpec& spec);
+  ~ArchiveWriter();
+  // Encode an OSC bundle of int, float and blob messages. Returns false if it
+  // can't be, which is counted and reported when the writer is destroyed.
+  bool write(const char* packet, size_t size);
+  void flush();
+  size_t bytesWritten() const { return totalBytes; }
+  size_t rejectedBundles() const { return rejected; }
+private:
+  const ArchiveEncodingSpec& spec;
+  std::ofstream out;
+  std::string buffer; // pending output, flushed in blocks
+  size_t totalBytes = 0;
+  size_t rejected = 0;
+  uint64_t previousTime = 0;
+  std::vector<archiveSchema_t> schemas;
+  std::vector<archivePredictor_t> predictors;
+  std::unordered_map<std::string, uint8_t> schemaIds; // shape signature -> id
+  std::string signature; // scratch, reused every frame
+  std::vector<float> values; // scratch, reused every frame
+  std::vector<std::string> blobs; // scratch, reused every frame
+  uint8_t schemaFor(const char* packet, size_t size);
+};
+
+class ArchiveReader {
+public:
+  ArchiveReader(const char* data, size_t size);
+  bool valid() const { return ok; }
+  // Decode the next frame; returns false at end of data or on a malformed record.
+  bool next(archiveFrame_t& frame);
+  // Rebuild the OSC bundle for a decoded frame, returns its size (0 if it doesn't fit).
+  size_t makeOscPacket(const archiveFrame_t& frame, char* buffer, size_t capacity) const;
+private:
+  const uint8_t* pos;
+  const uint8_t* end;
+  bool ok;
+  uint8_t version;
+  uint64_t previousTime = 0;
+  std::vector<archiveSchema_t> schemas;
+  std::vector<archivePredictor_t> predictors;
+};
+
+// Encode an .oscs file to <path minus .oscs>.osca, decode it again and check
+// every value against its error bound. Prints sizes and worst errors.
+bool archiveOscsFile(const std::string& oscsPath, const ArchiveEncodingSpec& spec);
+
+#endif // ANALYSER_ARCHIVE_HPP
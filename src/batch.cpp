@@ -0,0 +1,151 @@
+#include "batch.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "analysis.hpp"
+#include "output.hpp"
+#include "trace.hpp"
+#include "wavfile.hpp"
+
+namespace fs = std::filesystem;
+
+namespace {
+
+struct batchJob_t {
+  fs::path wavPath;
+  std::string session;
+  int channelId;
+  uintmax_t size;
+};
+
+std::mutex logMutex;
+
+// Returns the seconds of audio analysed, or a negative number on failure
+double analyseWavFile(const batchJob_t& job, const batchConfig_t& config) {
+  MappedWav wav;
+  if (!wav.open(job.wavPath.string())) return -1.0;
+
+  std::string directory = config.outputPrefix + job.session;
+  std::error_code error;
+  fs::create_directories(directory, error);
+  std::string filename = job.wavPath.filename().string();
+  const size_t frameSize = SAMPLES_PER_FRAME;
+  ChannelOutput output(directory, filename, job.session, nullptr, config.chunks.forFrames(frameSize, wav.sampleRate()),
+                       config.archiveEncoding);
+
+  channelState_t channel;
+  channel.inputRate = wav.sampleRate(); // resampled to SAMPLE_RATE by analyseFrame
+  const int channels = wav.channels();
+  channel.inputChannels = channels == 2 ? 2 : 1; // as Jamulus stereo channels arrive live
+  alignas(4) char oscBuffer[MAX_OSC_PACKET_SIZE];
+  int16_t frame[static_cast<size_t>(SAMPLES_PER_FRAME)];
+  const size_t sampleCount = frameSize * channel.inputChannels;
+  uint64_t frameSequence = jamulusStartFrame(filename);
+  for (size_t start = 0; start + frameSize <= wav.frames(); start += frameSize, frameSequence++) {
+    size_t count = frameSize;
+    const int16_t* samples = wav.frameView(start, count); // straight from the page cache
+    if (channels > channel.inputChannels) {
+      // the live mq carries mono or stereo, so mix down
+      for (size_t i = 0; i < frameSize; i++) {
+        int sum = 0;
+        for (int c = 0; c < channels; c++) sum += samples[i * channels + c];
+        frame[i] = static_cast<int16_t>(sum / channels);
+      }
+      samples = frame;
+    }
+    for (size_t offset = 0; offset < sampleCount; ) {
+      size_t consumed;
+      size_t bufferSize = analyseFrame(channel, job.channelId, frameSequence, samples + offset, sampleCount - offset,
+                                       consumed, oscBuffer);
+      offset += consumed;
+      // the bundle, then any spectrum packets of its window
+      for (; bufferSize > 0; bufferSize = nextSpectrumPacket(channel, oscBuffer)) {
+        TraceScope trace(TraceStage::write, job.channelId, frameSequence);
+        output.write(oscBuffer, bufferSize, frameSequence);
+      }
+    }
+  }
+  return static_cast<double>(wav.frames()) / wav.sampleRate();
+}
+
+} // namespace
+
+uint64_t jamulusStartFrame(const std::string& filename) {
+  // ____-86_175_246_x_22141-0-1.wav: the frame is the second to last field
+  size_t last = filename.rfind('-');
+  if (last == std::string::npos || last == 0) return 0;
+  size_t previous = filename.rfind('-', last - 1);
+  if (previous == std::string::npos) return 0;
+  try {
+    return std::stoull(filename.substr(previous + 1, last - previous - 1));
+  } catch (const std::exception& e) {
+    return 0;
+  }
+}
+
+bool runBatch(const batchConfig_t& config) {
+  std::vector<batchJob_t> jobs;
+  std::error_code error;
+  for (const auto& entry : fs::recursive_directory_iterator(config.inputDirectory, error)) {
+    if (!entry.is_regular_file() || entry.path().extension() != ".wav") continue;
+    jobs.push_back({ entry.path(), entry.path().parent_path().filename().string(), 0, entry.file_size() });
+  }
+  if (error) {
+    std::cerr << "can't read '" << config.inputDirectory << "': " << error.message() << std::endl;
+    return false;
+  }
+
+  // channel ids follow file order within each session, as Jamulus can't tell us the originals
+  std::sort(jobs.begin(), jobs.end(), [](const batchJob_t& a, const batchJob_t& b) { return a.wavPath < b.wavPath; });
+  std::string session;
+  int channelId = 0;
+  for (auto& job : jobs) {
+    if (job.session != session) {
+      session = job.session;
+      channelId = 0;
+    }
+    job.channelId = channelId++;
+  }
+  // longest first, so one long file doesn't start last and hold up the end
+  std::stable_sort(jobs.begin(), jobs.end(), [](const batchJob_t& a, const batchJob_t& b) { return a.size > b.size; });
+
+  size_t threads = config.jobs > 0 ? config.jobs : std::max(1u, std::thread::hardware_concurrency());
+  threads = std::min(threads, std::max<size_t>(jobs.size(), 1));
+  std::cout << "analyser: batch analysing " << jobs.size() << " files on " << threads << " threads" << std::endl;
+
+  std::atomic<size_t> nextJob(0);
+  std::atomic<size_t> failures(0);
+  double audioSeconds = 0.0;
+  auto start = std::chrono::steady_clock::now();
+  std::vector<std::thread> workers;
+  for (size_t t = 0; t < threads; t++) {
+    workers.emplace_back([&, t]() {
+      traceThreadName("batch " + std::to_string(t));
+      for (size_t j = nextJob++; j < jobs.size(); j = nextJob++) {
+        auto jobStart = std::chrono::steady_clock::now();
+        double seconds = analyseWavFile(jobs[j], config);
+        double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - jobStart).count();
+        std::lock_guard<std::mutex> lock(logMutex);
+        if (seconds < 0) {
+          failures++;
+          continue;
+        }
+        audioSeconds += seconds;
+        std::cout << jobs[j].wavPath.string() << ": " << seconds << "s audio in " << elapsed << "s ("
+                  << (elapsed > 0 ? seconds / elapsed : 0) << "x real time)" << std::endl;
+      }
+    });
+  }
+  for (auto& worker : workers) {
+    worker.join();
+  }
+  double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  std::cout << "analyser: batch done, " << audioSeconds << "s audio in " << elapsed << "s ("
+            << (elapsed > 0 ? audioSeconds / elapsed : 0) << "x real time), " << failures << " failed" << std::endl;
+  return failures == 0;
+}
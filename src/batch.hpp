@@ -0,0 +1,26 @@
+#ifndef ANALYSER_BATCH_HPP
+#define ANALYSER_BATCH_HPP
+
+#include <cstdint>
+#include <string>
+#include "archive.hpp"
+#include "chunkedfile.hpp"
+
+struct batchConfig_t {
+  std::string inputDirectory;    // a Jam-... session, or a directory of them
+  std::string outputPrefix;      // .oscs go to <outputPrefix><session>/<file>.oscs, like live
+  size_t jobs = 0;               // worker threads, 0 for one per core
+  const ArchiveEncodingSpec* archiveEncoding = nullptr; // also write .osca
+  chunkConfig_t chunks;          // as live, so files roll into the same chunks
+};
+
+// The start frame from a Jamulus recording name <name>-<address>-<frame>-<channels>.wav
+uint64_t jamulusStartFrame(const std::string& filename);
+
+// Re-analyse recorded WAVs with the live analysis and output code, one file
+// per job spread over a pool of worker threads. Returns false if any file failed.
+// The recordings don't keep Jamulus' channel ids, so each session's files are
+// numbered in name order for /meta instead.
+bool runBatch(const batchConfig_t& config);
+
+#endif // ANALYSER_BATCH_HPP
@@ -0,0 +1,347 @@
+#include "bench.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <complex>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <vector>
+#include <oscpp/client.hpp>
+#include <oscpp/server.hpp>
+#include "analysis.hpp"
+#include "chunkedfile.hpp"
+#include "features.hpp"
+#include "Gist.h"
+#include "kiss_fft.h"
+#include "kissfft.hh"
+#include "loudness.hpp"
+#include "onset.hpp"
+#include "oscschema.hpp"
+#include "resampler.hpp"
+#include "spectrum.hpp"
+#include "stereo.hpp"
+#include "tempo.hpp"
+
+#ifndef ANALYSER_BUILD_FLAGS
+#define ANALYSER_BUILD_FLAGS "unknown"
+#endif
+
+namespace {
+
+// Keep the optimiser from deleting work whose result we don't use
+template <typename T> inline void keep(const T& value) {
+  asm volatile("" : : "g"(&value) : "memory");
+}
+
+struct benchResult_t {
+  std::string name;
+  double nsPerOp;
+  uint64_t iterations;
+};
+
+// Best of 5 runs of at least 50ms each, so one noisy run doesn't count
+benchResult_t measure(const std::string& name, const std::function<void()>& op) {
+  using clock = std::chrono::steady_clock;
+  for (int i = 0; i < 10; i++) op(); // warm caches and lazy init
+  uint64_t batch = 1;
+  while (true) {
+    auto start = clock::now();
+    for (uint64_t i = 0; i < batch; i++) op();
+    if (clock::now() - start >= std::chrono::milliseconds(50)) break;
+    batch *= 2;
+  }
+  double best = 1e300;
+  for (int run = 0; run < 5; run++) {
+    auto start = clock::now();
+    for (uint64_t i = 0; i < batch; i++) op();
+    best = std::min(best, std::chrono::duration<double, std::nano>(clock::now() - start).count() / batch);
+  }
+  return { name, best, batch };
+}
+
+std::string cpuModel() {
+  std::ifstream cpuinfo("/proc/cpuinfo");
+  std::string line;
+  while (std::getline(cpuinfo, line)) {
+    if (line.rfind("model name", 0) == 0) return line.substr(line.find(':') + 2);
+  }
+  return "unknown";
+}
+
+std::string jsonEscape(const std::string& s) {
+  std::string escaped;
+  for (char c : s) {
+    if (c == '"' || c == '\\') escaped += '\\';
+    escaped += c;
+  }
+  return escaped;
+}
+
+std::vector<int16_t> testSignal(size_t n) {
+  std::mt19937 random(42);
+  std::normal_distribution<float> noise(0.0f, 300.0f);
+  std::vector<int16_t> samples(n);
+  for (size_t i = 0; i < n; i++) {
+    samples[i] = static_cast<int16_t>(6000.0 * std::sin(2.0 * M_PI * 440.0 * i / SAMPLE_RATE) + noise(random));
+  }
+  return samples;
+}
+
+} // namespace
+
+void runBenchmarks(std::ostream& out, const std::string& filter) {
+  std::vector<benchResult_t> results;
+  auto bench = [&](const std::string& name, const std::function<void()>& op) {
+    if (name.find(filter) == std::string::npos) return;
+    results.push_back(measure(name, op));
+    std::cerr << name << ": " << results.back().nsPerOp << " ns/op" << std::endl;
+  };
+
+  const std::vector<int16_t> samples = testSignal(SAMPLES_PER_SUPERFRAME);
+  std::vector<float> superFrame(SAMPLES_PER_SUPERFRAME);
+  convertFrame(samples.data(), superFrame.data(), SAMPLES_PER_SUPERFRAME);
+
+  for (int n : { 128, 1024 }) {
+    bench("convert_int16_float/" + std::to_string(n), [&]() {
+      convertFrame(samples.data(), superFrame.data(), n);
+      keep(superFrame[0]);
+    });
+  }
+
+  for (int n : { 256, 512, 1024, 2048, 4096 }) {
+    std::vector<std::complex<float>> in(n), outBins(n);
+    for (int i = 0; i < n; i++) in[i] = superFrame[i % superFrame.size()];
+    kissfft<float> fft(n, false);
+    bench("kissfft_template/" + std::to_string(n), [&]() {
+      fft.transform(in.data(), outBins.data());
+      keep(outBins[0]);
+    });
+
+    kiss_fft_cfg cfg = kiss_fft_alloc(n, 0, nullptr, nullptr);
+    std::vector<kiss_fft_cpx> cin(n), cout(n);
+    for (int i = 0; i < n; i++) cin[i] = { superFrame[i % superFrame.size()], 0.0f };
+    bench("kiss_fft_c/" + std::to_string(n), [&]() {
+      kiss_fft(cfg, cin.data(), cout.data());
+      keep(cout[0]);
+    });
+    kiss_fft_free(cfg);
+  }
+
+  const int frameSize = SAMPLES_PER_SUPERFRAME;
+  bench("gist_construct/" + std::to_string(frameSize), [&]() {
+    Gist<float> gist(frameSize, SAMPLE_RATE);
+    keep(gist);
+  });
+  Gist<float> gist(frameSize, SAMPLE_RATE);
+  bench("gist_process/" + std::to_string(frameSize), [&]() {
+    gist.processAudioFrame(superFrame.data(), frameSize);
+  });
+  const std::vector<std::pair<const char*, float (Gist<float>::*)()>> gistFeatures = {
+    { "rootMeanSquare", &Gist<float>::rootMeanSquare },
+    { "peakEnergy", &Gist<float>::peakEnergy },
+    { "zeroCrossingRate", &Gist<float>::zeroCrossingRate },
+    { "spectralCentroid", &Gist<float>::spectralCentroid },
+    { "spectralCrest", &Gist<float>::spectralCrest },
+    { "spectralFlatness", &Gist<float>::spectralFlatness },
+    { "spectralRolloff", &Gist<float>::spectralRolloff },
+    { "spectralKurtosis", &Gist<float>::spectralKurtosis },
+    { "energyDifference", &Gist<float>::energyDifference },
+    { "spectralDifference", &Gist<float>::spectralDifference },
+    { "spectralDifferenceHWR", &Gist<float>::spectralDifferenceHWR },
+    { "complexSpectralDifference", &Gist<float>::complexSpectralDifference },
+    { "highFrequencyContent", &Gist<float>::highFrequencyContent },
+    { "pitch", &Gist<float>::pitch },
+  };
+  for (const auto& feature : gistFeatures) {
+    bench(std::string("gist_") + feature.first + "/" + std::to_string(frameSize), [&]() {
+      keep((gist.*feature.second)());
+    });
+  }
+  bench("gist_mfcc/" + std::to_string(frameSize), [&]() {
+    keep(gist.getMelFrequencyCepstralCoefficients()[0]);
+  });
+
+  features_t features;
+  for (const auto& name : featureEngineNames()) {
+    auto engine = makeFeatureEngine(name, SAMPLE_RATE);
+    bench("engine_" + name + "/" + std::to_string(frameSize), [&]() {
+      engine->analyse(superFrame.data(), frameSize, ALL_FEATURES, features);
+      keep(features);
+    });
+  }
+
+  // pitch on the full window against a 16kHz sub-stream (ANALYSER_PITCH_RATE)
+  const int pitchFrameSize = frameSize / 3;
+  Gist<float> pitchGist(pitchFrameSize, SAMPLE_RATE / 3);
+  pitchGist.processAudioFrame(superFrame.data(), pitchFrameSize);
+  bench("gist_pitch_16k/" + std::to_string(pitchFrameSize), [&]() {
+    keep(pitchGist.pitch());
+  });
+
+  // a frame of input, so ns/op over the frame size is the cost per sample
+  for (auto quality : { "fast", "medium", "best" }) {
+    for (auto rates : { std::make_pair(44100, 48000), std::make_pair(16000, 48000), std::make_pair(48000, 16000) }) {
+      auto resampler = makeResampler(rates.first, rates.second, resamplerQualityFromName(quality, ResamplerQuality::medium));
+      std::vector<float> resampled(frameSize * rates.second / rates.first + 1);
+      bench(std::string("resample_") + quality + "_" + std::to_string(rates.first) + "_" + std::to_string(rates.second) +
+            "/" + std::to_string(frameSize), [&]() {
+        size_t used;
+        keep(resampler->process(superFrame.data(), frameSize, resampled.data(), resampled.size(), used));
+      });
+    }
+  }
+
+  // stereo: one shared FFT whatever the targets, against engine_gist per target
+  const std::vector<int16_t> interleaved = testSignal(2 * frameSize);
+  std::vector<float> right(frameSize);
+  for (int n : { 128, 1024 }) {
+    bench("deinterleave/" + std::to_string(n), [&]() {
+      deinterleave(interleaved.data(), superFrame.data(), right.data(), n);
+      keep(right[0]);
+    });
+  }
+  deinterleave(interleaved.data(), superFrame.data(), right.data(), frameSize);
+  stereoFeatures_t stereoFeatures = {};
+  for (auto targets : { "mid", "L,R", "all" }) {
+    auto engine = makeStereoFeatureEngine(SAMPLE_RATE);
+    unsigned mask = stereoTargetsFromSpec(targets);
+    bench(std::string("stereo_") + targets + "/" + std::to_string(frameSize), [&]() {
+      engine->analyse(superFrame.data(), right.data(), frameSize, ALL_FEATURES, mask, stereoFeatures);
+      keep(stereoFeatures);
+    });
+  }
+  convertFrame(samples.data(), superFrame.data(), SAMPLES_PER_SUPERFRAME);
+
+  // K-weighting, running sums and true peak over a window, against engine_gist's
+  for (bool stereo : { false, true }) {
+    LoudnessMeter meter(SAMPLE_RATE);
+    bench(std::string(stereo ? "loudness_stereo/" : "loudness_mono/") + std::to_string(frameSize), [&]() {
+      meter.process(superFrame.data(), stereo ? right.data() : nullptr, frameSize);
+      keep(meter.read());
+    });
+  }
+  // eight hops' FFTs and peak picking over a window, in Jamulus sized frames as live
+  {
+    OnsetDetector detector(onsetConfigFromEnv(SAMPLE_RATE));
+    onsetEvent_t event;
+    bench("onset_detector/" + std::to_string(frameSize), [&]() {
+      for (size_t i = 0; i < SAMPLES_PER_SUPERFRAME; i += SAMPLES_PER_FRAME) {
+        keep(detector.process(superFrame.data() + i, SAMPLES_PER_FRAME, event));
+      }
+    });
+  }
+  // a window's hops into the autocorrelation and phase bins, and the read each bundle takes
+  {
+    TempoTracker tracker(tempoConfigFromEnv(), SAMPLE_RATE);
+    std::vector<float> fluxes(SAMPLES_PER_SUPERFRAME / ONSET_HOP);
+    for (size_t i = 0; i < fluxes.size(); i++) fluxes[i] = std::fabs(superFrame[i]) / 32768;
+    bench("tempo_tracker/" + std::to_string(frameSize), [&]() {
+      tracker.process(fluxes.data(), fluxes.size());
+      keep(tracker.read());
+    });
+  }
+
+  alignas(4) char oscBuffer[MAX_OSC_PACKET_SIZE];
+  // a window's spectrum and 40 mel bands into packets, taken as live does: every
+  // bin in 16 bits fits one, in floats it's cut into fragments of 512 bytes
+  for (int bits : { 16, 32 }) {
+    spectrumConfig_t config;
+    config.streams = SPECTRUM_STREAM | MEL_STREAM;
+    config.bits = bits;
+    config.mtu = bits == 32 ? 512 : MAX_OSC_PACKET_SIZE;
+    SpectrumStreamer streamer(config, SAMPLE_RATE, SAMPLES_PER_SUPERFRAME);
+    bench("spectrum_streamer/" + std::to_string(bits), [&]() {
+      streamer.analyse(superFrame.data(), 1, 12345, FULL_ANALYSIS);
+      while (streamer.nextPacket(oscBuffer) > 0) keep(oscBuffer[0]);
+    });
+  }
+
+  bench("make_osc_packet_stereo_all", [&]() {
+    keep(makeStereoOscPacket(oscBuffer, 1, 12345, stereoFeatures, stereoTargetsFromSpec("all")));
+  });
+  size_t packetSize = makeOscPacket(oscBuffer, 1, 12345, features);
+  bench("make_osc_packet", [&]() {
+    keep(makeOscPacket(oscBuffer, 1, 12345, features));
+  });
+
+  bench("osc_parse_bundle", [&]() {
+    float sum = 0;
+    OSCPP::Server::Bundle bundle(OSCPP::Server::Packet(oscBuffer, packetSize));
+    OSCPP::Server::PacketStream packets(bundle.packets());
+    while (!packets.atEnd()) {
+      OSCPP::Server::Message message(packets.next());
+      OSCPP::Server::ArgStream args(message.args());
+      while (!args.atEnd()) sum += args.float32();
+    }
+    keep(sum);
+  });
+
+  bench("osc_decode_bundle", [&]() {
+    features_t decoded;
+    OSCPP::Server::Bundle bundle(OSCPP::Server::Packet(oscBuffer, packetSize));
+    OSCPP::Server::PacketStream packets(bundle.packets());
+    while (!packets.atEnd()) {
+      OSCPP::Server::Message message(packets.next());
+      if (message == TimeMessage::address) TimeMessage::decode(message, decoded);
+      else if (message == FreqMessage::address) FreqMessage::decode(message, decoded);
+      else if (message == OnsetMessage::address) OnsetMessage::decode(message, decoded);
+      else if (message == PitchMessage::address) PitchMessage::decode(message, decoded);
+      else if (message == MfccMessage::address) MfccMessage::decode(message, decoded);
+    }
+    keep(decoded[RMS] + decoded[MFCC_0 + MFCC_COUNT - 1]);
+  });
+
+  {
+    // a 512 bin spectrum as one message, per float and in bulk, against copying its bytes
+    const size_t bins = 512;
+    std::vector<float> spectrum(bins);
+    for (size_t i = 0; i < bins; i++) spectrum[i] = std::fabs(superFrame[i]);
+    alignas(4) char arrayBuffer[OSCPP::Size::message("/spectrum", bins) + 4 * bins];
+    bench("osc_float32_each/512", [&]() {
+      OSCPP::Client::Packet packet(arrayBuffer, sizeof(arrayBuffer));
+      packet.openMessage("/spectrum", bins);
+      for (float x : spectrum) packet.float32(x);
+      packet.closeMessage();
+      keep(packet.size());
+    });
+    bench("osc_float32_array/512", [&]() {
+      OSCPP::Client::Packet packet(arrayBuffer, sizeof(arrayBuffer));
+      packet.openMessage("/spectrum", bins).float32Array(spectrum.data(), bins).closeMessage();
+      keep(packet.size());
+    });
+    std::vector<float> decoded(bins);
+    bench("osc_read_float32_array/512", [&]() {
+      OSCPP::Server::Message message(OSCPP::Server::Packet(arrayBuffer, sizeof(arrayBuffer)));
+      message.args().float32Array(decoded.data(), bins);
+      keep(decoded[bins - 1]);
+    });
+    bench("memcpy/2048", [&]() {
+      std::memcpy(arrayBuffer, spectrum.data(), 4 * bins);
+      keep(arrayBuffer[0]);
+    });
+  }
+
+  {
+    std::string directory = "/tmp";
+    ChunkedFile file(directory, "analyser-bench", "", nullptr, chunkConfig_t());
+    bench("oscs_write", [&]() {
+      file.write(oscBuffer, packetSize, 12345);
+    });
+  }
+  std::remove("/tmp/analyser-bench.oscs");
+
+  // one benchmark per line, so bin/bench_compare.sh can read it without a json parser
+  out << "{\n"
+      << "  \"cpu\": \"" << jsonEscape(cpuModel()) << "\",\n"
+      << "  \"compiler\": \"" << jsonEscape(__VERSION__) << "\",\n"
+      << "  \"flags\": \"" << jsonEscape(ANALYSER_BUILD_FLAGS) << "\",\n"
+      << "  \"benchmarks\": [\n";
+  for (size_t i = 0; i < results.size(); i++) {
+    out << "    {\"name\": \"" << results[i].name << "\", \"ns_per_op\": " << results[i].nsPerOp
+        << ", \"iterations\": " << results[i].iterations << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+  }
+  out << "  ]\n}" << std::endl;
+}
@@ -0,0 +1,12 @@
+#ifndef ANALYSER_BENCH_HPP
+#define ANALYSER_BENCH_HPP
+
+#include <ostream>
+#include <string>
+
+// Microbenchmarks for each hot kernel in isolation, written as JSON to out
+// with the CPU model and build flags. Benchmarks whose name doesn't contain
+// filter are skipped. Compare runs with bin/bench_compare.sh.
+void runBenchmarks(std::ostream& out, const std::string& filter);
+
+#endif // ANALYSER_BENCH_HPP
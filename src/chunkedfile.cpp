@@ -0,0 +1,61 @@
+#include "chunkedfile.hpp"
+#include "uploader.hpp"
+#include <cstdio>
+
+ChunkedFile::ChunkedFile(const std::string& directory, const std::string& name, const std::string& uploadPrefix,
+                         Uploader* uploader, const chunkConfig_t& config)
+  : directory(directory), name(name), uploadPrefix(uploadPrefix), uploader(uploader), config(config) {
+  if (config.enabled()) {
+    manifest.open(directory + "/" + name + ".manifest", std::ios::trunc);
+  }
+  openChunk();
+}
+
+ChunkedFile::~ChunkedFile() {
+  sealChunk();
+  if (config.enabled()) {
+    manifest.close();
+    if (uploader) uploader->enqueue(directory + "/" + name + ".manifest", uploadPrefix + "/" + name + ".manifest");
+  }
+}
+
+void ChunkedFile::openChunk() {
+  if (config.enabled()) {
+    char suffix[16];
+    std::snprintf(suffix, sizeof(suffix), ".%06zu.oscs", chunkIndex++);
+    chunkName = name + suffix;
+  } else {
+    chunkName = name + ".oscs";
+  }
+  out.open(directory + "/" + chunkName, std::ios::binary | std::ios::trunc);
+  chunkBytes = 0;
+  chunkOpened = std::chrono::steady_clock::now();
+}
+
+void ChunkedFile::sealChunk() {
+  out.close();
+  if (!config.enabled()) return;
+  if (chunkBytes == 0) {
+    std::remove((directory + "/" + chunkName).c_str());
+    return;
+  }
+  manifest << chunkName << ' ' << chunkBytes << ' ' << firstTimetag << ' ' << lastTimetag << std::endl;
+  if (uploader) uploader->enqueue(directory + "/" + chunkName, uploadPrefix + "/" + chunkName);
+}
+
+void ChunkedFile::write(const char* data, size_t size, uint64_t timetag) {
+  if (config.enabled() && chunkBytes > 0) {
+    bool full = config.maxBytes > 0 && chunkBytes + size > config.maxBytes;
+    bool old = config.maxSeconds > 0 && (config.secondsPerTimetag > 0
+      ? (timetag - firstTimetag) * config.secondsPerTimetag >= config.maxSeconds
+      : std::chrono::steady_clock::now() - chunkOpened >= std::chrono::duration<double>(config.maxSeconds));
+    if (full || old) {
+      sealChunk();
+      openChunk();
+    }
+  }
+  if (chunkBytes == 0) firstTimetag = timetag;
+  lastTimetag = timetag;
+  out.write(data, size);
+  chunkBytes += size;
+}
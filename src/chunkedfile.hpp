@@ -0,0 +1,60 @@
+#ifndef ANALYSER_CHUNKEDFILE_HPP
+#define ANALYSER_CHUNKEDFILE_HPP
+
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <string>
+
+class Uploader;
+
+struct chunkConfig_t {
+  size_t maxBytes = 0;    // roll after this many bytes, 0 for no limit
+  double maxSeconds = 0;  // roll after this long open, 0 for no limit
+  double secondsPerTimetag = 0; // when set, age is the span of the chunk's timetags times this, not wall clock time
+  bool enabled() const { return maxBytes > 0 || maxSeconds > 0; }
+  // For timetags that count frames of frameSamples at sampleRate
+  chunkConfig_t forFrames(size_t frameSamples, int sampleRate) const {
+    chunkConfig_t config = *this;
+    config.secondsPerTimetag = static_cast<double>(frameSamples) / sampleRate;
+    return config;
+  }
+};
+
+// Per-channel .oscs output that rolls over into numbered chunks
+// (<name>.000000.oscs, <name>.000001.oscs, ...). Bundles never straddle a
+// chunk, so each chunk is a valid .oscs and concatenating them in manifest
+// order gives the same bytes as the unchunked file.
+//
+// Each chunk is handed to the uploader as soon as it's sealed, and a line
+// "<chunk> <bytes> <firstTimetag> <lastTimetag>" is appended to
+// <name>.manifest. The destructor seals the last chunk and uploads the
+// manifest too. With chunking disabled this just writes <name>.oscs and
+// leaves it for the session directory upload.
+class ChunkedFile {
+public:
+  ChunkedFile(const std::string& directory, const std::string& name, const std::string& uploadPrefix,
+              Uploader* uploader, const chunkConfig_t& config);
+  ~ChunkedFile();
+  void write(const char* data, size_t size, uint64_t timetag);
+
+private:
+  const std::string directory;
+  const std::string name;
+  const std::string uploadPrefix;
+  Uploader* uploader;
+  const chunkConfig_t config;
+  std::ofstream out;
+  std::ofstream manifest;
+  std::string chunkName;
+  size_t chunkIndex = 0;
+  size_t chunkBytes = 0;
+  uint64_t firstTimetag = 0;
+  uint64_t lastTimetag = 0;
+  std::chrono::steady_clock::time_point chunkOpened;
+
+  void openChunk();
+  void sealChunk();
+};
+
+#endif // ANALYSER_CHUNKEDFILE_HPP
@@ -0,0 +1,35 @@
+#ifndef ANALYSER_CONFIG_HPP
+#define ANALYSER_CONFIG_HPP
+
+#include <cstdlib>
+#include <string>
+
+// Runtime settings come from ANALYSER_* environment variables so they can be
+// passed straight through `docker run -e`, falling back to the given default.
+
+inline std::string envString(const char* name, const std::string& fallback) {
+  const char* value = std::getenv(name);
+  return (value == nullptr || *value == '\0') ? fallback : std::string(value);
+}
+
+inline long envLong(const char* name, long fallback) {
+  const char* value = std::getenv(name);
+  if (value == nullptr || *value == '\0') return fallback;
+  char* end;
+  long result = std::strtol(value, &end, 10);
+  return (*end == '\0') ? result : fallback;
+}
+
+inline double envDouble(const char* name, double fallback) {
+  const char* value = std::getenv(name);
+  if (value == nullptr || *value == '\0') return fallback;
+  char* end;
+  double result = std::strtod(value, &end);
+  return (*end == '\0') ? result : fallback;
+}
+
+inline bool envFlag(const char* name) {
+  return envLong(name, 0) != 0;
+}
+
+#endif // ANALYSER_CONFIG_HPP
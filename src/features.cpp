@@ -0,0 +1,138 @@
+#include "features.hpp"
+#include <algorithm>
+#include <cmath>
+#include "Gist.h"
+#include "stereo.hpp"
+#include "trace.hpp"
+
+const std::string& featureName(size_t feature) {
+  static const std::vector<std::string> names = [] {
+    std::vector<std::string> n = {
+      "rootMeanSquare", "peakEnergy", "zeroCrossingRate",
+      "spectralCentroid", "spectralCrest", "spectralFlatness", "spectralRolloff", "spectralKurtosis",
+      "energyDifference", "spectralDifference", "spectralDifferenceHWR", "complexSpectralDifference",
+      "highFrequencyContent",
+      "pitch",
+    };
+    for (size_t i = 0; i < MFCC_COUNT; i++) n.push_back("mfcc" + std::to_string(i));
+    return n;
+  }();
+  return names[feature];
+}
+
+static void gistFeatures(Gist<float>& gist, unsigned groups, features_t& features) {
+  if (groups & TIME_FEATURES) {
+    features[RMS] = gist.rootMeanSquare();
+    features[PEAK_ENERGY] = gist.peakEnergy();
+    features[ZERO_CROSSING_RATE] = gist.zeroCrossingRate();
+  }
+  if (groups & FREQ_FEATURES) {
+    features[SPECTRAL_CENTROID] = gist.spectralCentroid();
+    features[SPECTRAL_CREST] = gist.spectralCrest();
+    features[SPECTRAL_FLATNESS] = gist.spectralFlatness();
+    features[SPECTRAL_ROLLOFF] = gist.spectralRolloff();
+    features[SPECTRAL_KURTOSIS] = gist.spectralKurtosis();
+  }
+  if (groups & ONSET_FEATURES) {
+    features[ENERGY_DIFFERENCE] = gist.energyDifference();
+    features[SPECTRAL_DIFFERENCE] = gist.spectralDifference();
+    features[SPECTRAL_DIFFERENCE_HWR] = gist.spectralDifferenceHWR();
+    features[COMPLEX_SPECTRAL_DIFFERENCE] = gist.complexSpectralDifference();
+    features[HIGH_FREQUENCY_CONTENT] = gist.highFrequencyContent();
+  }
+  if (groups & PITCH_FEATURES) {
+    features[PITCH] = gist.pitch();
+  }
+  if (groups & MFCC_FEATURES) {
+    const auto& mfcc = gist.getMelFrequencyCepstralCoefficients();
+    std::fill(features.begin() + MFCC_0, features.end(), 0.0f);
+    std::copy_n(mfcc.begin(), std::min(mfcc.size(), MFCC_COUNT), features.begin() + MFCC_0);
+  }
+}
+
+// Gist's time domain features without its FFT, for when nothing spectral is
+// wanted. Crossings are counted as Gist does, between samples > 0 and not.
+static void timeDomainFeatures(const float* frame, int sampleCount, features_t& features) {
+  float sum = 0, peak = 0;
+  int crossings = 0;
+  bool previous = sampleCount > 0 && frame[0] > 0;
+  for (int i = 0; i < sampleCount; i++) {
+    sum += frame[i] * frame[i];
+    peak = std::max(peak, std::fabs(frame[i]));
+    const bool positive = frame[i] > 0;
+    if (i > 0 && positive != previous) crossings++;
+    previous = positive;
+  }
+  features[RMS] = std::sqrt(sum / sampleCount);
+  features[PEAK_ENERGY] = peak;
+  features[ZERO_CROSSING_RATE] = crossings;
+}
+
+namespace {
+
+class GistEngine : public FeatureEngine {
+public:
+  explicit GistEngine(int sampleRate) : sampleRate(sampleRate) {}
+  void analyse(const float* frame, int sampleCount, unsigned groups, features_t& features) override {
+    if (!(groups & SPECTRAL_FEATURES)) {
+      timeDomainFeatures(frame, sampleCount, features);
+      return;
+    }
+    Gist<float> gist(sampleCount, sampleRate);
+    {
+      TraceScope trace(TraceStage::fft);
+      gist.processAudioFrame(frame, sampleCount);
+    }
+    gistFeatures(gist, groups, features);
+  }
+private:
+  int sampleRate;
+};
+
+class PersistentGistEngine : public FeatureEngine {
+public:
+  explicit PersistentGistEngine(int sampleRate) : sampleRate(sampleRate) {}
+  void analyse(const float* frame, int sampleCount, unsigned groups, features_t& features) override {
+    if (!(groups & SPECTRAL_FEATURES)) {
+      timeDomainFeatures(frame, sampleCount, features);
+      return;
+    }
+    if (!gist || gist->getAudioFrameSize() != sampleCount) {
+      gist = std::make_unique<Gist<float>>(sampleCount, sampleRate);
+    }
+    {
+      TraceScope trace(TraceStage::fft);
+      gist->processAudioFrame(frame, sampleCount);
+    }
+    gistFeatures(*gist, groups, features);
+  }
+private:
+  int sampleRate;
+  std::unique_ptr<Gist<float>> gist;
+};
+
+class StereoMidEngine : public FeatureEngine {
+public:
+  explicit StereoMidEngine(int sampleRate) : stereo(makeStereoFeatureEngine(sampleRate)) {}
+  void analyse(const float* frame, int sampleCount, unsigned groups, features_t& features) override {
+    all[TARGET_MID] = features; // leaving the groups not asked for as they were
+    stereo->analyse(frame, frame, sampleCount, groups, 1u << TARGET_MID, all);
+    features = all[TARGET_MID];
+  }
+private:
+  std::unique_ptr<StereoFeatureEngine> stereo;
+  stereoFeatures_t all = {};
+};
+
+} // namespace
+
+std::unique_ptr<FeatureEngine> makeFeatureEngine(const std::string& name, int sampleRate) {
+  if (name == "gist") return std::make_unique<GistEngine>(sampleRate);
+  if (name == "gist-persistent") return std::make_unique<PersistentGistEngine>(sampleRate);
+  if (name == "gist-stereo") return std::make_unique<StereoMidEngine>(sampleRate);
+  return nullptr;
+}
+
+std::vector<std::string> featureEngineNames() {
+  return { "gist", "gist-persistent", "gist-stereo" };
+}
@@ -0,0 +1,53 @@
+#ifndef ANALYSER_FEATURES_HPP
+#define ANALYSER_FEATURES_HPP
+
+#include <array>
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+// The features sent in each bundle, flattened in makeOscPacket's message order
+constexpr size_t MFCC_COUNT = 13; // Gist's default
+enum Feature {
+  RMS = 0, PEAK_ENERGY, ZERO_CROSSING_RATE,                                                      // /time
+  SPECTRAL_CENTROID, SPECTRAL_CREST, SPECTRAL_FLATNESS, SPECTRAL_ROLLOFF, SPECTRAL_KURTOSIS,     // /freq
+  ENERGY_DIFFERENCE, SPECTRAL_DIFFERENCE, SPECTRAL_DIFFERENCE_HWR, COMPLEX_SPECTRAL_DIFFERENCE,
+  HIGH_FREQUENCY_CONTENT,                                                                        // /onset
+  PITCH,                                                                                         // /pitch
+  MFCC_0,                                                                                        // /mfcc
+  FEATURE_COUNT = MFCC_0 + MFCC_COUNT
+};
+using features_t = std::array<float, FEATURE_COUNT>;
+
+// Features are computed and sent a message at a time, so load shedding can drop the expensive ones
+enum FeatureGroup : unsigned {
+  TIME_FEATURES = 1, FREQ_FEATURES = 2, ONSET_FEATURES = 4, PITCH_FEATURES = 8, MFCC_FEATURES = 16,
+  ALL_FEATURES = 31,
+  SPECTRAL_FEATURES = FREQ_FEATURES | ONSET_FEATURES | PITCH_FEATURES | MFCC_FEATURES // need the FFT
+};
+
+// e.g. "spectralCentroid", "mfcc3"
+const std::string& featureName(size_t feature);
+
+// Turns an analysis window into features. Engines may keep state between
+// calls (the onset functions compare against the previous window), so use
+// one per channel. Only the FeatureGroups in groups are computed, the rest
+// are left as they were.
+class FeatureEngine {
+public:
+  virtual ~FeatureEngine() = default;
+  virtual void analyse(const float* frame, int sampleCount, unsigned groups, features_t& features) = 0;
+};
+
+// "gist" is the reference: a fresh Gist per window, as the analyser has always done.
+// "gist-persistent" keeps one Gist per channel, so it doesn't reallocate
+// every window and its onset functions see the previous window instead of silence.
+// "gist-stereo" analyses the frame as both sides of a stereo pair and
+// reports mid, so the accuracy mode can check stereo.hpp's own FFT and
+// feature plumbing against the reference.
+// sampleRate is that of the frames it will be given. Returns nullptr for an unknown name.
+std::unique_ptr<FeatureEngine> makeFeatureEngine(const std::string& name, int sampleRate);
+std::vector<std::string> featureEngineNames();
+
+#endif // ANALYSER_FEATURES_HPP
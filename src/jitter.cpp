@@ -0,0 +1,164 @@
+#include "jitter.hpp"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include "config.hpp"
+
+jitterStats_t jitterStats;
+
+namespace {
+
+enum class Concealment { repeat, zero, crossfade };
+
+Concealment concealmentFromEnv() {
+  std::string name = envString("ANALYSER_CONCEAL", "crossfade");
+  if (name == "repeat") return Concealment::repeat;
+  if (name == "zero") return Concealment::zero;
+  if (name != "crossfade") std::cerr << "unknown ANALYSER_CONCEAL '" << name << "', using crossfade" << std::endl;
+  return Concealment::crossfade;
+}
+
+const Concealment concealmentMode = concealmentFromEnv();
+const uint64_t jitterDepth = std::clamp<long>(envLong("ANALYSER_JITTER_DEPTH", 4), 1, MAX_JITTER_DEPTH);
+const uint64_t maxConceal = envLong("ANALYSER_JITTER_MAX_CONCEAL", FRAMES_PER_SUPERFRAME);
+
+} // namespace
+
+void reportJitterStats(std::ostream& out) {
+  uint64_t frames = jitterStats.frames.exchange(0);
+  if (frames == 0) return;
+  out << "analyser: " << frames << " frames, " << jitterStats.reordered.exchange(0) << " reordered, "
+      << jitterStats.late.exchange(0) << " late, " << jitterStats.duplicate.exchange(0) << " duplicate, "
+      << jitterStats.lost.exchange(0) << " lost (" << jitterStats.concealed.exchange(0) << " concealed)" << std::endl;
+}
+
+void JitterBuffer::store(slot_t& slot, uint64_t frameSequence, const int16_t* samples, int sampleCount) {
+  slot.frameSequence = frameSequence;
+  slot.sampleCount = std::min<int>(sampleCount, MAX_JITTER_FRAME);
+  std::memcpy(slot.samples.data(), samples, slot.sampleCount * sizeof(int16_t));
+  slot.filled = true;
+}
+
+void JitterBuffer::push(uint64_t frameSequence, const int16_t* samples, int sampleCount) {
+  jitterStats.frames.fetch_add(1, std::memory_order_relaxed);
+  if (!started) {
+    started = true;
+    next = highest = forceUntil = frameSequence;
+  }
+  if (frameSequence < next) {
+    uint64_t age = next - 1 - frameSequence;
+    bool arrivedBefore = age < 64 && (arrived >> age) & 1;
+    (arrivedBefore ? jitterStats.duplicate : jitterStats.late).fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+  if (frameSequence < highest) jitterStats.reordered.fetch_add(1, std::memory_order_relaxed);
+  highest = std::max(highest, frameSequence);
+
+  if (frameSequence - next >= MAX_JITTER_DEPTH) {
+    // too far ahead to share the ring with what's waiting: hold it, and give up on everything before it.
+    // There's one held frame, so the nearer is kept; the other is missing when pop gets to it, so counted lost there.
+    if (held.filled && held.frameSequence == frameSequence) {
+      jitterStats.duplicate.fetch_add(1, std::memory_order_relaxed);
+    } else if (!held.filled || frameSequence < held.frameSequence) {
+      store(held, frameSequence, samples, sampleCount);
+    }
+    forceUntil = std::max(forceUntil, frameSequence);
+    return;
+  }
+  slot_t& slot = slots[frameSequence % MAX_JITTER_DEPTH];
+  if (slot.filled && slot.frameSequence == frameSequence) {
+    jitterStats.duplicate.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+  store(slot, frameSequence, samples, sampleCount);
+  if (frameSequence + 1 > next + jitterDepth) {
+    forceUntil = std::max(forceUntil, frameSequence + 1 - jitterDepth);
+  }
+}
+
+void JitterBuffer::flush() {
+  if (!started) return;
+  forceUntil = std::max(forceUntil, highest + 1);
+}
+
+// The earliest frame waiting after next, if any
+const JitterBuffer::slot_t* JitterBuffer::firstAfterGap() const {
+  const slot_t* first = nullptr;
+  for (const auto& slot : slots) {
+    if (slot.filled && slot.frameSequence >= next && (first == nullptr || slot.frameSequence < first->frameSequence)) {
+      first = &slot;
+    }
+  }
+  if (held.filled && (first == nullptr || held.frameSequence < first->frameSequence)) first = &held;
+  return first;
+}
+
+// Fill concealment for frame position (0 based) of a gap of gapLength frames
+void JitterBuffer::conceal(uint64_t position, uint64_t gapLength) {
+  int count = lastCount > 0 ? lastCount : MAX_JITTER_FRAME;
+  switch (concealmentMode) {
+    case Concealment::zero:
+      std::fill(concealment.begin(), concealment.begin() + count, 0);
+      break;
+    case Concealment::repeat:
+      std::copy_n(last.begin(), count, concealment.begin());
+      break;
+    case Concealment::crossfade: {
+      // linear from the last frame towards the one after the gap (or silence at the end of a stream)
+      const slot_t* after = firstAfterGap();
+      double span = static_cast<double>(gapLength) * count + 1;
+      for (int i = 0; i < count; i++) {
+        double t = (position * count + i + 1) / span;
+        double target = after != nullptr && i < after->sampleCount ? after->samples[i] : 0;
+        concealment[i] = static_cast<int16_t>((1 - t) * last[i] + t * target);
+      }
+      break;
+    }
+  }
+  lastCount = count;
+}
+
+bool JitterBuffer::pop(uint64_t& frameSequence, const int16_t*& samples, int& sampleCount) {
+  while (started) {
+    if (held.filled && held.frameSequence < next + MAX_JITTER_DEPTH) {
+      slots[held.frameSequence % MAX_JITTER_DEPTH] = held;
+      held.filled = false;
+    }
+    slot_t& slot = slots[next % MAX_JITTER_DEPTH];
+    if (slot.filled && slot.frameSequence == next) {
+      slot.filled = false;
+      std::copy_n(slot.samples.begin(), slot.sampleCount, last.begin());
+      lastCount = slot.sampleCount;
+      frameSequence = next++;
+      arrived = (arrived << 1) | 1;
+      gapPosition = 0;
+      samples = last.data();
+      sampleCount = lastCount;
+      return true;
+    }
+    if (next >= forceUntil) return false; // still waiting for it
+
+    // the gap runs up to the next real frame we have, or as far as we've given up waiting
+    const slot_t* after = firstAfterGap();
+    uint64_t gapEnd = after != nullptr ? after->frameSequence : forceUntil;
+    if (gapEnd - next > maxConceal || lastCount == 0) {
+      // too long to paper over: skip what we've given up on
+      uint64_t skipTo = std::min(gapEnd, forceUntil);
+      jitterStats.lost.fetch_add(skipTo - next, std::memory_order_relaxed);
+      arrived = skipTo - next >= 64 ? 0 : arrived << (skipTo - next);
+      next = skipTo;
+      gapPosition = 0;
+      continue;
+    }
+    conceal(gapPosition, gapPosition + gapEnd - next);
+    gapPosition++;
+    jitterStats.lost.fetch_add(1, std::memory_order_relaxed);
+    jitterStats.concealed.fetch_add(1, std::memory_order_relaxed);
+    frameSequence = next++;
+    arrived <<= 1;
+    samples = concealment.data();
+    sampleCount = lastCount;
+    return true;
+  }
+  return false;
+}
@@ -0,0 +1,65 @@
+#ifndef ANALYSER_JITTER_HPP
+#define ANALYSER_JITTER_HPP
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <ostream>
+#include "analysis.hpp"
+
+// Per-channel reorder buffer on audioMeta_t::frameSequence, so reordered
+// frames are put back in order and missing ones are concealed rather than
+// the superframe silently splicing across the gap. Frames in order go
+// straight through; a missing frame is waited for until
+// ANALYSER_JITTER_DEPTH frames after it have arrived, then concealed per
+// ANALYSER_CONCEAL (repeat, zero or crossfade). Gaps longer than
+// ANALYSER_JITTER_MAX_CONCEAL frames are skipped instead. Fixed storage,
+// no locks: push a frame, then pop until it returns false.
+
+constexpr size_t MAX_JITTER_DEPTH = 16;
+constexpr size_t MAX_JITTER_FRAME = MAX_FRAME_SAMPLES;
+
+struct jitterStats_t {
+  std::atomic<uint64_t> frames{ 0 };
+  std::atomic<uint64_t> reordered{ 0 };  // arrived after a later frame, in time to be used
+  std::atomic<uint64_t> late{ 0 };       // arrived after being concealed or skipped
+  std::atomic<uint64_t> duplicate{ 0 };
+  std::atomic<uint64_t> lost{ 0 };       // never arrived in time
+  std::atomic<uint64_t> concealed{ 0 };  // lost frames filled in, the rest were skipped
+};
+extern jitterStats_t jitterStats;
+void reportJitterStats(std::ostream& out);
+
+class JitterBuffer {
+public:
+  void push(uint64_t frameSequence, const int16_t* samples, int sampleCount);
+  // The next frame in sequence, real or concealed, valid until the next push or pop
+  bool pop(uint64_t& frameSequence, const int16_t*& samples, int& sampleCount);
+  // Let pop release everything held, e.g. at session end
+  void flush();
+
+private:
+  struct slot_t {
+    uint64_t frameSequence;
+    bool filled = false;
+    int sampleCount;
+    std::array<int16_t, MAX_JITTER_FRAME> samples;
+  };
+  std::array<slot_t, MAX_JITTER_DEPTH> slots;
+  slot_t held; // a frame too far ahead for the ring, until pop catches up
+  bool started = false;
+  uint64_t next = 0;       // next frameSequence to pop
+  uint64_t highest = 0;    // highest pushed
+  uint64_t forceUntil = 0; // pop conceals or skips missing frames below this
+  uint64_t arrived = 0;    // bit i: next - 1 - i was a real frame
+  std::array<int16_t, MAX_JITTER_FRAME> last = {};
+  std::array<int16_t, MAX_JITTER_FRAME> concealment;
+  int lastCount = 0;
+  uint64_t gapPosition = 0; // frames concealed so far in the current gap
+
+  void store(slot_t& slot, uint64_t frameSequence, const int16_t* samples, int sampleCount);
+  const slot_t* firstAfterGap() const;
+  void conceal(uint64_t position, uint64_t gapLength);
+};
+
+#endif // ANALYSER_JITTER_HPP
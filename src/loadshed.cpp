@@ -0,0 +1,37 @@
+#include "loadshed.hpp"
+#include <iostream>
+#include "analysis.hpp"
+
+DegradationController::DegradationController(const loadShedConfig_t& config)
+  : config(config),
+    window(std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(config.windowSeconds))),
+    windowStart(clock::now()), lastChange(windowStart) {
+}
+
+void DegradationController::idle(clock::duration waited) {
+  idleTotal += waited;
+}
+
+int DegradationController::evaluate(long queued) {
+  auto now = clock::now();
+  double elapsed = std::chrono::duration<double>(now - windowStart).count();
+  double load = elapsed > 0 ? 1.0 - std::chrono::duration<double>(idleTotal).count() / elapsed : 0;
+  windowStart = now;
+  idleTotal = clock::duration::zero();
+
+  // bursts from Jamulus fill /samples even when idle, so the backlog only counts when we're also busy
+  bool overloaded = load > config.raiseLoad || (queued >= config.raiseQueued && load > config.lowerLoad);
+  int previous = current;
+  if (overloaded && current < MAX_DEGRADATION) {
+    current++;
+  } else if (load < config.lowerLoad && current > 0 &&
+             std::chrono::duration<double>(now - lastChange).count() >= config.holdSeconds) {
+    current--;
+  }
+  if (current != previous) {
+    lastChange = now;
+    std::cout << "analyser: load " << static_cast<int>(load * 100) << "%, " << queued << " queued, degradation "
+              << previous << " -> " << current << std::endl;
+  }
+  return current;
+}
@@ -0,0 +1,41 @@
+#ifndef ANALYSER_LOADSHED_HPP
+#define ANALYSER_LOADSHED_HPP
+
+#include <chrono>
+
+struct loadShedConfig_t {
+  double raiseLoad = 0.85;   // busy fraction of wall time that raises the level
+  double lowerLoad = 0.5;    // ... and that lowers it again, after holdSeconds
+  long raiseQueued = 5;      // /samples backlog that raises the level (of mq_maxmsg 10) when over lowerLoad
+  double windowSeconds = 0.5;
+  double holdSeconds = 2.0;
+};
+
+// Decides the degradation level (analysis.hpp) for the live pipeline from
+// how much of the time it's busy rather than waiting on /samples, and how far
+// behind /samples is. Steps up one level per window while overloaded, and
+// back down one level per holdSeconds of headroom, so everyone gets
+// degraded features instead of Jamulus dropping whole frames at random.
+class DegradationController {
+public:
+  using clock = std::chrono::steady_clock;
+
+  explicit DegradationController(const loadShedConfig_t& config);
+  // time spent blocked waiting for the next message
+  void idle(clock::duration waited);
+  // whether a window has ended, in which case call evaluate
+  bool due() const { return clock::now() - windowStart >= window; }
+  // returns the new level
+  int evaluate(long queued);
+  int level() const { return current; }
+
+private:
+  loadShedConfig_t config;
+  clock::duration window;
+  clock::time_point windowStart;
+  clock::duration idleTotal{ 0 };
+  clock::time_point lastChange;
+  int current = 0;
+};
+
+#endif // ANALYSER_LOADSHED_HPP
@@ -0,0 +1,199 @@
+#include "loadtest.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <oscpp/server.hpp>
+#include "analysis.hpp"
+#include "oscschema.hpp"
+#include "queues.hpp"
+
+namespace {
+
+constexpr size_t SEND_TIME_RING = 4096; // frames of history per channel, ~11s
+
+// Whether the message after a bundle's /meta makes it a feature bundle, of
+// which there's one per analysed window
+bool isFeatureMessage(const OSCPP::Server::Packet& element) {
+  if (!element.isMessage()) return false;
+  OSCPP::Server::Message message(element);
+  return message != oscAddress::onsetEvent && message != oscAddress::spectrum && message != oscAddress::mel &&
+    message != oscAddress::fragment;
+}
+
+int64_t nowNanoseconds() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+struct stepResult_t {
+  size_t channels = 0;
+  uint64_t framesSent = 0;
+  uint64_t framesDropped = 0;
+  uint64_t bundlesExpected = 0;
+  uint64_t bundlesReceived = 0;
+  double p50 = 0, p99 = 0, max = 0; // latency, ms
+  int degradation = 0; // highest load shedding level in /meta
+  bool sustained = false;
+};
+
+class OscReceiver {
+public:
+  explicit OscReceiver(size_t maxChannels) : sendTimes(maxChannels * SEND_TIME_RING) {
+    for (auto& t : sendTimes) t = 0;
+    struct mq_attr attr;
+    attr.mq_maxmsg = 10;
+    attr.mq_msgsize = MAX_MQ_MESSAGE_SIZE;
+    mqd = mq_open(OSC_QUEUE_NAME, O_RDONLY | O_CREAT, S_IRUSR | S_IWUSR, &attr);
+    if (mqd == (mqd_t)-1) {
+      std::cerr << "Can't open mq '" << OSC_QUEUE_NAME << "' for read" << std::endl;
+      exit(1);
+    }
+    thread = std::thread(&OscReceiver::receive, this);
+  }
+
+  ~OscReceiver() {
+    stopping = true;
+    thread.join();
+    mq_close(mqd);
+  }
+
+  void sent(int16_t channelId, uint64_t frameSequence) {
+    sendTimes[channelId * SEND_TIME_RING + frameSequence % SEND_TIME_RING].store(nowNanoseconds(), std::memory_order_relaxed);
+  }
+
+  void startStep() {
+    std::lock_guard<std::mutex> lock(mutex);
+    latencies.clear();
+    maxDegradation = 0;
+    for (auto& t : sendTimes) t = 0;
+  }
+
+  void finishStep(stepResult_t& result) {
+    std::lock_guard<std::mutex> lock(mutex);
+    result.bundlesReceived = latencies.size();
+    result.degradation = maxDegradation;
+    if (latencies.empty()) return;
+    std::sort(latencies.begin(), latencies.end());
+    result.p50 = latencies[latencies.size() / 2];
+    result.p99 = latencies[std::min(latencies.size() - 1, latencies.size() * 99 / 100)];
+    result.max = latencies.back();
+  }
+
+private:
+  mqd_t mqd;
+  std::vector<std::atomic<int64_t>> sendTimes;
+  std::atomic<bool> stopping{false};
+  std::mutex mutex;
+  std::vector<double> latencies; // ms, this step
+  int maxDegradation = 0;
+  std::thread thread;
+
+  void receive() {
+    alignas(4) char buffer[MAX_MQ_MESSAGE_SIZE];
+    while (!stopping) {
+      struct timespec timeout;
+      clock_gettime(CLOCK_REALTIME, &timeout);
+      timeout.tv_nsec += 200000000;
+      if (timeout.tv_nsec >= 1000000000) { timeout.tv_sec++; timeout.tv_nsec -= 1000000000; }
+      unsigned int prio;
+      ssize_t size = mq_timedreceive(mqd, buffer, sizeof(buffer), &prio, &timeout);
+      if (size <= 0) continue;
+      int64_t received = nowNanoseconds();
+      try {
+        OSCPP::Server::Packet packet(buffer, size);
+        if (!packet.isBundle()) continue;
+        OSCPP::Server::Bundle bundle(packet);
+        OSCPP::Server::PacketStream packets(bundle.packets());
+        while (!packets.atEnd()) {
+          OSCPP::Server::Packet element = packets.next();
+          if (!element.isMessage()) continue;
+          OSCPP::Server::Message message(element);
+          if (message != "/meta") continue;
+          oscMeta_t meta;
+          MetaMessage::decode(message, meta);
+          const int32_t channelId = meta.channelId, degradation = meta.degradation;
+          // only feature bundles (or /silent) count, not onset events or spectra sent alongside
+          if (packets.atEnd() || !isFeatureMessage(packets.next())) break;
+          if (channelId < 0 || static_cast<size_t>(channelId) * SEND_TIME_RING >= sendTimes.size()) break;
+          int64_t sentAt = sendTimes[channelId * SEND_TIME_RING + bundle.time() % SEND_TIME_RING].load(std::memory_order_relaxed);
+          if (sentAt == 0) break; // from before this step
+          std::lock_guard<std::mutex> lock(mutex);
+          latencies.push_back((received - sentAt) / 1e6);
+          maxDegradation = std::max(maxDegradation, degradation);
+          break;
+        }
+      } catch (const OSCPP::Error& e) {
+        // not one of ours
+      }
+    }
+  }
+};
+
+stepResult_t runStep(const loadtestConfig_t& config, OscReceiver& receiver, size_t channels) {
+  stepResult_t result;
+  result.channels = channels;
+  producerConfig_t producer = config.producer;
+  producer.channels = channels;
+  producer.seconds = config.stepSeconds;
+  producer.realtime = true;
+  producer.sessionName = "Loadtest-" + std::to_string(channels);
+  producerStats_t stats;
+
+  receiver.startStep();
+  runProducer(producer, stats, [&](int16_t channelId, uint64_t frameSequence) { receiver.sent(channelId, frameSequence); });
+  std::this_thread::sleep_for(std::chrono::seconds(1)); // let the analyser drain
+  receiver.finishStep(result);
+
+  result.framesSent = stats.framesSent;
+  result.framesDropped = stats.framesDropped;
+  result.bundlesExpected = result.framesSent * producer.frameSize / analysisHop;
+  result.sustained = result.framesDropped == 0 &&
+    result.bundlesReceived >= config.requiredDelivery * result.bundlesExpected;
+
+  std::cout << std::fixed << std::setprecision(2)
+            << "channels " << std::setw(4) << channels
+            << "  sent " << result.framesSent << "  dropped " << result.framesDropped
+            << "  bundles " << result.bundlesReceived << "/" << result.bundlesExpected
+            << "  latency ms p50 " << result.p50 << " p99 " << result.p99 << " max " << result.max
+            << "  degradation " << result.degradation
+            << (result.sustained ? "  ok" : "  overloaded") << std::endl;
+  return result;
+}
+
+} // namespace
+
+bool runLoadtest(const loadtestConfig_t& config) {
+  openMessageQueueForProducer();
+  OscReceiver receiver(config.maxChannels);
+
+  // double until the analyser falls behind, then bisect
+  size_t good = 0, bad = 0;
+  for (size_t channels = 1; channels <= config.maxChannels; channels *= 2) {
+    if (runStep(config, receiver, channels).sustained) {
+      good = channels;
+    } else {
+      bad = channels;
+      break;
+    }
+  }
+  if (bad == 0 && good < config.maxChannels) {
+    if (runStep(config, receiver, config.maxChannels).sustained) good = config.maxChannels;
+    else bad = config.maxChannels;
+  }
+  while (bad > good + 1) {
+    size_t channels = (good + bad) / 2;
+    if (runStep(config, receiver, channels).sustained) good = channels;
+    else bad = channels;
+  }
+
+  std::cout << "analyser: max sustainable channels " << good << " (analysis runs on one core)" << std::endl;
+  return good > 0;
+}
@@ -0,0 +1,20 @@
+#ifndef ANALYSER_LOADTEST_HPP
+#define ANALYSER_LOADTEST_HPP
+
+#include "producer.hpp"
+
+struct loadtestConfig_t {
+  producerConfig_t producer;   // channels and seconds are set per step
+  size_t maxChannels = 256;
+  double stepSeconds = 10;
+  double requiredDelivery = 0.99; // fraction of expected bundles that must reach /osc
+};
+
+// End-to-end benchmark against a running analyser: produce real-time load on
+// /samples for increasing channel counts, read the bundles back off /osc and
+// report drops and produce-to-receipt latency per step, then the most
+// channels the (single threaded) analyser sustains. Nothing else may be
+// reading /osc meanwhile.
+bool runLoadtest(const loadtestConfig_t& config);
+
+#endif // ANALYSER_LOADTEST_HPP
@@ -0,0 +1,213 @@
+#include "loudness.hpp"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+const size_t SUB_BLOCKS_PER_SECOND = 100;
+const size_t MOMENTARY_SUB_BLOCKS = 40;   // 400ms
+const size_t SHORT_TERM_SUB_BLOCKS = 300; // 3s
+const size_t GATING_STEP_SUB_BLOCKS = 10; // a gating block every 100ms, overlapping by 75%
+const float ABSOLUTE_GATE = -70.0f;       // LUFS
+const float RELATIVE_GATE = -10.0f;       // LU
+const size_t HISTOGRAM_BINS = 800;        // -70 to +10 LUFS
+
+// BS.1770-4 Annex 2, 4 phases of 12 taps
+const size_t TRUE_PEAK_TAPS = 12;
+const float INTERPOLATOR[4][TRUE_PEAK_TAPS] = {
+  { 0.0017089843750f, 0.0109863281250f, -0.0196533203125f, 0.0332031250000f, -0.0594482421875f, 0.1373291015625f,
+    0.9721679687500f, -0.1022949218750f, 0.0476074218750f, -0.0266113281250f, 0.0148925781250f, -0.0083007812500f },
+  { -0.0291748046875f, 0.0292968750000f, -0.0517578125000f, 0.0891113281250f, -0.1665039062500f, 0.4650878906250f,
+    0.7797851562500f, -0.2003173828125f, 0.1015625000000f, -0.0582275390625f, 0.0330810546875f, -0.0189208984375f },
+  { -0.0189208984375f, 0.0330810546875f, -0.0582275390625f, 0.1015625000000f, -0.2003173828125f, 0.7797851562500f,
+    0.4650878906250f, -0.1665039062500f, 0.0891113281250f, -0.0517578125000f, 0.0292968750000f, -0.0291748046875f },
+  { -0.0083007812500f, 0.0148925781250f, -0.0266113281250f, 0.0476074218750f, -0.1022949218750f, 0.9721679687500f,
+    0.1373291015625f, -0.0594482421875f, 0.0332031250000f, -0.0196533203125f, 0.0109863281250f, 0.0017089843750f },
+};
+// the most any phase can amplify its input by, to skip blocks that can't raise the peak
+const float INTERPOLATOR_GAIN = 2.03f;
+
+typedef float floatx4 __attribute__((vector_size(16)));
+typedef float unalignedFloatx4 __attribute__((vector_size(16), aligned(4)));
+typedef int intx4 __attribute__((vector_size(16)));
+
+// each coefficient splatted, ordered to match the delay line, oldest input first
+const std::array<std::array<floatx4, TRUE_PEAK_TAPS>, 4> PHASE_TAPS = [] {
+  std::array<std::array<floatx4, TRUE_PEAK_TAPS>, 4> taps;
+  for (size_t p = 0; p < 4; p++) {
+    for (size_t j = 0; j < TRUE_PEAK_TAPS; j++) {
+      const float h = INTERPOLATOR[p][TRUE_PEAK_TAPS - 1 - j];
+      taps[p][j] = floatx4{ h, h, h, h };
+    }
+  }
+  return taps;
+}();
+
+inline floatx4 abs(floatx4 x) {
+  return x < 0 ? -x : x;
+}
+inline floatx4 maximum(floatx4 a, floatx4 b) {
+  return a > b ? a : b;
+}
+
+float loudnessOf(double energy, double samples) {
+  if (energy <= 0) return LOUDNESS_FLOOR;
+  return std::max(LOUDNESS_FLOOR, static_cast<float>(-0.691 + 10 * std::log10(energy / samples / (32768.0 * 32768.0))));
+}
+
+} // namespace
+
+LoudnessMeter::LoudnessMeter(int sampleRate)
+  : subBlockSize(sampleRate / SUB_BLOCKS_PER_SECOND), subBlocks(SHORT_TERM_SUB_BLOCKS, 0.0),
+    blockCounts(HISTOGRAM_BINS, 0), blockEnergies(HISTOGRAM_BINS, 0.0) {
+  // K-weighting from its analogue prototype, so any rate gets BS.1770's 48kHz response
+  double K = std::tan(M_PI * 1681.974450955533 / sampleRate);
+  double Q = 0.7071752369554196;
+  double Vh = std::pow(10.0, 3.999843853973347 / 20.0);
+  double Vb = std::pow(Vh, 0.4996667741545416);
+  double a0 = 1 + K / Q + K * K;
+  const float shelf[5] = { static_cast<float>((Vh + Vb * K / Q + K * K) / a0), static_cast<float>(2 * (K * K - Vh) / a0),
+                           static_cast<float>((Vh - Vb * K / Q + K * K) / a0), static_cast<float>(2 * (K * K - 1) / a0),
+                           static_cast<float>((1 - K / Q + K * K) / a0) };
+  K = std::tan(M_PI * 38.13547087602444 / sampleRate);
+  Q = 0.5003270373238773;
+  a0 = 1 + K / Q + K * K;
+  const float highPass[5] = { 1, -2, 1, static_cast<float>(2 * (K * K - 1) / a0),
+                              static_cast<float>((1 - K / Q + K * K) / a0) };
+  floatx4* lanes[5] = { &b0, &b1, &b2, &a1, &a2 };
+  for (int c = 0; c < 5; c++) *lanes[c] = floatx4{ shelf[c], shelf[c], highPass[c], highPass[c] };
+  for (auto& line : delayLines) line.assign(TRUE_PEAK_TAPS - 1 + subBlockSize + 4, 0.0f);
+}
+
+void LoudnessMeter::process(const float* left, const float* right, size_t count) {
+  while (count > 0) {
+    size_t n = std::min(count, subBlockSize - subBlockFill);
+    filter(left, right, n);
+    oversample(left, right, n);
+    left += n;
+    if (right) right += n;
+    count -= n;
+    subBlockFill += n;
+    if (subBlockFill == subBlockSize) endSubBlock();
+  }
+}
+
+// Transposed direct form II, where x is each lane's input. Locals, so the
+// state stays in registers rather than going back through this.
+void LoudnessMeter::filter(const float* left, const float* right, size_t count) {
+  const floatx4 b0 = this->b0, b1 = this->b1, b2 = this->b2, a1 = this->a1, a2 = this->a2;
+  floatx4 s1 = this->s1, s2 = this->s2, y = stage, energy = {};
+  for (size_t i = 0; i < count; i++) {
+    floatx4 input = { left[i], right ? right[i] : 0.0f, 0, 0 };
+    floatx4 x = __builtin_shuffle(input, y, intx4{ 0, 1, 4, 5 }); // one shuffle, not through memory
+    y = b0 * x + s1;
+    s1 = (b1 * x + s2) - a1 * y; // grouped so only a1 * y waits on y
+    s2 = b2 * x - a2 * y;
+    energy += y * y;
+  }
+  subBlockEnergy += energy[2] + energy[3];
+  // flush decaying state before it goes denormal in silence
+  for (int lane = 0; lane < 4; lane++) {
+    if (std::fabs(s1[lane]) < 1e-15f) s1[lane] = 0;
+    if (std::fabs(s2[lane]) < 1e-15f) s2[lane] = 0;
+  }
+  this->s1 = s1;
+  this->s2 = s2;
+  stage = y;
+}
+
+void LoudnessMeter::endSubBlock() {
+  const double energy = subBlockEnergy;
+  subBlockEnergy = 0;
+  subBlockFill = 0;
+  // add the new sub-block to each window and drop the one that leaves it
+  const size_t ring = subBlocks.size();
+  momentaryEnergy += energy - subBlocks[(subBlockPosition + ring - MOMENTARY_SUB_BLOCKS) % ring];
+  shortTermEnergy += energy - subBlocks[subBlockPosition];
+  subBlocks[subBlockPosition] = energy;
+  subBlockPosition = (subBlockPosition + 1) % ring;
+  subBlockCount++;
+  if (subBlockPosition == 0) {
+    // start afresh every lap, so rounding can't accumulate
+    shortTermEnergy = 0;
+    for (double e : subBlocks) shortTermEnergy += e;
+    momentaryEnergy = 0;
+    for (size_t i = ring - MOMENTARY_SUB_BLOCKS; i < ring; i++) momentaryEnergy += subBlocks[i];
+  }
+
+  if (subBlockCount >= MOMENTARY_SUB_BLOCKS && subBlockCount % GATING_STEP_SUB_BLOCKS == 0) {
+    float block = loudnessOf(momentaryEnergy, MOMENTARY_SUB_BLOCKS * subBlockSize);
+    if (block > ABSOLUTE_GATE) {
+      size_t bin = std::min<size_t>((block - ABSOLUTE_GATE) * 10, HISTOGRAM_BINS - 1);
+      blockCounts[bin]++;
+      blockEnergies[bin] += momentaryEnergy;
+      integratedStale = true;
+    }
+  }
+}
+
+// Four outputs of each phase at a time, along the delay line
+void LoudnessMeter::oversample(const float* left, const float* right, size_t count) {
+  const float* sides[2] = { left, right };
+  const intx4 lanes = { 0, 1, 2, 3 };
+  for (int s = 0; s < (right ? 2 : 1); s++) {
+    float* line = delayLines[s].data(); // the last TRUE_PEAK_TAPS - 1 inputs, then these
+    std::copy_n(sides[s], count, line + TRUE_PEAK_TAPS - 1);
+    const size_t length = count + TRUE_PEAK_TAPS - 1;
+    floatx4 inputs = {};
+    size_t k = 0;
+    for (; k + 4 <= length; k += 4) inputs = maximum(inputs, abs(*reinterpret_cast<const unalignedFloatx4*>(line + k)));
+    float loudestInput = std::max({ inputs[0], inputs[1], inputs[2], inputs[3] });
+    for (; k < length; k++) loudestInput = std::max(loudestInput, std::fabs(line[k]));
+    if (loudestInput * INTERPOLATOR_GAIN > peak) {
+      floatx4 top = {};
+      for (size_t i = 0; i < count; i += 4) {
+        // named rather than an array, so they stay in registers
+        floatx4 phase0 = {}, phase1 = {}, phase2 = {}, phase3 = {};
+        for (size_t j = 0; j < TRUE_PEAK_TAPS; j++) {
+          const floatx4 x = *reinterpret_cast<const unalignedFloatx4*>(line + i + j);
+          phase0 += PHASE_TAPS[0][j] * x;
+          phase1 += PHASE_TAPS[1][j] * x;
+          phase2 += PHASE_TAPS[2][j] * x;
+          phase3 += PHASE_TAPS[3][j] * x;
+        }
+        floatx4 loudest = maximum(maximum(abs(phase0), abs(phase1)), maximum(abs(phase2), abs(phase3)));
+        const intx4 valid = lanes < static_cast<int>(count - i); // past the end on the last round
+        top = maximum(top, valid ? loudest : floatx4{});
+      }
+      peak = std::max({ peak, top[0], top[1], top[2], top[3] });
+    }
+    std::copy_n(line + count, TRUE_PEAK_TAPS - 1, line);
+  }
+}
+
+loudness_t LoudnessMeter::read() {
+  if (integratedStale) {
+    integratedStale = false;
+    // absolute gated, then again without the blocks more than 10 LU under that
+    uint64_t blocks = 0;
+    double energy = 0;
+    for (size_t b = 0; b < HISTOGRAM_BINS; b++) {
+      blocks += blockCounts[b];
+      energy += blockEnergies[b];
+    }
+    const double blockSamples = MOMENTARY_SUB_BLOCKS * subBlockSize;
+    float threshold = loudnessOf(energy, blocks * blockSamples) + RELATIVE_GATE;
+    // bins whose centre is over the threshold
+    long first = std::max(0L, static_cast<long>(std::floor((threshold - ABSOLUTE_GATE) * 10 - 0.5)) + 1);
+    blocks = 0;
+    energy = 0;
+    for (size_t b = first; b < HISTOGRAM_BINS; b++) {
+      blocks += blockCounts[b];
+      energy += blockEnergies[b];
+    }
+    integrated = blocks > 0 ? loudnessOf(energy, blocks * blockSamples) : LOUDNESS_FLOOR;
+  }
+  loudness_t loudness;
+  loudness.momentary = loudnessOf(momentaryEnergy, MOMENTARY_SUB_BLOCKS * subBlockSize);
+  loudness.shortTerm = loudnessOf(shortTermEnergy, SHORT_TERM_SUB_BLOCKS * subBlockSize);
+  loudness.integrated = integrated;
+  loudness.truePeak = peak > 0 ? std::max(LOUDNESS_FLOOR, 20 * std::log10(peak / 32768.0f)) : LOUDNESS_FLOOR;
+  peak = 0;
+  return loudness;
+}
@@ -0,0 +1,61 @@
+#ifndef ANALYSER_LOUDNESS_HPP
+#define ANALYSER_LOUDNESS_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// EBU R128 (ITU-R BS.1770-4) loudness of one channel's stream, mono or a
+// stereo pair, fed every sample as it arrives rather than per window.
+// K-weighting is a high shelf and a high pass; both sides and both stages
+// run as lanes of one 4-wide biquad, the second stage a sample behind.
+// Filtered energy is summed per 10ms sub-block, and momentary (400ms) and
+// short-term (3s) loudness are running sums over a ring of those.
+// Integrated loudness is gated over 400ms blocks every 100ms: absolutely
+// at -70 LUFS, then relative to the result less 10 LU, from a histogram so
+// it costs the same however long the session. True peak is the maximum of
+// 4x oversampled input, with BS.1770's 48 tap interpolator.
+
+constexpr float LOUDNESS_FLOOR = -120.0f; // LUFS and dBTP for silence
+
+struct loudness_t {
+  float momentary = LOUDNESS_FLOOR;  // LUFS
+  float shortTerm = LOUDNESS_FLOOR;  // LUFS
+  float integrated = LOUDNESS_FLOOR; // LUFS, since the meter started
+  float truePeak = LOUDNESS_FLOOR;   // dBTP, since the last read
+};
+
+class LoudnessMeter {
+public:
+  explicit LoudnessMeter(int sampleRate);
+  // Samples at int16 scale; right is nullptr for mono
+  void process(const float* left, const float* right, size_t count);
+  // The latest values, and starts the next true peak
+  loudness_t read();
+private:
+  typedef float floatx4 __attribute__((vector_size(16)));
+  // K-weighting lanes: left and right shelf, then left and right high pass
+  floatx4 b0, b1, b2, a1, a2;
+  floatx4 s1 = {}, s2 = {}, stage = {}; // stage holds the last shelf outputs, for the high pass
+  size_t subBlockSize, subBlockFill = 0;
+  float subBlockEnergy = 0;
+  std::vector<double> subBlocks; // energy ring, the last 3s
+  size_t subBlockPosition = 0;
+  uint64_t subBlockCount = 0;
+  double momentaryEnergy = 0, shortTermEnergy = 0;
+  // integrated: count and summed energy of gating blocks in 0.1 LU bins from -70 LUFS
+  std::vector<uint32_t> blockCounts;
+  std::vector<double> blockEnergies;
+  float integrated = LOUDNESS_FLOOR;
+  bool integratedStale = false;
+  // true peak: each side's interpolator input, up to a sub-block after the last 11 samples
+  std::array<std::vector<float>, 2> delayLines;
+  float peak = 0;
+
+  void filter(const float* left, const float* right, size_t count);
+  void endSubBlock();
+  void oversample(const float* left, const float* right, size_t count);
+};
+
+#endif // ANALYSER_LOUDNESS_HPP
@@ -1,157 +1,206 @@
 #include <mqueue.h>
 #include <fcntl.h>              /* For definition of O_NONBLOCK */
+#include <algorithm>
+#include <chrono>
+#include <cmath>
 #include <iostream>
 #include <fstream>
 #include <filesystem>
 #include <string>
 #include <memory>
+#include <thread>
+#include <random>
 #include <unordered_map>
 #include <signal.h>
 #define _BSD_SOURCE   /* To get definitions of NI_MAXHOST and NI_MAXSERV from <netdb.h> */
 #include <netdb.h>
 #define ADDRSTRLEN (NI_MAXHOST + NI_MAXSERV + 10)
 #include <unistd.h>
-#include "Gist.h"
-#include <oscpp/client.hpp>
-
-constexpr ssize_t MAX_MQ_MESSAGE_SIZE = 2048; // must be at least mq_msgsize
-
-// The same code in jamulus, so whoever gets there first will create the queue
-mqd_t read_mqd;
-struct mq_attr read_attr;
-const char* SAMPLES_QUEUE_NAME = "/samples"; // from Jamulus
-void openMessageQueueForRead() {
-  mode_t perms = S_IRUSR | S_IWUSR;
-  read_attr.mq_maxmsg = 10;
-  read_attr.mq_msgsize = MAX_MQ_MESSAGE_SIZE;
-  read_mqd = mq_open(SAMPLES_QUEUE_NAME, O_RDONLY | O_CREAT, perms, &read_attr); // will block
-  if (read_mqd == (mqd_t)-1) {
-    std::cerr << "Can't open mq '" << SAMPLES_QUEUE_NAME << "' for read" << std::endl;
-    exit(1);
-  }
-  std::cout << "Opened mq for read" << std::endl;
-  // Validate queue attributes
-  if (mq_getattr(read_mqd, &read_attr) == -1) {
-    std::cerr << "Can't fetch attributes for mq '" << SAMPLES_QUEUE_NAME << "'" << std::endl;
-    return;
-  }
-  if (read_attr.mq_msgsize > MAX_MQ_MESSAGE_SIZE) {
-    std::cerr << "mq_msgsize " << read_attr.mq_msgsize << " > MAX_MQ_MESSAGE_SIZE " << MAX_MQ_MESSAGE_SIZE << std::endl;
-    return;
-  }
+#include "accuracy.hpp"
+#include "analysis.hpp"
+#include "archive.hpp"
+#include "batch.hpp"
+#include "bench.hpp"
+#include "config.hpp"
+#include "jitter.hpp"
+#include "loadshed.hpp"
+#include "loadtest.hpp"
+#include "onseteval.hpp"
+#include "output.hpp"
+#include "producer.hpp"
+#include "queues.hpp"
+#include "replay.hpp"
+#include "spectrum.hpp"
+#include "trace.hpp"
+#include "uploader.hpp"
+
+char oscBuffer[MAX_OSC_PACKET_SIZE];
+
+char receivedMeta[MAX_MQ_MESSAGE_SIZE];
+char receivedFrame[MAX_MQ_MESSAGE_SIZE];
+std::unordered_map<int16_t, channelState_t> channels; // within a session, channelId -> analysis state
+std::unordered_map<int16_t, std::unique_ptr<ChannelOutput>> oscFiles; // within a session, channelId -> .oscs/.osca output
+
+// Frames are put back in frameSequence order before analysis, see jitter.hpp
+struct channelInput_t {
+  JitterBuffer jitter;
+  std::string filename;
+  int channels = 0; // 1, or 2 for stereo, from the first frame
+  bool layoutWarned = false;
+};
+std::unordered_map<int16_t, channelInput_t> inputs; // within a session, channelId -> input
+
+// ANALYSER_ARCHIVE=1 also writes a compact .osca next to each .oscs,
+// encoded per ANALYSER_ARCHIVE_ENCODING (see archive.hpp)
+const bool writeArchives = envFlag("ANALYSER_ARCHIVE");
+const ArchiveEncodingSpec archiveEncoding(envString("ANALYSER_ARCHIVE_ENCODING", ""));
+
+std::string oscDirectoryPrefix("/tmp/");
+std::string oscDirectoryName; // populate on start of a session, clear on session end
+
+// Sealed sessions are moved off the box by background workers, see uploader.hpp
+std::unique_ptr<Uploader> uploader;
+
+// .oscs output rolls into chunks that upload while the session is running,
+// so session end only has the last partial chunk left to send. Seconds are
+// of audio, counted in the channel's own frames (see forFrames), so batch
+// rolls at the same frames.
+chunkConfig_t oscChunks = { static_cast<size_t>(envLong("ANALYSER_CHUNK_BYTES", 16 * 1024 * 1024)),
+                            envDouble("ANALYSER_CHUNK_SECONDS", 60.0) };
+
+void startUploader() {
+  uploaderConfig_t config;
+  config.queueDirectory = envString("ANALYSER_UPLOAD_QUEUE", "/tmp/upload-queue");
+  config.concurrency = envLong("ANALYSER_UPLOAD_CONCURRENCY", 2);
+  config.maxAttempts = envLong("ANALYSER_UPLOAD_ATTEMPTS", 5);
+  config.bytesPerSecond = envLong("ANALYSER_UPLOAD_BYTES_PER_SEC", 0);
+  auto target = makeUploadTarget(envString("ANALYSER_UPLOAD_TARGET", "s3://meyfroidt/osc"),
+                                 envString("ANALYSER_UPLOAD_ENDPOINT", ""));
+  uploader = std::make_unique<Uploader>(std::move(target), config);
 }
 
-// The same code in oscserver, so whoever gets there first will create the queue
-mqd_t write_mqd;
-struct mq_attr write_attr;
-const char* OSC_QUEUE_NAME = "/osc";
-void openMessageQueueForWrite() {
-  mode_t perms = S_IRUSR | S_IWUSR;
-  write_attr.mq_maxmsg = 10;
-  write_attr.mq_msgsize = MAX_MQ_MESSAGE_SIZE;
-  write_mqd = mq_open(OSC_QUEUE_NAME, O_WRONLY | O_CREAT | O_NONBLOCK, perms, &write_attr);
-  if (write_mqd == (mqd_t)-1) {
-    std::cerr << "Can't open mq '" << OSC_QUEUE_NAME << "' for write" << std::endl;
-    exit(1);
-  }
-  std::cout << "Opened mq for write" << std::endl;
-  // Validate queue attributes
-  if (mq_getattr(write_mqd, &write_attr) == -1) {
-    std::cerr << "Can't fetch attributes for mq '" << OSC_QUEUE_NAME << "'" << std::endl;
-    return;
+// ANALYSER_PERF_COUNTERS=1 reports hardware counters per stage at the end of
+// each session. ANALYSER_TRACE=1 writes a trace to ANALYSER_TRACE_DIRECTORY at the end of
+// each session, and on SIGUSR1 (when the next message arrives)
+const std::string traceDirectory = envString("ANALYSER_TRACE_DIRECTORY", "/tmp");
+volatile sig_atomic_t traceRequested = 0;
+
+void requestTrace(int) {
+  traceRequested = 1;
+}
+
+void dumpTrace(const std::string& name) {
+  writeTrace(traceDirectory + "/analyser-trace-" + name + ".json");
+}
+
+// From the pipeline, on a thread of its own, as formatting up to
+// ANALYSER_TRACE_EVENTS per thread would hold up /samples. Dumps take the
+// trace's lock, so overlapping ones run one after the other.
+void dumpTraceInBackground(const std::string& name) {
+  if (!traceEnabled) return;
+  std::thread(dumpTrace, name).detach();
+}
+
+// Overload sheds features rather than frames, see loadshed.hpp. ANALYSER_LOAD_SHED=0 turns it off.
+const bool loadShedding = envLong("ANALYSER_LOAD_SHED", 1) != 0;
+
+loadShedConfig_t loadShedFromEnv() {
+  loadShedConfig_t config;
+  config.raiseLoad = envDouble("ANALYSER_LOAD_SHED_HIGH", config.raiseLoad);
+  config.lowerLoad = envDouble("ANALYSER_LOAD_SHED_LOW", config.lowerLoad);
+  return config;
+}
+
+// Jamulus sends SAMPLE_RATE, ANALYSER_INPUT_RATE is for other sources on /samples
+const int inputRate = envLong("ANALYSER_INPUT_RATE", SAMPLE_RATE);
+
+// Analyse one frame, and send and write a bundle for each window it completes
+void processFrame(int16_t channelId, const channelInput_t& input, uint64_t frameSequence,
+                  const int16_t* samples, int sampleCount) {
+  auto channel = channels.find(channelId);
+  if (channel == channels.end()) {
+    channel = channels.emplace(channelId, channelState_t()).first;
+    channel->second.inputRate = inputRate;
+    channel->second.inputChannels = input.channels;
   }
-  if (write_attr.mq_msgsize > MAX_MQ_MESSAGE_SIZE) {
-    std::cerr << "mq_msgsize " << write_attr.mq_msgsize << " > MAX_MQ_MESSAGE_SIZE " << MAX_MQ_MESSAGE_SIZE << std::endl;
-    return;
+  for (int offset = 0; offset < sampleCount; ) {
+    size_t consumed;
+    ssize_t bufferSize = analyseFrame(channel->second, channelId, frameSequence, samples + offset,
+                                      sampleCount - offset, consumed, oscBuffer);
+    offset += consumed;
+    if (bufferSize == 0) {
+      continue; // keep filling up the superframe
+    }
+
+    // Create new file on first time we see a channel
+    if (oscFiles.find(channelId) == oscFiles.end()) {
+      TraceScope trace(TraceStage::openOutput, channelId, frameSequence);
+      oscFiles[channelId] = std::make_unique<ChannelOutput>(oscDirectoryPrefix + oscDirectoryName, input.filename,
+                                                            oscDirectoryName, uploader.get(),
+                                                            oscChunks.forFrames(sampleCount / input.channels, inputRate),
+                                                            writeArchives ? &archiveEncoding : nullptr);
+    }
+
+    // The bundle, then any spectrum packets of its window
+    do {
+      // Forward OSC to the oscserver
+      {
+        TraceScope trace(TraceStage::send, channelId, frameSequence);
+        if (mq_send(write_mqd, oscBuffer, bufferSize, 0) == -1) {
+//          std::cerr << "failed to send osc buffer" << std::endl;
+        }
+      }
+      TraceScope trace(TraceStage::write, channelId, frameSequence);
+      oscFiles[channelId]->write(oscBuffer, bufferSize, frameSequence);
+    } while ((bufferSize = nextSpectrumPacket(channel->second, oscBuffer)) > 0);
   }
 }
 
-const size_t MAX_OSC_PACKET_SIZE = 512; // safe max is ethernet packet MTU 1500 (minus overhead gives max 1380) https://superuser.com/questions/1341012/practical-vs-theoretical-max-limit-of-tcp-packet-size
-char oscBuffer[MAX_OSC_PACKET_SIZE];
+// With more than one channel tracking tempo, the ensemble's goes to the
+// oscserver (not to any channel's file) about as often as a window's
+const auto ensembleTempoInterval = std::chrono::microseconds(1000000 * SAMPLES_PER_SUPERFRAME / SAMPLE_RATE);
+std::chrono::steady_clock::time_point nextEnsembleTempo;
 
-// Use the frameSequence as OSC timestamp, which is not correct, but might be enough
-size_t makeOscPacket(int channelId, uint64_t frameSequence, Gist<float>& gist) {
-//  const auto now = std::chrono::system_clock::now();
-//  unsigned long long timestamp = std::chrono::nanoseconds(now - startTime).count(); // TODO: this should be a 64bit NTP Timestamp
-  OSCPP::Client::Packet packet(oscBuffer, MAX_OSC_PACKET_SIZE);
-  packet
-    //.openBundle(timestamp)
-    .openBundle(frameSequence)
-      .openMessage("/meta", 1)
-        .int32(channelId)
-      .closeMessage()
-      .openMessage("/time", 3)
-        .float32(gist.rootMeanSquare())
-        .float32(gist.peakEnergy())
-        .float32(gist.zeroCrossingRate())
-      .closeMessage()
-      .openMessage("/freq", 5)
-        .float32(gist.spectralCentroid())
-        .float32(gist.spectralCrest())
-        .float32(gist.spectralFlatness())
-        .float32(gist.spectralRolloff())
-        .float32(gist.spectralKurtosis())
-      .closeMessage()
-      .openMessage("/onset", 5)
-        .float32(gist.energyDifference())
-        .float32(gist.spectralDifference())
-        .float32(gist.spectralDifferenceHWR())
-        .float32(gist.complexSpectralDifference())
-        .float32(gist.highFrequencyContent())
-      .closeMessage()
-      .openMessage("/pitch", 1)
-        .float32(gist.pitch())
-      .closeMessage()
-//      .openMessage("/spectrum", OSCPP::Tags::array(gist.getMagnitudeSpectrum().size()))
-//        .openArray()
-//  for(float x : gist.getMagnitudeSpectrum()) {
-//    packet.float32(x)
-//  }
-//  packet
-//        .closeArray()
-//      .closeMessage()
-//      .openMessage("/mel", OSCPP::Tags::array(gist.getMelFrequencySpectrum().size()))
-//        .openArray()
-//  for(float x : gist.getMelFrequencySpectrum()) {
-//    packet.float32(x)
-//  }
-//  packet
-//        .closeArray()
-//      .closeMessage()
-      .openMessage("/mfcc", OSCPP::Tags::array(gist.getMelFrequencyCepstralCoefficients().size()));
-  for(float x : gist.getMelFrequencyCepstralCoefficients()) {
-    packet.float32(x);
+void sendEnsembleTempo(uint64_t frameSequence) {
+  const auto now = std::chrono::steady_clock::now();
+  if (!tempoEnabled || now < nextEnsembleTempo) return;
+  nextEnsembleTempo = now + ensembleTempoInterval;
+  std::vector<const TempoTracker*> trackers;
+  for (const auto& channel : channels) {
+    if (channel.second.tempo) trackers.push_back(channel.second.tempo.get());
   }
-  packet
-      .closeMessage()
-    .closeBundle();
-  return packet.size();
+  if (trackers.size() < 2) return;
+  size_t bufferSize = makeTempoPacket(oscBuffer, ENSEMBLE_CHANNEL_ID, frameSequence, ensembleTempo(trackers),
+                                      degradationLevel);
+  TraceScope trace(TraceStage::send, ENSEMBLE_CHANNEL_ID, frameSequence);
+  mq_send(write_mqd, oscBuffer, bufferSize, 0);
 }
 
-const int SAMPLE_RATE = 48000; // for Gist: needs to match what Jamulus is sending
+// Analyse whatever the jitter buffer can release in order
+void releaseFrames(int16_t channelId, channelInput_t& input) {
+  uint64_t frameSequence;
+  const int16_t* samples;
+  int sampleCount;
+  bool released = false;
+  while (input.jitter.pop(frameSequence, samples, sampleCount)) {
+    processFrame(channelId, input, frameSequence, samples, sampleCount);
+    released = true;
+  }
+  if (released) sendEnsembleTempo(frameSequence);
+}
 
-char receivedMeta[MAX_MQ_MESSAGE_SIZE];
-char receivedFrame[MAX_MQ_MESSAGE_SIZE];
-constexpr float FRAMES_PER_SUPERFRAME = 8.0; // 25 frames would be 1/15th of a sec
-constexpr float SAMPLES_PER_FRAME = 128.0; // need to know what Jamulus is sending per audio frame
-constexpr size_t SAMPLES_PER_SUPERFRAME = SAMPLES_PER_FRAME * FRAMES_PER_SUPERFRAME;
-// FIXME: should be a hash of structs
-std::unordered_map<int16_t, std::array<float, SAMPLES_PER_SUPERFRAME>> superFrames; // within a session, channelId -> superframe
-std::unordered_map<int16_t, int16_t> superFrameOffsets; // within a session, channelId -> current superframe offset
-std::unordered_map<int16_t, std::unique_ptr<std::ofstream>> oscFiles; // within a session, channelId -> ofstream ptr
-
-// Copy this from Jamulus jamrecorder.cpp
-static constexpr size_t MAX_OSC_FILEPATH_LENGTH = 64;
-enum class META_TYPE { startSession=0, endSession, audioFrame };
-struct startSessionMeta_t { int8_t metaType; char sessionDir[MAX_OSC_FILEPATH_LENGTH+1]; };
-struct endSessionMeta_t  { int8_t metaType; };
-struct audioMeta_t { int8_t metaType; int16_t channelId; uint64_t frameSequence; double offsetSeconds; char filename[MAX_OSC_FILEPATH_LENGTH+1]; };
-// Jam-20240326-145726119/____-86_175_246_x_22141-0-1.wav
+void pipeMessages() {
+  startUploader();
+  DegradationController degradation(loadShedFromEnv());
 
-std::string oscDirectoryPrefix("/tmp/");
-std::string oscDirectoryName; // populate on start of a session, clear on session end
+  if (traceEnabled) {
+    traceThreadName("pipeline");
+    struct sigaction action = {};
+    action.sa_handler = requestTrace;
+    action.sa_flags = SA_RESTART; // so mq_receive carries on waiting
+    sigaction(SIGUSR1, &action, nullptr);
+  }
 
-void pipeMessages() {
   // open the MQ to read audio frames from Jamulus
   openMessageQueueForRead();
   // open the MQ to write OSC messages to oscserver
@@ -170,7 +219,20 @@ void pipeMessages() {
 
   while(true) {
 
+    auto waitStart = DegradationController::clock::now();
     ssize_t sizeRead = mq_receive(read_mqd, receivedMeta, read_attr.mq_msgsize, &prio);
+    if (loadShedding) {
+      degradation.idle(DegradationController::clock::now() - waitStart);
+      if (degradation.due()) {
+        mq_attr attr;
+        mq_getattr(read_mqd, &attr);
+        degradationLevel = degradation.evaluate(attr.mq_curmsgs);
+      }
+    }
+    if (traceRequested) {
+      traceRequested = 0;
+      dumpTraceInBackground(std::to_string(time(nullptr)));
+    }
     int8_t metaType = static_cast<int8_t>(receivedMeta[0]);
 
     if (metaType == static_cast<int8_t>(META_TYPE::startSession)) {
@@ -178,12 +240,15 @@ void pipeMessages() {
         std::cerr << "ignoring start session when existing session open: " << oscDirectoryName << std::endl;
         continue;
       }
+      TraceScope trace(TraceStage::startSession);
       startSessionMeta_t* meta = reinterpret_cast<startSessionMeta_t*>(receivedMeta);
       oscDirectoryName = std::string(meta->sessionDir);
       std::string p = oscDirectoryPrefix + oscDirectoryName;
       std::filesystem::create_directory(p);
       // TODO: write metadata file
       oscFiles.clear(); // flushes, closes
+      channels.clear();
+      inputs.clear();
       std::cout << "analyser: start session '" <<  oscDirectoryName << "'" << std::endl;
       continue;
     }
@@ -193,11 +258,21 @@ void pipeMessages() {
         std::cerr << "ignoring end session when no existing session" << std::endl;
         continue;
       }
-      oscFiles.clear(); // flushes, closes
-      std::string p = oscDirectoryPrefix + oscDirectoryName;
-      std::string cmd("aws s3 mv " + p + " s3://meyfroidt/osc/" + oscDirectoryName + " --recursive && rmdir " + p);
-      std::system(cmd.c_str());
+      {
+        TraceScope trace(TraceStage::endSession);
+        for (auto& input : inputs) {
+          input.second.jitter.flush();
+          releaseFrames(input.first, input.second);
+        }
+        inputs.clear();
+        oscFiles.clear(); // seals and enqueues the last chunks
+        uploader->enqueue(oscDirectoryPrefix + oscDirectoryName, oscDirectoryName);
+      }
       std::cout << "analyser: end session '" << oscDirectoryName << "'" << std::endl;
+      reportJitterStats(std::cout);
+      reportGateStats(std::cout);
+      reportStageCounters(std::cout);
+      dumpTraceInBackground(oscDirectoryName);
       oscDirectoryName = "";
       continue;
     }
@@ -216,63 +291,229 @@ void pipeMessages() {
     }
 
     audioMeta_t* meta = reinterpret_cast<audioMeta_t*>(receivedMeta);
-    if (meta->metaType != static_cast<int8_t>(META_TYPE::audioFrame)) {
+    if (meta->metaType != static_cast<int8_t>(META_TYPE::audioFrame) &&
+        meta->metaType != static_cast<int8_t>(META_TYPE::stereoAudioFrame)) {
       std::cerr << "ignoring audioFrame meta, metaType " << meta->metaType << std::endl;
       continue;
     }
+    const int frameChannels = meta->metaType == static_cast<int8_t>(META_TYPE::stereoAudioFrame) ? 2 : 1;
 
     // the next message is an audio frame
     sizeRead = mq_receive(read_mqd, receivedFrame, read_attr.mq_msgsize, &prio);
-    if (sizeRead < 200 || sizeRead % 2 == 1) {
+    const ssize_t frameBytes = frameChannels * sizeof(int16_t);
+    if (sizeRead < static_cast<ssize_t>(MIN_FRAME_SAMPLES * frameBytes) || sizeRead % frameBytes != 0) {
       std::cerr << "ignoring audio frame with unexpected size " << sizeRead << std::endl;
       continue;
     }
 
-    // Create new superframe if required
-    superFrames.try_emplace(meta->channelId, std::array<float, SAMPLES_PER_SUPERFRAME>());
-    superFrameOffsets.try_emplace(meta->channelId, 0);
-    // TODO: for analysis, copy last frame over current if we missed any
-    // Merge 8 frames from Jamulus into a super-frame for analysis
-    // samples from Jamulus are int16_t, Gist wants float32, so convert
     int sampleCount = sizeRead / sizeof(int16_t);
-    auto& superFrame = superFrames[meta->channelId];
-    if (sampleCount != SAMPLES_PER_FRAME) {
-      std::cerr << "ignoring frame where sampleCount " << sampleCount << " != " << SAMPLES_PER_FRAME << std::endl;
+    channelInput_t& input = inputs[meta->channelId];
+    if (input.filename.empty()) input.filename = meta->filename;
+    if (input.channels == 0) input.channels = frameChannels;
+    if (input.channels != frameChannels) {
+      // the analysis is already set up for the other layout
+      if (!input.layoutWarned) {
+        std::cerr << "ignoring " << (frameChannels == 2 ? "stereo" : "mono") << " frames on channel "
+                  << meta->channelId << " after it started out the other way" << std::endl;
+        input.layoutWarned = true;
+      }
       continue;
     }
-    float* data = superFrame.data() + superFrameOffsets[meta->channelId]++;
-    for(ssize_t i = 0; i < sampleCount * sizeof(int16_t); i += sizeof(int16_t)) {
-      *data++ = static_cast<float>(*(reinterpret_cast<int16_t*>(receivedFrame + i))); // little-endian int16_t to float32
-    }
+    input.jitter.push(meta->frameSequence, reinterpret_cast<int16_t*>(receivedFrame), sampleCount);
+    releaseFrames(meta->channelId, input);
+  }
+}
 
-    if (superFrameOffsets[meta->channelId] < FRAMES_PER_SUPERFRAME) {
-      continue; // keep filling up the superframe
+// Four seconds of a gliding tone over noise, with half a second of silence,
+// analysed into a .oscs as a live channel's would be
+bool writeSyntheticOscs(const std::string& path) {
+  std::ofstream out(path, std::ios::binary);
+  std::mt19937 random(42);
+  std::normal_distribution<float> noise(0.0f, 300.0f);
+  channelState_t channel;
+  int16_t frame[static_cast<size_t>(SAMPLES_PER_FRAME)];
+  double phase = 0;
+  const uint64_t frames = 4 * SAMPLE_RATE / SAMPLES_PER_FRAME;
+  for (uint64_t frameSequence = 0; frameSequence < frames; frameSequence++) {
+    for (size_t i = 0; i < SAMPLES_PER_FRAME; i++) {
+      const double t = (frameSequence * SAMPLES_PER_FRAME + i) / SAMPLE_RATE;
+      phase += 2 * M_PI * (220 + 165 * t) / SAMPLE_RATE;
+      frame[i] = (t >= 2 && t < 2.5) ? 0 : static_cast<int16_t>(8000 * std::sin(phase) + noise(random));
     }
-    superFrameOffsets[meta->channelId] = 0;
-
-    // Use Gist to analyse and then make an OSC packet
-    Gist<float> gist(sampleCount, SAMPLE_RATE);
-    gist.processAudioFrame(superFrame.data(), sampleCount);
-    ssize_t bufferSize = makeOscPacket(meta->channelId, meta->frameSequence, gist);
-
-    // Forward OSC to the oscserver
-    if (mq_send(write_mqd, oscBuffer, bufferSize, 0) == -1) {
-//      std::cerr << "failed to send osc buffer" << std::endl;
+    for (size_t offset = 0; offset < SAMPLES_PER_FRAME; ) {
+      size_t consumed;
+      size_t bufferSize = analyseFrame(channel, 0, frameSequence, frame + offset, SAMPLES_PER_FRAME - offset,
+                                       consumed, oscBuffer);
+      offset += consumed;
+      for (; bufferSize > 0; bufferSize = nextSpectrumPacket(channel, oscBuffer)) out.write(oscBuffer, bufferSize);
     }
+  }
+  return static_cast<bool>(out);
+}
 
-    // Create new file on first time we see a channel
-    if (oscFiles.find(meta->channelId) == oscFiles.end()) {
-      std::string filepath(oscDirectoryPrefix + oscDirectoryName + "/" + meta->filename + ".oscs");
-      oscFiles[meta->channelId] = std::make_unique<std::ofstream>(filepath, std::ios::binary);
+// analyser archive [--generate <file.oscs>] <file.oscs>...
+// Convert existing session files to .osca and check the round trip, each
+// value within its bound (see ANALYSER_ARCHIVE_ENCODING). --generate first
+// writes a synthetic session file to check, as `make archive-check` does.
+int archiveMain(int argc, char* argv[]) {
+  std::vector<std::string> paths(argv, argv + argc);
+  if (!paths.empty() && paths[0] == "--generate") {
+    if (paths.size() < 2 || !writeSyntheticOscs(paths[1])) {
+      std::cerr << "usage: analyser archive [--generate <file.oscs>] <file.oscs>..." << std::endl;
+      return 1;
     }
+    paths.erase(paths.begin());
+  }
+  if (paths.empty()) {
+    std::cerr << "usage: analyser archive [--generate <file.oscs>] <file.oscs>..." << std::endl;
+    return 1;
+  }
+  bool ok = true;
+  for (const std::string& path : paths) {
+    ok = archiveOscsFile(path, archiveEncoding) && ok;
+  }
+  return ok ? 0 : 1;
+}
+
+// analyser spectra <file.oscs>...
+// Decode the /spectrum and /mel frames in session files, reassembling fragments
+int spectraMain(int argc, char* argv[]) {
+  if (argc < 1) {
+    std::cerr << "usage: analyser spectra <file.oscs>..." << std::endl;
+    return 1;
+  }
+  bool ok = true;
+  for (int i = 0; i < argc; i++) {
+    ok = readSpectra(argv[i]) && ok;
+  }
+  return ok ? 0 : 1;
+}
 
-    // TODO: find the last frame number written, write blanks (as special markers) so that
-    // TODO: the file length is consistent throughout,
-    oscFiles[meta->channelId]->write(oscBuffer, bufferSize);
+// analyser batch <dir> [outputPrefix]
+// Re-analyse Jamulus WAV recordings offline into the same .oscs chunks as
+// live mode, except for the channel ids in /meta
+int batchMain(int argc, char* argv[]) {
+  if (argc < 1) {
+    std::cerr << "usage: analyser batch <dir> [outputPrefix]" << std::endl
+              << "  recordings don't keep Jamulus' channel ids, so /meta numbers each session's files in name order" << std::endl;
+    return 1;
   }
+  batchConfig_t config;
+  config.inputDirectory = argv[0];
+  config.outputPrefix = argc > 1 ? std::string(argv[1]) + "/" : oscDirectoryPrefix;
+  config.jobs = envLong("ANALYSER_BATCH_JOBS", 0);
+  config.archiveEncoding = writeArchives ? &archiveEncoding : nullptr;
+  config.chunks = oscChunks;
+  bool ok = runBatch(config);
+  reportGateStats(std::cout);
+  reportStageCounters(std::cout);
+  dumpTrace("batch");
+  return ok ? 0 : 1;
+}
+
+// analyser replay <sessionDir> [speed]
+// Re-emit a session's .oscs onto /osc: speed 1 is real time (default), N is
+// N times faster, 0 is as fast as the consumer takes them.
+// ANALYSER_REPLAY_LOOP=1 repeats until killed.
+int replayMain(int argc, char* argv[]) {
+  if (argc < 1) {
+    std::cerr << "usage: analyser replay <sessionDir> [speed]" << std::endl;
+    return 1;
+  }
+  replayConfig_t config;
+  config.sessionDirectory = argv[0];
+  config.speed = argc > 1 ? std::atof(argv[1]) : 1.0;
+  config.loop = envFlag("ANALYSER_REPLAY_LOOP");
+  return runReplay(config) ? 0 : 1;
+}
+
+producerConfig_t producerFromEnv(bool burstByDefault) {
+  producerConfig_t config;
+  config.channels = envLong("ANALYSER_WRITER_CHANNELS", 4);
+  config.seconds = envDouble("ANALYSER_WRITER_SECONDS", 60);
+  config.realtime = envLong("ANALYSER_WRITER_REALTIME", 1) != 0;
+  config.burst = envLong("ANALYSER_WRITER_BURST", burstByDefault) != 0;
+  config.source = envString("ANALYSER_WRITER_SOURCE", "tone");
+  config.frameSize = envLong("ANALYSER_WRITER_FRAME", SAMPLES_PER_FRAME);
+  config.stereoChannels = envLong("ANALYSER_WRITER_STEREO", 0);
+  config.loss = envDouble("ANALYSER_WRITER_LOSS", 0);
+  config.reorder = envDouble("ANALYSER_WRITER_REORDER", 0);
+  config.duplicate = envDouble("ANALYSER_WRITER_DUPLICATE", 0);
+  return config;
+}
+
+// analyser writer
+// Synthetic Jamulus: one session of ANALYSER_WRITER_CHANNELS channels of
+// ANALYSER_WRITER_SOURCE (tone, noise or recordings) onto /samples, the
+// first ANALYSER_WRITER_STEREO of them in stereo.
+// ANALYSER_WRITER_LOSS, _REORDER and _DUPLICATE impair it like a network.
+int writerMain() {
+  openMessageQueueForProducer();
+  producerConfig_t config = producerFromEnv(true);
+  producerStats_t stats;
+  bool ok = runProducer(config, stats);
+  std::cout << "analyser: writer sent " << stats.framesSent << " frames, dropped " << stats.framesDropped << std::endl;
+  return ok ? 0 : 1;
+}
+
+// analyser loadtest [maxChannels]
+// Run against a live analyser to find how many channels it sustains. Sends are
+// spread over each frame period by default so the 10 message queue depth
+// doesn't mask CPU capacity; ANALYSER_WRITER_BURST=1 tests Jamulus-style bursts.
+int loadtestMain(int argc, char* argv[]) {
+  loadtestConfig_t config;
+  config.producer = producerFromEnv(false);
+  config.maxChannels = argc > 0 ? std::atol(argv[0]) : 256;
+  config.stepSeconds = envDouble("ANALYSER_LOADTEST_SECONDS", 10);
+  return runLoadtest(config) ? 0 : 1;
+}
+
+// analyser bench [filter]
+// Kernel microbenchmarks as JSON on stdout, see `make bench`
+int benchMain(int argc, char* argv[]) {
+  runBenchmarks(std::cout, argc > 0 ? argv[0] : "");
+  return 0;
+}
+
+// analyser accuracy [engine...] [-- recording...]
+// Compare feature engines against the reference (gist) on synthetic signals
+// and any .wav recordings or directories given after --. Per-feature
+// tolerances come from ANALYSER_ACCURACY_TOLERANCE as feature=abs:rel,...
+int accuracyMain(int argc, char* argv[]) {
+  accuracyConfig_t config;
+  int i = 0;
+  for (; i < argc && std::string(argv[i]) != "--"; i++) config.engines.push_back(argv[i]);
+  for (i++; i < argc; i++) config.recordings.push_back(argv[i]);
+  config.tolerances = envString("ANALYSER_ACCURACY_TOLERANCE", "");
+  config.windowSize = envLong("ANALYSER_ACCURACY_WINDOW", SAMPLES_PER_SUPERFRAME);
+  config.maxRecordedWindows = envLong("ANALYSER_ACCURACY_WINDOWS", 500);
+  return runAccuracy(config) ? 0 : 1;
+}
+
+// analyser onsets [recording...]
+// Precision, recall and latency of the onset events on a labelled synthetic
+// corpus and any .wav recordings (or directories) given with their labels
+int onsetsMain(int argc, char* argv[]) {
+  onsetEvalConfig_t config;
+  for (int i = 0; i < argc; i++) config.recordings.push_back(argv[i]);
+  config.toleranceMs = envDouble("ANALYSER_ONSET_TOLERANCE_MS", 50);
+  config.frameSize = std::clamp<long>(envLong("ANALYSER_ONSET_FRAME", static_cast<long>(SAMPLES_PER_FRAME)), 1L,
+                                     static_cast<long>(MAX_FRAME_SAMPLES));
+  return runOnsetEvaluation(config) ? 0 : 1;
 }
 
 int main(int argc, char* argv[]) {
+  std::string mode(argc > 1 ? argv[1] : "");
+  if (mode == "archive") return archiveMain(argc - 2, argv + 2);
+  if (mode == "spectra") return spectraMain(argc - 2, argv + 2);
+  if (mode == "batch") return batchMain(argc - 2, argv + 2);
+  if (mode == "replay") return replayMain(argc - 2, argv + 2);
+  if (mode == "writer") return writerMain();
+  if (mode == "bench") return benchMain(argc - 2, argv + 2);
+  if (mode == "loadtest") return loadtestMain(argc - 2, argv + 2);
+  if (mode == "accuracy") return accuracyMain(argc - 2, argv + 2);
+  if (mode == "onsets") return onsetsMain(argc - 2, argv + 2);
+
   // TODO: signal handler for ctrl-c
 
   std::cout << "Start OSC message pipeline\n";
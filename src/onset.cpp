@@ -0,0 +1,168 @@
+#include "onset.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include "config.hpp"
+
+namespace {
+
+const size_t BINS = ONSET_WINDOW / 2 + 1;
+const size_t PADDED_BINS = (BINS + 3) / 4 * 4; // whole vectors, the padding stays 0
+// power is scaled so a full scale sine's bin is about 3e4 before the log and
+// the -70dBFS noise of a quiet input well under 1, so it barely registers
+const float POWER_SCALE = 1e3f / (32768.0f * 32768.0f * ONSET_WINDOW);
+// per hop, so the envelope of past fluxes falls by e in about 25ms
+const float ENVELOPE_DECAY = 0.9f;
+
+typedef float floatx4 __attribute__((vector_size(16)));
+typedef int32_t intx4 __attribute__((vector_size(16)));
+
+// log2 to about 0.005, from the exponent and a quadratic over the mantissa
+inline floatx4 fastLog2(floatx4 x) {
+  intx4 bits;
+  std::memcpy(&bits, &x, sizeof(bits));
+  const floatx4 exponent = __builtin_convertvector((bits >> 23) - 127, floatx4);
+  bits = (bits & 0x007fffff) | 0x3f800000;
+  floatx4 mantissa;
+  std::memcpy(&mantissa, &bits, sizeof(mantissa));
+  return exponent + (mantissa * -0.34484843f + 2.02466578f) * mantissa - 1.67487759f;
+}
+
+const size_t MAX_PROCESS_HOPS = 16; // room for a few frames' hops before latestFluxes has to grow
+
+size_t hopsOf(double ms, int sampleRate) {
+  return std::max<size_t>(1, std::lround(ms / 1000.0 * sampleRate / ONSET_HOP));
+}
+
+} // namespace
+
+onsetConfig_t onsetConfigFromEnv(int sampleRate) {
+  onsetConfig_t config;
+  config.delta = envDouble("ANALYSER_ONSET_DELTA", config.delta);
+  config.lambda = envDouble("ANALYSER_ONSET_LAMBDA", config.lambda);
+  config.medianHops = hopsOf(envDouble("ANALYSER_ONSET_MEDIAN_MS", 100), sampleRate);
+  config.minimumHops = hopsOf(envDouble("ANALYSER_ONSET_MIN_MS", 30), sampleRate);
+  return config;
+}
+
+OnsetDetector::OnsetDetector(const onsetConfig_t& config) : config(config) {
+  const size_t half = ONSET_WINDOW / 2;
+  fft = kiss_fft_alloc(half, 0, nullptr, nullptr);
+  window.resize(ONSET_WINDOW);
+  for (size_t i = 0; i < ONSET_WINDOW; i++) window[i] = 0.5 * (1 - std::cos(2 * M_PI * i / (ONSET_WINDOW - 1.0)));
+  cosines.resize(BINS);
+  sines.resize(BINS);
+  for (size_t k = 0; k < BINS; k++) {
+    cosines[k] = std::cos(2 * M_PI * k / ONSET_WINDOW);
+    sines[k] = std::sin(2 * M_PI * k / ONSET_WINDOW);
+  }
+  packed.resize(half);
+  transformed.resize(half);
+  sorted.reserve(config.medianHops);
+  latestFluxes.reserve(MAX_PROCESS_HOPS);
+  reset();
+}
+
+OnsetDetector::~OnsetDetector() {
+  kiss_fft_free(fft);
+}
+
+void OnsetDetector::reset() {
+  samples.assign(ONSET_WINDOW, 0.0f);
+  fill = 0;
+  spectra.assign(3 * PADDED_BINS, 0.0f);
+  hops = 0;
+  fluxes.assign(config.medianHops, 0.0f);
+  previousFlux = olderFlux = envelope = 0;
+  sinceOnset = config.minimumHops;
+  latestFluxes.clear();
+}
+
+bool OnsetDetector::process(const float* input, size_t count, onsetEvent_t& event) {
+  bool found = false;
+  size_t after = 0; // samples since the hop that confirmed it
+  latestFluxes.clear();
+  while (count > 0) {
+    const size_t n = std::min(count, ONSET_HOP - fill);
+    std::copy_n(input, n, samples.begin() + ONSET_WINDOW - ONSET_HOP + fill);
+    input += n;
+    count -= n;
+    fill += n;
+    after += n;
+    if (fill < ONSET_HOP) break;
+    fill = 0;
+    float strength;
+    latestFluxes.push_back(flux());
+    if (pickPeak(latestFluxes.back(), strength)) {
+      found = true;
+      event.strength = strength;
+      after = 0;
+    }
+    std::copy(samples.begin() + ONSET_HOP, samples.end(), samples.begin());
+  }
+  // the peak was the hop before the one that confirmed it
+  if (found) event.latency = ONSET_PEAK_DELAY + ONSET_HOP + after;
+  return found;
+}
+
+// Half-wave rectified rise in log power since two hops before, per bin
+float OnsetDetector::flux() {
+  // the window's even and odd samples as one complex signal of half the length
+  const size_t half = ONSET_WINDOW / 2;
+  for (size_t m = 0; m < half; m++) {
+    packed[m].r = samples[2 * m] * window[2 * m];
+    packed[m].i = samples[2 * m + 1] * window[2 * m + 1];
+  }
+  kiss_fft(fft, packed.data(), transformed.data());
+
+  // split into the even and odd halves' spectra and combine them: X = E + W^k O
+  float* power = spectra.data() + (hops % 3) * PADDED_BINS;
+  for (size_t k = 0; k < BINS; k++) {
+    const kiss_fft_cpx& z = transformed[k % half];
+    const kiss_fft_cpx& mirror = transformed[(half - k) % half];
+    const float evenR = 0.5f * (z.r + mirror.r), evenI = 0.5f * (z.i - mirror.i);
+    const float oddR = 0.5f * (z.i + mirror.i), oddI = -0.5f * (z.r - mirror.r);
+    const float r = evenR + cosines[k] * oddR + sines[k] * oddI;
+    const float i = evenI + cosines[k] * oddI - sines[k] * oddR;
+    power[k] = r * r + i * i;
+  }
+
+  floatx4* current = reinterpret_cast<floatx4*>(power);
+  const floatx4* before = reinterpret_cast<const floatx4*>(spectra.data() + ((hops + 1) % 3) * PADDED_BINS);
+  floatx4 rise = {};
+  for (size_t v = 0; v < PADDED_BINS / 4; v++) {
+    current[v] = fastLog2(current[v] * POWER_SCALE + 1.0f);
+    floatx4 difference = current[v] - before[v];
+    rise += difference > 0 ? difference : floatx4{};
+  }
+  // kept as the max of each bin and its neighbours, so a partial moving a bin isn't a rise
+  float last = power[0];
+  for (size_t k = 0; k + 1 < BINS; k++) {
+    const float here = power[k];
+    power[k] = std::max(std::max(last, here), power[k + 1]);
+    last = here;
+  }
+  power[BINS - 1] = std::max(last, power[BINS - 1]);
+  hops++;
+  return (rise[0] + rise[1] + rise[2] + rise[3]) / BINS;
+}
+
+// Whether the previous hop was an onset, now that current shows it was a peak.
+// It must also reach the decaying envelope of earlier fluxes, so a noisy
+// decay (a snare's, say) doesn't make a second onset once minimumHops pass.
+bool OnsetDetector::pickPeak(float current, float& strength) {
+  const float candidate = previousFlux;
+  fluxes[hops % fluxes.size()] = candidate;
+  sorted.assign(fluxes.begin(), fluxes.end());
+  std::nth_element(sorted.begin(), sorted.begin() + sorted.size() / 2, sorted.end());
+  const float threshold = config.delta + config.lambda * sorted[sorted.size() / 2];
+
+  const bool onset = candidate > olderFlux && candidate >= current && candidate >= threshold &&
+                     candidate >= envelope && sinceOnset >= config.minimumHops;
+  envelope = std::max(candidate, ENVELOPE_DECAY * envelope + (1 - ENVELOPE_DECAY) * candidate);
+  sinceOnset = onset ? 0 : sinceOnset + 1;
+  olderFlux = candidate;
+  previousFlux = current;
+  strength = candidate;
+  return onset;
+}
@@ -0,0 +1,75 @@
+#ifndef ANALYSER_ONSET_HPP
+#define ANALYSER_ONSET_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "kiss_fft.h"
+
+// Onset events, for consumers that want "a note started" rather than the raw
+// detection functions /onset sends every superframe. Every ONSET_HOP samples
+// the latest ONSET_WINDOW of them, Hann windowed, give a log power spectrum,
+// and the detection function is how much that rose since two hops before,
+// half-wave rectified and averaged over the bins (spectral flux). A hop is
+// an onset when its flux peaks above delta + lambda x the median flux of the
+// last medianHops, at least minimumHops after the previous onset, and isn't
+// under the decaying envelope of the fluxes before it. The reference spectrum
+// is maximum filtered over neighbouring bins (as SuperFlux does) so vibrato
+// doesn't count. The peak is confirmed as soon as the flux falls, one hop later.
+
+constexpr size_t ONSET_HOP = 128;
+constexpr size_t ONSET_WINDOW = 4 * ONSET_HOP;
+// From an onset to the end of the hop where its flux peaks, when it's about
+// mid window, as measured over `analyser onsets`' corpus
+constexpr uint32_t ONSET_PEAK_DELAY = ONSET_WINDOW / 2 + ONSET_HOP / 2;
+
+struct onsetConfig_t {
+  float delta = 0.03f;      // ANALYSER_ONSET_DELTA, flux an onset needs over silence
+  float lambda = 1.5f;      // ANALYSER_ONSET_LAMBDA, and over the median
+  size_t medianHops = 38;   // ANALYSER_ONSET_MEDIAN_MS, 100ms
+  size_t minimumHops = 11;  // ANALYSER_ONSET_MIN_MS, 30ms
+};
+// From the environment, in hops of ONSET_HOP at sampleRate
+onsetConfig_t onsetConfigFromEnv(int sampleRate);
+
+struct onsetEvent_t {
+  float strength = 0;   // flux at the peak
+  uint32_t latency = 0; // samples from the onset to the end of the input it was confirmed in
+};
+
+// Keeps history between calls, so use one per channel and stream
+class OnsetDetector {
+public:
+  explicit OnsetDetector(const onsetConfig_t& config);
+  ~OnsetDetector();
+  OnsetDetector(const OnsetDetector&) = delete;
+  OnsetDetector& operator=(const OnsetDetector&) = delete;
+  // Samples at int16 scale. Returns whether an onset was confirmed in them
+  // and sets event, the latest if there were several.
+  bool process(const float* samples, size_t count, onsetEvent_t& event);
+  // The flux of each hop completed in the last process call, oldest first,
+  // as a detection function for the tempo tracker (tempo.hpp)
+  const std::vector<float>& hopFluxes() const { return latestFluxes; }
+  // Forget the history, e.g. after a gap in the input
+  void reset();
+private:
+  onsetConfig_t config;
+  kiss_fft_cfg fft; // half size: the window's even and odd samples as one complex signal
+  std::vector<float> window, cosines, sines;
+  std::vector<kiss_fft_cpx> packed, transformed;
+  std::vector<float> samples; // the latest ONSET_WINDOW, oldest first
+  size_t fill = 0;            // new samples since the last hop
+  std::vector<float> spectra; // log power of the last three hops, maximum filtered, a ring of 16 byte aligned rows
+  size_t hops = 0;
+  std::vector<float> fluxes;  // the last medianHops, a ring
+  std::vector<float> sorted;  // scratch for the median
+  float previousFlux = 0, olderFlux = 0; // the last two hops'; the previous one is the candidate
+  float envelope = 0;         // of fluxes, decaying, for pickPeak
+  size_t sinceOnset = 0;      // hops
+  std::vector<float> latestFluxes;
+
+  float flux();
+  bool pickPeak(float current, float& strength);
+};
+
+#endif // ANALYSER_ONSET_HPP
@@ -0,0 +1,319 @@
+#include "onseteval.hpp"
+#include <algorithm>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include "analysis.hpp"
+#include "onset.hpp"
+#include "resampler.hpp"
+#include "wavfile.hpp"
+
+namespace fs = std::filesystem;
+
+namespace {
+
+const double CORPUS_SECONDS = 10;
+
+struct labelled_t {
+  std::string label;
+  std::vector<float> samples; // at SAMPLE_RATE, int16 scale
+  std::vector<double> onsets; // seconds
+};
+
+struct detection_t {
+  double estimate;  // seconds, the event's confirmation less its latency
+  double confirmed; // seconds, the end of the frame it came in
+};
+
+struct score_t {
+  size_t labels = 0, detections = 0, matched = 0;
+  std::vector<double> latencies; // ms from onset to confirmation, matched only
+  std::vector<double> offsets;   // ms from onset to estimate, matched only
+  void add(const score_t& other) {
+    labels += other.labels;
+    detections += other.detections;
+    matched += other.matched;
+    latencies.insert(latencies.end(), other.latencies.begin(), other.latencies.end());
+    offsets.insert(offsets.end(), other.offsets.begin(), other.offsets.end());
+  }
+};
+
+// Quantised to int16 like Jamulus audio, over a -70dBFS noise floor
+labelled_t quantise(const std::string& label, const std::vector<double>& signal, std::vector<double> onsets,
+                    std::mt19937& random) {
+  std::normal_distribution<double> floor(0.0, std::pow(10.0, -70 / 20.0));
+  labelled_t sequence{ label, std::vector<float>(signal.size()), std::move(onsets) };
+  for (size_t i = 0; i < signal.size(); i++) {
+    double x = std::clamp(signal[i] + floor(random), -1.0, 32767.0 / 32768.0);
+    sequence.samples[i] = static_cast<float>(std::lround(x * 32768.0));
+  }
+  return sequence;
+}
+
+double logUniform(std::mt19937& random, double low, double high) {
+  return std::exp(std::uniform_real_distribution<double>(std::log(low), std::log(high))(random));
+}
+
+// Adds a note to signal from onset, shaped by envelope(t) until it falls silent
+void addNote(std::vector<double>& signal, double onset, const std::function<double(double)>& note,
+             double duration) {
+  const size_t start = onset * SAMPLE_RATE;
+  const size_t end = std::min(signal.size(), start + static_cast<size_t>(duration * SAMPLE_RATE));
+  for (size_t i = start; i < end; i++) signal[i] += note(static_cast<double>(i - start) / SAMPLE_RATE);
+}
+
+labelled_t plucks(const std::string& label, std::mt19937& random, double noiseDbfs) {
+  std::vector<double> signal(CORPUS_SECONDS * SAMPLE_RATE);
+  std::vector<double> onsets;
+  std::uniform_real_distribution<double> uniform(0, 1);
+  for (double t = 0.2; t < CORPUS_SECONDS - 0.5; t += 0.08 + 0.52 * uniform(random)) {
+    const double hz = logUniform(random, 80, 1200);
+    const double gain = std::pow(10.0, (-30 + 24 * uniform(random)) / 20);
+    const double decay = 0.08 + 0.42 * uniform(random);
+    addNote(signal, t, [=](double s) {
+      const double envelope = gain * std::min(1.0, s / 0.002) * std::exp(-s / decay);
+      return envelope * (std::sin(2 * M_PI * hz * s) + 0.5 * std::sin(4 * M_PI * hz * s) +
+                         0.25 * std::sin(6 * M_PI * hz * s)) / 1.75;
+    }, 5 * decay);
+    onsets.push_back(t);
+  }
+  if (noiseDbfs > -100) {
+    std::normal_distribution<double> noise(0.0, std::pow(10.0, noiseDbfs / 20));
+    for (auto& x : signal) x += noise(random);
+    onsets.insert(onsets.begin(), 0.0); // the noise starting
+  }
+  return quantise(label, signal, onsets, random);
+}
+
+labelled_t drums(std::mt19937& random) {
+  std::vector<double> signal(CORPUS_SECONDS * SAMPLE_RATE);
+  std::vector<double> onsets;
+  std::uniform_real_distribution<double> uniform(0, 1);
+  std::normal_distribution<double> white(0.0, 1.0);
+  for (double t = 0.2; t < CORPUS_SECONDS - 0.5; t += 0.1 + 0.3 * uniform(random)) {
+    const double gain = std::pow(10.0, (-12 + 12 * uniform(random)) / 20);
+    const int kind = static_cast<int>(3 * uniform(random));
+    if (kind == 0) {
+      // kick: a sine swept from 150Hz down to 45
+      addNote(signal, t, [=](double s) {
+        const double phase = 2 * M_PI * (45 * s + 105 * 0.03 * (1 - std::exp(-s / 0.03)));
+        return gain * std::exp(-s / 0.15) * std::sin(phase);
+      }, 0.75);
+    } else if (kind == 1) {
+      // snare: noise over a 190Hz body
+      std::vector<double> noise(0.4 * SAMPLE_RATE);
+      for (auto& x : noise) x = white(random);
+      addNote(signal, t, [=](double s) {
+        const double n = noise[std::min(noise.size() - 1, static_cast<size_t>(s * SAMPLE_RATE))];
+        return gain * (0.4 * n * std::exp(-s / 0.08) + 0.5 * std::sin(2 * M_PI * 190 * s) * std::exp(-s / 0.05));
+      }, 0.4);
+    } else {
+      // hat: differenced noise, so mostly highs
+      std::vector<double> noise(0.15 * SAMPLE_RATE + 1);
+      for (auto& x : noise) x = white(random);
+      addNote(signal, t, [=](double s) {
+        const size_t i = std::min(noise.size() - 2, static_cast<size_t>(s * SAMPLE_RATE));
+        return gain * 0.25 * (noise[i + 1] - noise[i]) * std::exp(-s / 0.03);
+      }, 0.15);
+    }
+    onsets.push_back(t);
+  }
+  return quantise("drums", signal, onsets, random);
+}
+
+// Legato: each note fades in over 25ms as the last fades out, so only pitch marks most onsets
+labelled_t softAttacks(std::mt19937& random) {
+  std::vector<double> signal(CORPUS_SECONDS * SAMPLE_RATE);
+  std::vector<double> onsets;
+  std::uniform_real_distribution<double> uniform(0, 1);
+  const double fade = 0.025;
+  for (double t = 0.2; t < CORPUS_SECONDS - 1; ) {
+    const double length = 0.25 + 0.55 * uniform(random);
+    const double hz = logUniform(random, 150, 800);
+    const double gain = std::pow(10.0, (-12 + 6 * uniform(random)) / 20);
+    addNote(signal, t, [=](double s) {
+      const double in = s < fade ? 0.5 * (1 - std::cos(M_PI * s / fade)) : 1.0;
+      const double out = s > length ? 0.5 * (1 + std::cos(M_PI * (s - length) / fade)) : 1.0;
+      return gain * in * out * (std::sin(2 * M_PI * hz * s) + 0.3 * std::sin(4 * M_PI * hz * s)) / 1.3;
+    }, length + fade);
+    onsets.push_back(t);
+    t += length;
+  }
+  return quantise("soft attacks", signal, onsets, random);
+}
+
+// No onsets after the first: vibrato and tremolo shouldn't trigger events
+labelled_t steadyTone(std::mt19937& random) {
+  std::vector<double> signal(CORPUS_SECONDS * SAMPLE_RATE);
+  double phase = 0;
+  for (size_t i = 0; i < signal.size(); i++) {
+    const double s = static_cast<double>(i) / SAMPLE_RATE;
+    const double hz = 220 * std::pow(2.0, 0.2 / 12 * std::sin(2 * M_PI * 5.5 * s));
+    phase += 2 * M_PI * hz / SAMPLE_RATE;
+    const double gain = 0.25 * std::pow(10.0, 1.5 * std::sin(2 * M_PI * 4 * s) / 20);
+    signal[i] = gain * (std::sin(phase) + 0.5 * std::sin(2 * phase) + 0.25 * std::sin(3 * phase)) / 1.75;
+  }
+  return quantise("steady tone", signal, { 0.0 }, random);
+}
+
+std::vector<labelled_t> syntheticCorpus() {
+  std::mt19937 random(2024);
+  std::vector<labelled_t> corpus;
+  corpus.push_back(plucks("plucks", random, -200));
+  corpus.push_back(plucks("plucks in noise", random, -40));
+  corpus.push_back(drums(random));
+  corpus.push_back(softAttacks(random));
+  corpus.push_back(steadyTone(random));
+  return corpus;
+}
+
+// x.onsets or x.txt next to x.wav, the first number on each line
+bool readLabels(const fs::path& wavPath, std::vector<double>& onsets) {
+  for (const char* extension : { ".onsets", ".txt" }) {
+    fs::path path = wavPath;
+    path.replace_extension(extension);
+    std::ifstream in(path);
+    if (!in) continue;
+    std::string line;
+    while (std::getline(in, line)) {
+      std::istringstream fields(line);
+      double seconds;
+      if (fields >> seconds) onsets.push_back(seconds);
+    }
+    std::sort(onsets.begin(), onsets.end());
+    return true;
+  }
+  return false;
+}
+
+bool addRecording(const fs::path& path, std::vector<labelled_t>& corpus) {
+  labelled_t sequence{ path.filename().string(), {}, {} };
+  if (!readLabels(path, sequence.onsets)) {
+    std::cerr << "skipping " << path.string() << ", no .onsets or .txt labels next to it" << std::endl;
+    return true;
+  }
+  MappedWav wav;
+  if (!wav.open(path.string())) return false;
+  size_t count = wav.frames();
+  const int16_t* interleaved = wav.frameView(0, count);
+  std::vector<float> mono(count);
+  for (size_t i = 0; i < count; i++) {
+    int sum = 0; // mixed down, as batch does for more than two channels
+    for (int c = 0; c < wav.channels(); c++) sum += interleaved[i * wav.channels() + c];
+    mono[i] = static_cast<float>(sum / wav.channels());
+  }
+  if (wav.sampleRate() == SAMPLE_RATE) {
+    sequence.samples = std::move(mono);
+  } else {
+    auto resampler = makeResampler(wav.sampleRate(), SAMPLE_RATE, resamplerQuality);
+    if (!resampler) {
+      std::cerr << "can't resample " << path.string() << " from " << wav.sampleRate() << "Hz" << std::endl;
+      return false;
+    }
+    sequence.samples.resize(count * SAMPLE_RATE / wav.sampleRate() + 1);
+    size_t used;
+    sequence.samples.resize(resampler->process(mono.data(), count, sequence.samples.data(), sequence.samples.size(),
+                                               used));
+  }
+  corpus.push_back(std::move(sequence));
+  return true;
+}
+
+std::vector<detection_t> detect(const labelled_t& sequence, const onsetConfig_t& config, size_t frameSize) {
+  OnsetDetector detector(config);
+  std::vector<detection_t> detections;
+  onsetEvent_t event;
+  for (size_t start = 0; start < sequence.samples.size(); start += frameSize) {
+    const size_t count = std::min(frameSize, sequence.samples.size() - start);
+    if (detector.process(sequence.samples.data() + start, count, event)) {
+      const double confirmed = static_cast<double>(start + count) / SAMPLE_RATE;
+      detections.push_back({ confirmed - static_cast<double>(event.latency) / SAMPLE_RATE, confirmed });
+    }
+  }
+  return detections;
+}
+
+// Each label takes the closest unmatched detection within the tolerance
+score_t score(const std::vector<double>& onsets, const std::vector<detection_t>& detections, double tolerance) {
+  score_t result;
+  result.labels = onsets.size();
+  result.detections = detections.size();
+  std::vector<bool> used(detections.size(), false);
+  for (double onset : onsets) {
+    size_t best = detections.size();
+    for (size_t d = 0; d < detections.size(); d++) {
+      if (used[d] || std::fabs(detections[d].estimate - onset) > tolerance) continue;
+      if (best == detections.size() ||
+          std::fabs(detections[d].estimate - onset) < std::fabs(detections[best].estimate - onset)) {
+        best = d;
+      }
+    }
+    if (best == detections.size()) continue;
+    used[best] = true;
+    result.matched++;
+    result.latencies.push_back(1000 * (detections[best].confirmed - onset));
+    result.offsets.push_back(1000 * (detections[best].estimate - onset));
+  }
+  return result;
+}
+
+void report(const std::string& label, const score_t& s) {
+  const double precision = s.detections > 0 ? static_cast<double>(s.matched) / s.detections : 1;
+  const double recall = s.labels > 0 ? static_cast<double>(s.matched) / s.labels : 1;
+  const double f = precision + recall > 0 ? 2 * precision * recall / (precision + recall) : 0;
+  std::cout << "  " << std::left << std::setw(20) << label << std::right << std::fixed << std::setprecision(3)
+            << " onsets " << std::setw(4) << s.labels << "  events " << std::setw(4) << s.detections
+            << "  P " << precision << "  R " << recall << "  F " << f;
+  if (!s.latencies.empty()) {
+    std::vector<double> latencies = s.latencies;
+    std::sort(latencies.begin(), latencies.end());
+    double mean = 0, offset = 0, spread = 0;
+    for (double l : latencies) mean += l;
+    for (double o : s.offsets) offset += o;
+    mean /= latencies.size();
+    offset /= s.offsets.size();
+    for (double o : s.offsets) spread += (o - offset) * (o - offset);
+    spread = std::sqrt(spread / s.offsets.size());
+    std::cout << std::setprecision(1) << "  latency mean " << mean << " p95 "
+              << latencies[std::min(latencies.size() - 1, latencies.size() * 95 / 100)] << " max " << latencies.back()
+              << "ms  timing " << std::showpos << offset << std::noshowpos << " sd " << spread << "ms";
+  }
+  std::cout << std::defaultfloat << std::endl;
+}
+
+} // namespace
+
+bool runOnsetEvaluation(const onsetEvalConfig_t& config) {
+  std::vector<labelled_t> corpus = syntheticCorpus();
+  bool ok = true;
+  for (const auto& recording : config.recordings) {
+    std::error_code error;
+    if (fs::is_directory(recording, error)) {
+      std::vector<fs::path> files;
+      for (const auto& entry : fs::recursive_directory_iterator(recording, error)) {
+        if (entry.is_regular_file() && entry.path().extension() == ".wav") files.push_back(entry.path());
+      }
+      std::sort(files.begin(), files.end());
+      for (const auto& file : files) ok = addRecording(file, corpus) && ok;
+    } else {
+      ok = addRecording(recording, corpus) && ok;
+    }
+  }
+
+  const onsetConfig_t onsets = onsetConfigFromEnv(SAMPLE_RATE);
+  std::cout << "analyser: onset events in " << config.frameSize << " sample frames, matched within "
+            << config.toleranceMs << "ms (delta " << onsets.delta << ", lambda " << onsets.lambda << ")" << std::endl;
+  score_t total;
+  for (const auto& sequence : corpus) {
+    score_t s = score(sequence.onsets, detect(sequence, onsets, config.frameSize), config.toleranceMs / 1000);
+    report(sequence.label, s);
+    total.add(s);
+  }
+  report("all", total);
+  return ok;
+}
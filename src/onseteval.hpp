@@ -0,0 +1,23 @@
+#ifndef ANALYSER_ONSETEVAL_HPP
+#define ANALYSER_ONSETEVAL_HPP
+
+#include <string>
+#include <vector>
+
+// Benchmark for the onset event stage (onset.hpp) on a labelled corpus: a
+// seeded synthetic one of plucked notes, drums, soft attacks and onset-free
+// tones, plus any recordings given with their labels alongside (x.wav with
+// x.onsets or x.txt, one onset time in seconds per line, as onset datasets
+// ship them). Each is fed in Jamulus sized frames, as live, and detections
+// are matched to labels within the tolerance for precision, recall and
+// F-measure, with the latency from each onset to its event.
+struct onsetEvalConfig_t {
+  std::vector<std::string> recordings; // .wav files or directories of them
+  double toleranceMs;                  // 50 is the usual for onset evaluation
+  size_t frameSize;                    // samples per call, as Jamulus frames would be
+};
+
+// Returns false if a recording couldn't be read
+bool runOnsetEvaluation(const onsetEvalConfig_t& config);
+
+#endif // ANALYSER_ONSETEVAL_HPP
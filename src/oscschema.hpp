@@ -0,0 +1,91 @@
+#ifndef ANALYSER_OSCSCHEMA_HPP
+#define ANALYSER_OSCSCHEMA_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <oscpp/schema.hpp>
+#include "analysis.hpp"
+
+// The messages of the analyser's bundles (see analysis.hpp for what each
+// means), declared once for the encoders in analysis.cpp and for anything
+// reading them back, as OSCPP::Schema::Message<address, values, arguments>.
+// A stereo channel's feature messages go under a target's prefix instead.
+
+struct oscMeta_t {
+  int32_t channelId = 0;
+  int32_t degradation = 0;
+};
+
+struct oscSilence_t {
+  float rms = 0;
+  float peak = 0;
+};
+
+namespace oscAddress {
+inline constexpr char meta[] = "/meta";
+inline constexpr char time[] = "/time";
+inline constexpr char freq[] = "/freq";
+inline constexpr char onset[] = "/onset";
+inline constexpr char pitch[] = "/pitch";
+inline constexpr char mfcc[] = "/mfcc";
+inline constexpr char silent[] = "/silent";
+inline constexpr char loudness[] = "/loudness";
+inline constexpr char tempo[] = "/tempo";
+inline constexpr char onsetEvent[] = "/onset/event";
+inline constexpr char spectrum[] = "/spectrum";
+inline constexpr char mel[] = "/mel";
+inline constexpr char fragment[] = "/fragment";
+} // namespace oscAddress
+
+using OSCPP::Schema::Elements;
+using OSCPP::Schema::Member;
+
+using MetaMessage = OSCPP::Schema::Message<oscAddress::meta, oscMeta_t,
+  Member<&oscMeta_t::channelId>, Member<&oscMeta_t::degradation>>;
+
+// Feature messages, one per group, in group order
+using TimeMessage = OSCPP::Schema::Message<oscAddress::time, features_t, Elements<RMS, 3>>;
+using FreqMessage = OSCPP::Schema::Message<oscAddress::freq, features_t, Elements<SPECTRAL_CENTROID, 5>>;
+using OnsetMessage = OSCPP::Schema::Message<oscAddress::onset, features_t, Elements<ENERGY_DIFFERENCE, 5>>;
+using PitchMessage = OSCPP::Schema::Message<oscAddress::pitch, features_t, Elements<PITCH>>;
+using MfccMessage = OSCPP::Schema::Message<oscAddress::mfcc, features_t, Elements<MFCC_0, MFCC_COUNT>>;
+
+using SilentMessage = OSCPP::Schema::Message<oscAddress::silent, oscSilence_t,
+  Member<&oscSilence_t::rms>, Member<&oscSilence_t::peak>>;
+
+using LoudnessMessage = OSCPP::Schema::Message<oscAddress::loudness, loudness_t,
+  Member<&loudness_t::momentary>, Member<&loudness_t::shortTerm>, Member<&loudness_t::integrated>,
+  Member<&loudness_t::truePeak>>;
+
+using TempoMessage = OSCPP::Schema::Message<oscAddress::tempo, tempo_t,
+  Member<&tempo_t::bpm>, Member<&tempo_t::confidence>, Member<&tempo_t::phase>>;
+
+using OnsetEventMessage = OSCPP::Schema::Message<oscAddress::onsetEvent, onsetEvent_t,
+  Member<&onsetEvent_t::strength>, Member<&onsetEvent_t::latency>>;
+
+// /spectrum, /mel and /fragment have a blob or a run of floats sized by the
+// configuration, so spectrum.cpp writes them itself
+
+// A mono channel's fullest bundle
+using FeatureBundle = OSCPP::Schema::Bundle<MetaMessage, TimeMessage, FreqMessage, OnsetMessage, PitchMessage,
+  MfccMessage, LoudnessMessage, TempoMessage, OnsetEventMessage>;
+
+// A stereo channel's fullest: every target's feature messages, each address
+// as long as the longest prefix makes it
+constexpr size_t maxStereoBundleSize() {
+  size_t prefix = 0;
+  for (size_t t = 0; t < STEREO_TARGET_COUNT; t++) {
+    prefix = std::max(prefix, std::char_traits<char>::length(stereoTargetName(t)) + 1);
+  }
+  const size_t features = TimeMessage::size(prefix + TimeMessage::addressLength) +
+                          FreqMessage::size(prefix + FreqMessage::addressLength) +
+                          OnsetMessage::size(prefix + OnsetMessage::addressLength) +
+                          PitchMessage::size(prefix + PitchMessage::addressLength) +
+                          MfccMessage::size(prefix + MfccMessage::addressLength);
+  return OSCPP::Size::bundle(1 + 5 * STEREO_TARGET_COUNT + 3) + MetaMessage::size() +
+         STEREO_TARGET_COUNT * features + LoudnessMessage::size() + TempoMessage::size() +
+         OnsetEventMessage::size();
+}
+
+#endif // ANALYSER_OSCSCHEMA_HPP
@@ -0,0 +1,52 @@
+#include "oscsfile.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+static const char BUNDLE_MARKER[8] = { '#', 'b', 'u', 'n', 'd', 'l', 'e', '\0' };
+static constexpr size_t BUNDLE_HEADER_SIZE = 16; // marker + timetag
+
+static int32_t readBigEndianInt32(const char* p) {
+  uint32_t x;
+  std::memcpy(&x, p, 4);
+  return static_cast<int32_t>(__builtin_bswap32(x));
+}
+
+size_t oscsBundleSize(const char* data, size_t size) {
+  if (size < BUNDLE_HEADER_SIZE || std::memcmp(data, BUNDLE_MARKER, 8) != 0) return 0;
+  size_t pos = BUNDLE_HEADER_SIZE;
+  while (size - pos >= 4) {
+    // the next bundle's marker, or as much of it as has been written (an element's size can't start with '#')
+    if (std::memcmp(data + pos, BUNDLE_MARKER, std::min<size_t>(size - pos, 8)) == 0) break;
+    int32_t elementSize = readBigEndianInt32(data + pos);
+    if (elementSize <= 0 || elementSize % 4 != 0 || pos + 4 + elementSize > size) return 0;
+    pos += 4 + elementSize;
+  }
+  return pos;
+}
+
+size_t forEachOscsBundle(const char* data, size_t size, const std::function<void(const char*, size_t)>& fn) {
+  size_t count = 0;
+  size_t pos = 0;
+  while (pos < size) {
+    size_t bundleSize = oscsBundleSize(data + pos, size - pos);
+    if (bundleSize == 0) {
+      std::cerr << "malformed bundle at offset " << pos << ", stopping" << std::endl;
+      break;
+    }
+    fn(data + pos, bundleSize);
+    pos += bundleSize;
+    count++;
+  }
+  return count;
+}
+
+bool readWholeFile(const std::string& path, std::vector<char>& contents) {
+  std::ifstream in(path, std::ios::binary | std::ios::ate);
+  if (!in) return false;
+  contents.resize(in.tellg());
+  in.seekg(0);
+  return static_cast<bool>(in.read(contents.data(), contents.size()));
+}
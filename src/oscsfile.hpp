@@ -0,0 +1,23 @@
+#ifndef ANALYSER_OSCSFILE_HPP
+#define ANALYSER_OSCSFILE_HPP
+
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <vector>
+
+// An .oscs file is a plain concatenation of the OSC bundles written by the
+// analyser, with no size prefix for the top level bundles. Each bundle is
+// "#bundle\0" + 8 byte timetag followed by size-prefixed elements, so we walk
+// the elements until the next "#bundle" marker (or end of file).
+
+// Returns the size of the bundle starting at data, or 0 if it isn't one.
+size_t oscsBundleSize(const char* data, size_t size);
+
+// Calls fn(bundle, bundleSize) for each bundle; returns the number of bundles.
+// Stops at the first malformed bundle and reports it on stderr.
+size_t forEachOscsBundle(const char* data, size_t size, const std::function<void(const char*, size_t)>& fn);
+
+bool readWholeFile(const std::string& path, std::vector<char>& contents);
+
+#endif // ANALYSER_OSCSFILE_HPP
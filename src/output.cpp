@@ -0,0 +1,18 @@
+#include "output.hpp"
+
+ChannelOutput::ChannelOutput(const std::string& directory, const std::string& filename, const std::string& uploadPrefix,
+                             Uploader* uploader, const chunkConfig_t& chunks, const ArchiveEncodingSpec* archiveEncoding)
+  : oscs(directory, filename, uploadPrefix, uploader, chunks) {
+  if (archiveEncoding) {
+    archive = std::make_unique<ArchiveWriter>(directory + "/" + filename + ".osca", *archiveEncoding);
+  }
+}
+
+void ChannelOutput::write(const char* bundle, size_t size, uint64_t frameSequence) {
+  // TODO: find the last frame number written, write blanks (as special markers) so that
+  // TODO: the file length is consistent throughout,
+  oscs.write(bundle, size, frameSequence);
+  if (archive) {
+    archive->write(bundle, size);
+  }
+}
@@ -0,0 +1,21 @@
+#ifndef ANALYSER_OUTPUT_HPP
+#define ANALYSER_OUTPUT_HPP
+
+#include <memory>
+#include <string>
+#include "archive.hpp"
+#include "chunkedfile.hpp"
+
+// Everything written for one channel in a session: the (possibly chunked)
+// .oscs, plus an .osca archive when archiveEncoding is given.
+class ChannelOutput {
+public:
+  ChannelOutput(const std::string& directory, const std::string& filename, const std::string& uploadPrefix,
+                Uploader* uploader, const chunkConfig_t& chunks, const ArchiveEncodingSpec* archiveEncoding);
+  void write(const char* bundle, size_t size, uint64_t frameSequence);
+private:
+  ChunkedFile oscs;
+  std::unique_ptr<ArchiveWriter> archive;
+};
+
+#endif // ANALYSER_OUTPUT_HPP
@@ -0,0 +1,171 @@
+#include "perfcounters.hpp"
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include "config.hpp"
+
+const bool perfCountersEnabled = envFlag("ANALYSER_PERF_COUNTERS");
+
+namespace {
+
+constexpr size_t MAX_STAGES = 32;
+
+const char* COUNTER_NAMES[PERF_COUNTER_COUNT] = { "cycles", "instructions", "cache-misses", "branch-misses" };
+const uint64_t COUNTER_CONFIGS[PERF_COUNTER_COUNT] = {
+  PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES
+};
+
+// Written only by the owning thread, so without read-modify-writes, and never
+// reset; perfReport reports the difference from what it last reported
+struct stageTotals_t {
+  std::atomic<uint64_t> calls{ 0 };
+  std::atomic<uint64_t> values[PERF_COUNTER_COUNT] = {};
+  uint64_t reportedCalls = 0; // under countersMutex
+  uint64_t reported[PERF_COUNTER_COUNT] = {};
+};
+
+struct threadCounters_t {
+  int leader = -1;
+  int fds[PERF_COUNTER_COUNT] = { -1, -1, -1, -1 };
+  int slot[PERF_COUNTER_COUNT]; // position in the group read, -1 if not open
+  int opened = 0;
+  stageTotals_t stages[MAX_STAGES];
+};
+
+std::mutex countersMutex;
+std::vector<std::unique_ptr<threadCounters_t>> allCounters; // never shrinks
+std::once_flag warnOnce;
+bool anyOpened = false;
+
+int openCounter(uint64_t config, int group) {
+  perf_event_attr attr;
+  std::memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = PERF_TYPE_HARDWARE;
+  attr.config = config;
+  attr.disabled = group == -1; // the leader starts the group once everyone has joined
+  attr.exclude_kernel = 1;     // allowed at perf_event_paranoid 2
+  attr.exclude_hv = 1;
+  attr.read_format = PERF_FORMAT_GROUP;
+  return syscall(SYS_perf_event_open, &attr, 0, -1, group, 0);
+}
+
+threadCounters_t* threadCounters() {
+  thread_local threadCounters_t* counters = nullptr;
+  if (counters != nullptr) return counters;
+
+  auto created = std::make_unique<threadCounters_t>();
+  std::string failed;
+  for (int c = 0; c < PERF_COUNTER_COUNT; c++) {
+    int fd = openCounter(COUNTER_CONFIGS[c], created->leader);
+    created->slot[c] = -1;
+    if (fd == -1) {
+      failed += std::string(failed.empty() ? "" : ", ") + COUNTER_NAMES[c] + " (" + std::strerror(errno) + ")";
+      continue;
+    }
+    if (created->leader == -1) created->leader = fd;
+    created->fds[c] = fd;
+    created->slot[c] = created->opened++;
+  }
+  if (created->leader != -1) {
+    ioctl(created->leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ioctl(created->leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+  }
+  std::call_once(warnOnce, [&]() {
+    if (!failed.empty()) {
+      std::cerr << "perf counters unavailable: " << failed
+                << "; see kernel.perf_event_paranoid, or CAP_PERFMON in containers" << std::endl;
+    }
+  });
+
+  std::lock_guard<std::mutex> lock(countersMutex);
+  anyOpened = anyOpened || created->opened > 0;
+  allCounters.push_back(std::move(created));
+  counters = allCounters.back().get();
+  return counters;
+}
+
+} // namespace
+
+void perfRead(perfSample_t& sample) {
+  threadCounters_t* counters = threadCounters();
+  sample.valid = false;
+  if (counters->opened == 0) return;
+  uint64_t buffer[1 + PERF_COUNTER_COUNT]; // nr, then values in group order
+  if (read(counters->leader, buffer, sizeof(uint64_t) * (1 + counters->opened)) <= 0) return;
+  for (int c = 0; c < PERF_COUNTER_COUNT; c++) {
+    sample.values[c] = counters->slot[c] < 0 ? 0 : buffer[1 + counters->slot[c]];
+  }
+  sample.valid = true;
+}
+
+void perfAccumulate(size_t stage, const perfSample_t& begin, const perfSample_t& end) {
+  if (!begin.valid || !end.valid || stage >= MAX_STAGES) return;
+  stageTotals_t& totals = threadCounters()->stages[stage];
+  totals.calls.store(totals.calls.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+  for (int c = 0; c < PERF_COUNTER_COUNT; c++) {
+    auto& total = totals.values[c];
+    total.store(total.load(std::memory_order_relaxed) + end.values[c] - begin.values[c], std::memory_order_relaxed);
+  }
+}
+
+void perfReport(std::ostream& out, const char* const* stageNames, size_t stageCount) {
+  if (!perfCountersEnabled) return;
+  std::lock_guard<std::mutex> lock(countersMutex);
+  if (!anyOpened) return;
+  bool available[PERF_COUNTER_COUNT] = {};
+  for (auto& counters : allCounters) {
+    for (int c = 0; c < PERF_COUNTER_COUNT; c++) available[c] = available[c] || counters->slot[c] >= 0;
+  }
+  out << "analyser: perf counters per call (user space)" << std::endl;
+  out << "  " << std::left << std::setw(14) << "stage" << std::right << std::setw(10) << "calls"
+      << std::setw(12) << "cycles" << std::setw(14) << "instructions" << std::setw(7) << "IPC"
+      << std::setw(16) << "cache miss/call" << std::setw(18) << "branch miss/kinst" << std::endl;
+  for (size_t s = 0; s < stageCount && s < MAX_STAGES; s++) {
+    uint64_t calls = 0, values[PERF_COUNTER_COUNT] = {};
+    for (auto& counters : allCounters) {
+      stageTotals_t& totals = counters->stages[s];
+      const uint64_t totalCalls = totals.calls.load(std::memory_order_relaxed);
+      calls += totalCalls - totals.reportedCalls;
+      totals.reportedCalls = totalCalls;
+      for (int c = 0; c < PERF_COUNTER_COUNT; c++) {
+        const uint64_t total = totals.values[c].load(std::memory_order_relaxed);
+        values[c] += total - totals.reported[c];
+        totals.reported[c] = total;
+      }
+    }
+    if (calls == 0) continue;
+    auto perCall = [&](int c) -> std::string {
+      if (!available[c]) return "n/a";
+      std::ostringstream value;
+      value << std::fixed << std::setprecision(0) << static_cast<double>(values[c]) / calls;
+      return value.str();
+    };
+    std::ostringstream ipc, branchMisses;
+    if (available[CYCLES] && available[INSTRUCTIONS] && values[CYCLES] > 0) {
+      ipc << std::fixed << std::setprecision(2) << static_cast<double>(values[INSTRUCTIONS]) / values[CYCLES];
+    } else {
+      ipc << "n/a";
+    }
+    if (available[BRANCH_MISSES] && available[INSTRUCTIONS] && values[INSTRUCTIONS] > 0) {
+      // per thousand instructions rather than per branch, as the branch count would need a fifth counter
+      branchMisses << std::fixed << std::setprecision(2) << 1000.0 * values[BRANCH_MISSES] / values[INSTRUCTIONS];
+    } else {
+      branchMisses << "n/a";
+    }
+    out << "  " << std::left << std::setw(14) << stageNames[s] << std::right << std::setw(10) << calls
+        << std::setw(12) << perCall(CYCLES) << std::setw(14) << perCall(INSTRUCTIONS) << std::setw(7) << ipc.str()
+        << std::setw(16) << perCall(CACHE_MISSES) << std::setw(18) << branchMisses.str() << std::endl;
+  }
+}
@@ -0,0 +1,31 @@
+#ifndef ANALYSER_PERFCOUNTERS_HPP
+#define ANALYSER_PERFCOUNTERS_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+
+// Hardware counters per pipeline stage, with ANALYSER_PERF_COUNTERS=1: each
+// thread opens one perf_event_open group (cycles, instructions, cache
+// misses, branch misses, user space only) and TraceScope reads it at stage
+// boundaries. Where perf isn't allowed (containers, perf_event_paranoid > 2)
+// or an event doesn't exist (some VMs), that's reported once and the
+// counters it affects read as unavailable; the pipeline carries on.
+
+enum PerfCounter { CYCLES = 0, INSTRUCTIONS, CACHE_MISSES, BRANCH_MISSES, PERF_COUNTER_COUNT };
+
+extern const bool perfCountersEnabled;
+
+struct perfSample_t {
+  uint64_t values[PERF_COUNTER_COUNT];
+  bool valid;
+};
+
+void perfRead(perfSample_t& sample);
+// Add end - begin to this thread's totals for stage
+void perfAccumulate(size_t stage, const perfSample_t& begin, const perfSample_t& end);
+
+// Totals over all threads since the last report, one line per stage
+void perfReport(std::ostream& out, const char* const* stageNames, size_t stageCount);
+
+#endif // ANALYSER_PERFCOUNTERS_HPP
@@ -0,0 +1,220 @@
+#include "producer.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <thread>
+#include <vector>
+#include "analysis.hpp"
+#include "queues.hpp"
+#include "wavfile.hpp"
+
+namespace fs = std::filesystem;
+
+namespace {
+
+class SampleSource {
+public:
+  virtual ~SampleSource() = default;
+  virtual void fill(int16_t* frame, size_t size) = 0;
+};
+
+class ToneSource : public SampleSource {
+public:
+  explicit ToneSource(double frequency) : increment(2.0 * M_PI * frequency / SAMPLE_RATE) {}
+  void fill(int16_t* frame, size_t size) override {
+    for (size_t i = 0; i < size; i++) {
+      frame[i] = static_cast<int16_t>(8000.0 * std::sin(phase));
+      phase += increment;
+    }
+    phase = std::fmod(phase, 2.0 * M_PI);
+  }
+private:
+  double increment;
+  double phase = 0.0;
+};
+
+class NoiseSource : public SampleSource {
+public:
+  explicit NoiseSource(uint32_t seed) : state(seed | 1) {}
+  void fill(int16_t* frame, size_t size) override {
+    for (size_t i = 0; i < size; i++) {
+      state ^= state << 13; // xorshift32
+      state ^= state >> 17;
+      state ^= state << 5;
+      frame[i] = static_cast<int16_t>(state >> 20) - 2048;
+    }
+  }
+private:
+  uint32_t state;
+};
+
+// Loops a recording, mixed down to mono
+class WavSource : public SampleSource {
+public:
+  explicit WavSource(std::shared_ptr<MappedWav> wav) : wav(std::move(wav)) {}
+  void fill(int16_t* frame, size_t size) override {
+    const int channels = wav->channels();
+    for (size_t i = 0; i < size; i++) {
+      if (position >= wav->frames()) position = 0;
+      size_t count = 1;
+      const int16_t* s = wav->frameView(position++, count);
+      int sum = 0;
+      for (int c = 0; c < channels; c++) sum += s[c];
+      frame[i] = static_cast<int16_t>(sum / channels);
+    }
+  }
+private:
+  std::shared_ptr<MappedWav> wav;
+  size_t position = 0;
+};
+
+std::vector<std::unique_ptr<SampleSource>> makeSources(const producerConfig_t& config) {
+  std::vector<std::unique_ptr<SampleSource>> sources;
+  std::vector<std::shared_ptr<MappedWav>> wavs;
+  if (config.source != "tone" && config.source != "noise") {
+    std::vector<fs::path> paths;
+    std::error_code error;
+    if (fs::is_directory(config.source, error)) {
+      for (const auto& entry : fs::recursive_directory_iterator(config.source, error)) {
+        if (entry.is_regular_file() && entry.path().extension() == ".wav") paths.push_back(entry.path());
+      }
+      std::sort(paths.begin(), paths.end());
+    } else {
+      paths.push_back(config.source);
+    }
+    for (const auto& path : paths) {
+      auto wav = std::make_shared<MappedWav>();
+      if (wav->open(path.string()) && wav->frames() > 0) wavs.push_back(wav);
+    }
+    if (wavs.empty()) {
+      std::cerr << "no usable recordings in '" << config.source << "', using tones" << std::endl;
+    }
+  }
+  for (size_t c = 0; c < config.channels; c++) {
+    if (!wavs.empty()) {
+      sources.push_back(std::make_unique<WavSource>(wavs[c % wavs.size()]));
+    } else if (config.source == "noise") {
+      sources.push_back(std::make_unique<NoiseSource>(static_cast<uint32_t>(c * 2654435761u)));
+    } else {
+      sources.push_back(std::make_unique<ToneSource>(110.0 * (c + 1)));
+    }
+  }
+  return sources;
+}
+
+// Session markers mustn't be lost, so keep trying for a while
+bool sendReliably(const void* message, size_t size) {
+  for (int attempt = 0; attempt < 5000; attempt++) {
+    if (mq_send(producer_mqd, static_cast<const char*>(message), size, 0) == 0) return true;
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  return false;
+}
+
+} // namespace
+
+bool runProducer(const producerConfig_t& config, producerStats_t& stats,
+                 const producerHook_t& onSend, const std::atomic<bool>* stop) {
+  auto sources = makeSources(config);
+  std::string sessionName = config.sessionName.empty()
+    ? "Synth-" + std::to_string(std::chrono::duration_cast<std::chrono::seconds>(
+                                  std::chrono::system_clock::now().time_since_epoch()).count())
+    : config.sessionName;
+
+  startSessionMeta_t start = {};
+  start.metaType = static_cast<int8_t>(META_TYPE::startSession);
+  std::strncpy(start.sessionDir, sessionName.c_str(), MAX_OSC_FILEPATH_LENGTH);
+  if (!sendReliably(&start, sizeof(start))) {
+    std::cerr << "can't send startSession" << std::endl;
+    return false;
+  }
+
+  std::vector<audioMeta_t> metas(config.channels);
+  for (size_t c = 0; c < config.channels; c++) {
+    metas[c] = {};
+    metas[c].metaType = static_cast<int8_t>(c < config.stereoChannels ? META_TYPE::stereoAudioFrame
+                                                                      : META_TYPE::audioFrame);
+    metas[c].channelId = static_cast<int16_t>(c);
+    std::snprintf(metas[c].filename, sizeof(metas[c].filename), "synth%zu-127_0_0_1_%zu-0-1.wav", c, 22000 + c);
+  }
+
+  const size_t frameSize = std::clamp<size_t>(config.frameSize, MIN_FRAME_SAMPLES,
+                                             config.stereoChannels > 0 ? MAX_FRAME_SAMPLES / 2 : MAX_FRAME_SAMPLES);
+  const double framePeriod = static_cast<double>(frameSize) / SAMPLE_RATE;
+  const uint64_t totalFrames = config.seconds > 0 ? static_cast<uint64_t>(config.seconds / framePeriod) : UINT64_MAX;
+  std::vector<int16_t> frameBuffer(2 * frameSize); // room for stereo
+  int16_t* frame = frameBuffer.data();
+  auto startTime = std::chrono::steady_clock::now();
+  auto due = [&](uint64_t f, size_t c) {
+    double offset = f * framePeriod + (config.burst ? 0.0 : c * framePeriod / config.channels);
+    return startTime + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(offset));
+  };
+
+  auto send = [&](const audioMeta_t& meta, const int16_t* samples) {
+    const size_t frameBytes = frameSize * sizeof(int16_t) *
+      (meta.metaType == static_cast<int8_t>(META_TYPE::stereoAudioFrame) ? 2 : 1);
+    if (!config.realtime) {
+      // unthrottled, so wait for the analyser rather than drop
+      sendReliably(&meta, sizeof(audioMeta_t));
+      sendReliably(samples, frameBytes);
+    } else if (mq_send(producer_mqd, reinterpret_cast<const char*>(&meta), sizeof(audioMeta_t), 0) == -1) {
+      stats.framesDropped++;
+      return;
+    } else if (!sendReliably(samples, frameBytes)) { // keep the pair together once the meta is in
+      stats.framesDropped++;
+      return;
+    }
+    stats.framesSent++;
+  };
+  std::mt19937 random(42);
+  std::uniform_real_distribution<double> chance(0.0, 1.0);
+  std::vector<std::vector<int16_t>> heldFrames(config.channels, std::vector<int16_t>(2 * frameSize));
+  std::vector<audioMeta_t> heldMetas(config.channels);
+  std::vector<bool> holding(config.channels, false);
+
+  for (uint64_t f = 0; f < totalFrames && !(stop && *stop); f++) {
+    for (size_t c = 0; c < config.channels; c++) {
+      if (config.realtime && (c == 0 || !config.burst)) {
+        auto when = due(f, c);
+        if (when - std::chrono::steady_clock::now() > std::chrono::microseconds(50)) std::this_thread::sleep_until(when);
+      }
+      sources[c]->fill(frame, frameSize);
+      if (c < config.stereoChannels) {
+        // interleave in place from the end, with the right at half level so side isn't silent
+        for (size_t i = frameSize; i-- > 0; ) {
+          frame[2 * i + 1] = frame[i] / 2;
+          frame[2 * i] = frame[i];
+        }
+      }
+      metas[c].frameSequence = f;
+      metas[c].offsetSeconds = f * framePeriod;
+      if (onSend) onSend(metas[c].channelId, f);
+      if (config.loss > 0 && chance(random) < config.loss) continue;
+      if (holding[c]) {
+        send(metas[c], frame);
+        send(heldMetas[c], heldFrames[c].data());
+        holding[c] = false;
+      } else if (config.reorder > 0 && chance(random) < config.reorder) {
+        std::copy_n(frame, 2 * frameSize, heldFrames[c].begin());
+        heldMetas[c] = metas[c];
+        holding[c] = true;
+        continue;
+      } else {
+        send(metas[c], frame);
+      }
+      if (config.duplicate > 0 && chance(random) < config.duplicate) send(metas[c], frame);
+    }
+  }
+
+  endSessionMeta_t end = { static_cast<int8_t>(META_TYPE::endSession) };
+  if (!sendReliably(&end, sizeof(end))) {
+    std::cerr << "can't send endSession" << std::endl;
+    return false;
+  }
+  return true;
+}
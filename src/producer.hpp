@@ -0,0 +1,41 @@
+#ifndef ANALYSER_PRODUCER_HPP
+#define ANALYSER_PRODUCER_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <string>
+
+// Stands in for Jamulus on /samples: startSession, then an audioMeta_t +
+// frameSize int16 frame pair per channel per frame period, then endSession.
+// Stereo channels send stereoAudioFrame metas and frameSize interleaved pairs.
+struct producerConfig_t {
+  size_t channels = 4;
+  double seconds = 60;          // 0 to run until stopped
+  bool realtime = true;         // pace at SAMPLE_RATE, otherwise as fast as the queue takes them
+  bool burst = true;            // send all channels at once per frame like Jamulus, or spread them over the period
+  std::string source = "tone";  // tone, noise, or a .wav file / directory of them
+  size_t frameSize = 128;       // samples, as the Jamulus server's buffer setting
+  size_t stereoChannels = 0;    // of the channels, how many send interleaved stereo, panned left
+  std::string sessionName;      // defaults to Synth-<unix time>
+  // network impairment, as probabilities per frame, to exercise the jitter buffer
+  double loss = 0;              // never sent
+  double reorder = 0;           // sent after the channel's next frame
+  double duplicate = 0;         // sent twice
+};
+
+struct producerStats_t {
+  std::atomic<uint64_t> framesSent{0};
+  std::atomic<uint64_t> framesDropped{0}; // /samples was full, as Jamulus would see it
+};
+
+// Called just before each frame is sent, e.g. to timestamp it (after would
+// race with the analyser's response)
+using producerHook_t = std::function<void(int16_t channelId, uint64_t frameSequence)>;
+
+// Runs one session; returns false if the session markers couldn't be sent.
+// Expects openMessageQueueForProducer() to have been called.
+bool runProducer(const producerConfig_t& config, producerStats_t& stats,
+                 const producerHook_t& onSend = producerHook_t(), const std::atomic<bool>* stop = nullptr);
+
+#endif // ANALYSER_PRODUCER_HPP
@@ -0,0 +1,71 @@
+#include "queues.hpp"
+#include <fcntl.h>              /* For definition of O_NONBLOCK */
+#include <sys/stat.h>
+#include <cstdlib>
+#include <iostream>
+
+// The same code in jamulus, so whoever gets there first will create the queue
+mqd_t read_mqd;
+struct mq_attr read_attr;
+const char* SAMPLES_QUEUE_NAME = "/samples"; // from Jamulus
+void openMessageQueueForRead() {
+  mode_t perms = S_IRUSR | S_IWUSR;
+  read_attr.mq_maxmsg = 10;
+  read_attr.mq_msgsize = MAX_MQ_MESSAGE_SIZE;
+  read_mqd = mq_open(SAMPLES_QUEUE_NAME, O_RDONLY | O_CREAT, perms, &read_attr); // will block
+  if (read_mqd == (mqd_t)-1) {
+    std::cerr << "Can't open mq '" << SAMPLES_QUEUE_NAME << "' for read" << std::endl;
+    exit(1);
+  }
+  std::cout << "Opened mq for read" << std::endl;
+  // Validate queue attributes
+  if (mq_getattr(read_mqd, &read_attr) == -1) {
+    std::cerr << "Can't fetch attributes for mq '" << SAMPLES_QUEUE_NAME << "'" << std::endl;
+    return;
+  }
+  if (read_attr.mq_msgsize > MAX_MQ_MESSAGE_SIZE) {
+    std::cerr << "mq_msgsize " << read_attr.mq_msgsize << " > MAX_MQ_MESSAGE_SIZE " << MAX_MQ_MESSAGE_SIZE << std::endl;
+    return;
+  }
+}
+
+// Same attributes as Jamulus uses, but writing to the queue. Non-blocking,
+// so a slow analyser shows up as dropped sends the way it would in Jamulus.
+mqd_t producer_mqd;
+void openMessageQueueForProducer() {
+  mode_t perms = S_IRUSR | S_IWUSR;
+  struct mq_attr attr;
+  attr.mq_maxmsg = 10;
+  attr.mq_msgsize = MAX_MQ_MESSAGE_SIZE;
+  producer_mqd = mq_open(SAMPLES_QUEUE_NAME, O_WRONLY | O_CREAT | O_NONBLOCK, perms, &attr);
+  if (producer_mqd == (mqd_t)-1) {
+    std::cerr << "Can't open mq '" << SAMPLES_QUEUE_NAME << "' for write" << std::endl;
+    exit(1);
+  }
+  std::cout << "Opened mq for producer" << std::endl;
+}
+
+// The same code in oscserver, so whoever gets there first will create the queue
+mqd_t write_mqd;
+struct mq_attr write_attr;
+const char* OSC_QUEUE_NAME = "/osc";
+void openMessageQueueForWrite() {
+  mode_t perms = S_IRUSR | S_IWUSR;
+  write_attr.mq_maxmsg = 10;
+  write_attr.mq_msgsize = MAX_MQ_MESSAGE_SIZE;
+  write_mqd = mq_open(OSC_QUEUE_NAME, O_WRONLY | O_CREAT | O_NONBLOCK, perms, &write_attr);
+  if (write_mqd == (mqd_t)-1) {
+    std::cerr << "Can't open mq '" << OSC_QUEUE_NAME << "' for write" << std::endl;
+    exit(1);
+  }
+  std::cout << "Opened mq for write" << std::endl;
+  // Validate queue attributes
+  if (mq_getattr(write_mqd, &write_attr) == -1) {
+    std::cerr << "Can't fetch attributes for mq '" << OSC_QUEUE_NAME << "'" << std::endl;
+    return;
+  }
+  if (write_attr.mq_msgsize > MAX_MQ_MESSAGE_SIZE) {
+    std::cerr << "mq_msgsize " << write_attr.mq_msgsize << " > MAX_MQ_MESSAGE_SIZE " << MAX_MQ_MESSAGE_SIZE << std::endl;
+    return;
+  }
+}
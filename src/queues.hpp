@@ -0,0 +1,35 @@
+#ifndef ANALYSER_QUEUES_HPP
+#define ANALYSER_QUEUES_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <mqueue.h>
+#include <sys/types.h>
+
+constexpr ssize_t MAX_MQ_MESSAGE_SIZE = 2048; // must be at least mq_msgsize
+
+// Copy this from Jamulus jamrecorder.cpp
+static constexpr size_t MAX_OSC_FILEPATH_LENGTH = 64;
+enum class META_TYPE { startSession=0, endSession, audioFrame, stereoAudioFrame }; // stereo: interleaved L/R
+struct startSessionMeta_t { int8_t metaType; char sessionDir[MAX_OSC_FILEPATH_LENGTH+1]; };
+struct endSessionMeta_t  { int8_t metaType; };
+struct audioMeta_t { int8_t metaType; int16_t channelId; uint64_t frameSequence; double offsetSeconds; char filename[MAX_OSC_FILEPATH_LENGTH+1]; };
+// Jam-20240326-145726119/____-86_175_246_x_22141-0-1.wav
+
+// The same code in jamulus, so whoever gets there first will create the queue
+extern mqd_t read_mqd;
+extern struct mq_attr read_attr;
+extern const char* SAMPLES_QUEUE_NAME; // from Jamulus
+void openMessageQueueForRead();
+
+// The Jamulus end of /samples, for synthetic load
+extern mqd_t producer_mqd;
+void openMessageQueueForProducer();
+
+// The same code in oscserver, so whoever gets there first will create the queue
+extern mqd_t write_mqd;
+extern struct mq_attr write_attr;
+extern const char* OSC_QUEUE_NAME;
+void openMessageQueueForWrite();
+
+#endif // ANALYSER_QUEUES_HPP
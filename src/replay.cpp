@@ -0,0 +1,104 @@
+#include "replay.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <filesystem>
+#include <iostream>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <oscpp/server.hpp>
+#include "analysis.hpp"
+#include "oscsfile.hpp"
+#include "queues.hpp"
+
+namespace fs = std::filesystem;
+
+namespace {
+
+struct replayBundle_t {
+  uint64_t time;
+  const char* data;
+  size_t size;
+};
+
+void reportRate(const char* label, size_t sent, size_t dropped, double seconds) {
+  std::cout << "analyser: replay " << label << " " << sent << " sent, " << dropped << " dropped, "
+            << (seconds > 0 ? sent / seconds : 0) << " packets/s" << std::endl;
+}
+
+} // namespace
+
+bool runReplay(const replayConfig_t& config) {
+  std::vector<fs::path> paths;
+  std::error_code error;
+  for (const auto& entry : fs::recursive_directory_iterator(config.sessionDirectory, error)) {
+    if (entry.is_regular_file() && entry.path().extension() == ".oscs") paths.push_back(entry.path());
+  }
+  std::sort(paths.begin(), paths.end()); // keeps chunks of a channel in order
+  if (paths.empty()) {
+    std::cerr << "no .oscs files in '" << config.sessionDirectory << "'" << std::endl;
+    return false;
+  }
+
+  std::vector<std::vector<char>> files(paths.size());
+  std::vector<replayBundle_t> bundles;
+  for (size_t f = 0; f < paths.size(); f++) {
+    if (!readWholeFile(paths[f].string(), files[f])) {
+      std::cerr << "can't read '" << paths[f].string() << "'" << std::endl;
+      continue;
+    }
+    forEachOscsBundle(files[f].data(), files[f].size(), [&](const char* data, size_t size) {
+      OSCPP::Server::Bundle bundle(OSCPP::Server::Packet(data, size));
+      bundles.push_back({ bundle.time(), data, size });
+    });
+  }
+  // stable, so bundles with equal timetags keep file (channel) order
+  std::stable_sort(bundles.begin(), bundles.end(),
+                   [](const replayBundle_t& a, const replayBundle_t& b) { return a.time < b.time; });
+  if (bundles.empty()) return false;
+
+  const double secondsPerFrame = SAMPLES_PER_FRAME / SAMPLE_RATE;
+  const double sessionSeconds = (bundles.back().time - bundles.front().time) * secondsPerFrame;
+  std::cout << "analyser: replaying " << bundles.size() << " bundles from " << paths.size() << " files, "
+            << sessionSeconds << "s at " << (config.speed > 0 ? std::to_string(config.speed) + "x" : "full speed") << std::endl;
+
+  openMessageQueueForWrite();
+  if (config.speed <= 0) {
+    write_attr.mq_flags = 0; // block on a full queue rather than drop
+    mq_setattr(write_mqd, &write_attr, NULL);
+  }
+
+  size_t sent = 0, dropped = 0;
+  size_t intervalSent = 0, intervalDropped = 0;
+  auto start = std::chrono::steady_clock::now();
+  auto intervalStart = start;
+  do {
+    auto passStart = std::chrono::steady_clock::now();
+    for (const auto& bundle : bundles) {
+      if (config.speed > 0) {
+        double offset = (bundle.time - bundles.front().time) * secondsPerFrame / config.speed;
+        std::this_thread::sleep_until(passStart + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                                                    std::chrono::duration<double>(offset)));
+      }
+      if (mq_send(write_mqd, bundle.data, bundle.size, 0) == -1) {
+        intervalDropped++;
+      } else {
+        intervalSent++;
+      }
+
+      auto now = std::chrono::steady_clock::now();
+      if (now - intervalStart >= std::chrono::seconds(1)) {
+        reportRate("interval", intervalSent, intervalDropped, std::chrono::duration<double>(now - intervalStart).count());
+        sent += intervalSent;
+        dropped += intervalDropped;
+        intervalSent = intervalDropped = 0;
+        intervalStart = now;
+      }
+    }
+  } while (config.loop);
+  sent += intervalSent;
+  dropped += intervalDropped;
+  reportRate("total", sent, dropped, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+  return true;
+}
@@ -0,0 +1,20 @@
+#ifndef ANALYSER_REPLAY_HPP
+#define ANALYSER_REPLAY_HPP
+
+#include <string>
+
+struct replayConfig_t {
+  std::string sessionDirectory; // .oscs files (or chunks) of one session
+  double speed = 1.0;           // 1 for real time, N for N times faster, 0 for as fast as possible
+  bool loop = false;            // start again at the end, for soak tests
+};
+
+// Merge a session's .oscs files by bundle timetag (frameSequence) and send
+// the bundles to /osc paced like the original session. Reports sustained
+// packets per second every second and at the end.
+//
+// Paced replay sends non-blocking and counts drops, like live mode. As fast
+// as possible blocks on a full queue, so the rate measures the consumer.
+bool runReplay(const replayConfig_t& config);
+
+#endif // ANALYSER_REPLAY_HPP
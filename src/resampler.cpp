@@ -0,0 +1,109 @@
+#include "resampler.hpp"
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+namespace {
+
+struct preset_t {
+  double zeroCrossings; // each side of the sinc's peak
+  double beta;          // Kaiser window: about 60, 80 and 100dB stopband
+  double rolloff;       // passband edge, as a fraction of the lower Nyquist
+};
+
+preset_t preset(ResamplerQuality quality) {
+  switch (quality) {
+    case ResamplerQuality::fast: return { 4, 5.0, 0.85 };
+    case ResamplerQuality::best: return { 16, 9.5, 0.95 };
+    default: return { 8, 7.0, 0.9 };
+  }
+}
+
+double besselI0(double x) {
+  double sum = 1, term = 1;
+  for (int k = 1; k < 100 && term > sum * 1e-12; k++) {
+    term *= (x / (2 * k)) * (x / (2 * k));
+    sum += term;
+  }
+  return sum;
+}
+
+// Four lanes wide, with unaligned loads: SSE on x86-64, NEON on arm64
+typedef float floatx4 __attribute__((vector_size(16), aligned(4)));
+
+inline float dot(const float* a, const float* b, size_t n) {
+  floatx4 sum0 = { 0, 0, 0, 0 }, sum1 = { 0, 0, 0, 0 };
+  for (size_t i = 0; i < n; i += 8) {
+    sum0 += *reinterpret_cast<const floatx4*>(a + i) * *reinterpret_cast<const floatx4*>(b + i);
+    sum1 += *reinterpret_cast<const floatx4*>(a + i + 4) * *reinterpret_cast<const floatx4*>(b + i + 4);
+  }
+  sum0 += sum1;
+  return (sum0[0] + sum0[2]) + (sum0[1] + sum0[3]);
+}
+
+} // namespace
+
+ResamplerQuality resamplerQualityFromName(const std::string& name, ResamplerQuality fallback) {
+  if (name == "fast") return ResamplerQuality::fast;
+  if (name == "medium") return ResamplerQuality::medium;
+  if (name == "best") return ResamplerQuality::best;
+  return fallback;
+}
+
+Resampler::Resampler(int inputRate, int outputRate, ResamplerQuality quality) : in(inputRate), out(outputRate) {
+  const int divisor = std::gcd(inputRate, outputRate);
+  up = outputRate / divisor;
+  down = inputRate / divisor;
+  phase = up; // nothing until the first input
+
+  // The prototype runs at up * inputRate, cutting off below the lower Nyquist
+  const preset_t p = preset(quality);
+  const double spacing = std::max(up, down) / p.rolloff; // prototype samples between zero crossings
+  taps = static_cast<size_t>(std::ceil(2 * p.zeroCrossings * spacing / up));
+  taps = (taps + 7) / 8 * 8;
+  const size_t length = taps * up;
+  const double centre = (length - 1) / 2.0;
+  std::vector<double> prototype(length);
+  for (size_t i = 0; i < length; i++) {
+    double t = (i - centre) / spacing;
+    double sinc = t == 0 ? 1.0 : std::sin(M_PI * t) / (M_PI * t);
+    double x = (i - centre) / (centre + 1);
+    prototype[i] = sinc * besselI0(p.beta * std::sqrt(1 - x * x)) / besselI0(p.beta);
+  }
+
+  // Split into phases, reversed to match the history, each with unity gain at DC
+  coefficients.resize(length);
+  for (int ph = 0; ph < up; ph++) {
+    double sum = 0;
+    for (size_t t = 0; t < taps; t++) sum += prototype[(taps - 1 - t) * up + ph];
+    for (size_t t = 0; t < taps; t++) {
+      coefficients[ph * taps + t] = static_cast<float>(prototype[(taps - 1 - t) * up + ph] / sum);
+    }
+  }
+  history.assign(2 * taps, 0.0f);
+}
+
+size_t Resampler::process(const float* input, size_t inputCount, float* output, size_t outputCapacity,
+                          size_t& inputUsed) {
+  size_t produced = 0;
+  inputUsed = 0;
+  while (true) {
+    // every output between the newest input and the next one
+    while (phase < up) {
+      if (produced == outputCapacity) return produced;
+      output[produced++] = dot(history.data() + position, coefficients.data() + phase * taps, taps);
+      phase += down;
+    }
+    if (inputUsed == inputCount) return produced;
+    history[position] = history[position + taps] = input[inputUsed++];
+    position = position + 1 == taps ? 0 : position + 1;
+    phase -= up;
+  }
+}
+
+std::unique_ptr<Resampler> makeResampler(int inputRate, int outputRate, ResamplerQuality quality) {
+  if (inputRate <= 0 || outputRate <= 0) return nullptr;
+  const int divisor = std::gcd(inputRate, outputRate);
+  if (std::max(inputRate, outputRate) / divisor > MAX_RESAMPLER_PHASES) return nullptr;
+  return std::make_unique<Resampler>(inputRate, outputRate, quality);
+}
@@ -0,0 +1,44 @@
+#ifndef ANALYSER_RESAMPLER_HPP
+#define ANALYSER_RESAMPLER_HPP
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Streaming rational polyphase resampler: a Kaiser windowed sinc split into
+// one short filter per output phase, so each output sample is a single dot
+// product over the latest input. Keeps its history between calls, so use one
+// per channel and stream.
+
+constexpr int MAX_RESAMPLER_PHASES = 1024; // 44.1kHz to 48kHz needs 160
+
+// Filter length and stopband traded against speed
+enum class ResamplerQuality { fast, medium, best };
+// fast, medium or best; returns fallback for anything else
+ResamplerQuality resamplerQualityFromName(const std::string& name, ResamplerQuality fallback);
+
+class Resampler {
+public:
+  Resampler(int inputRate, int outputRate, ResamplerQuality quality);
+  // Resample as much of input as fits in output, returning the samples
+  // written and setting inputUsed to how many were taken. Call again with
+  // the rest, as an upsampler can have output pending with no input left.
+  size_t process(const float* input, size_t inputCount, float* output, size_t outputCapacity, size_t& inputUsed);
+  int inputRate() const { return in; }
+  int outputRate() const { return out; }
+  size_t tapsPerPhase() const { return taps; }
+private:
+  int in, out;
+  int up, down; // the ratio in lowest terms
+  size_t taps;  // a multiple of 8, for dot()
+  std::vector<float> coefficients; // taps per phase, oldest input first
+  std::vector<float> history;      // the last taps inputs, twice over so they're always contiguous
+  size_t position = 0;
+  int phase;                       // of the next output past the newest input, in 1/up inputs
+};
+
+// nullptr when the rates are unusable, or too far from a simple ratio
+std::unique_ptr<Resampler> makeResampler(int inputRate, int outputRate, ResamplerQuality quality);
+
+#endif // ANALYSER_RESAMPLER_HPP
@@ -0,0 +1,443 @@
+#include "spectrum.hpp"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <oscpp/client.hpp>
+#include "config.hpp"
+#include "oscschema.hpp"
+#include "oscsfile.hpp"
+
+namespace {
+
+const size_t MIN_MTU = 256;
+const size_t MAX_BANDS = 1024;
+const uint32_t MAX_FRAGMENTS = 1024;
+const size_t MAX_MESSAGE_SIZE = 1 << 20;
+
+// bits, scale, lowHz, highHz, floorDb, ceilingDb
+const size_t HEADER_ARGS = 6;
+
+// A fragment's bundle without its bytes: /meta, then /fragment sequence index count offset and the blob's size
+const size_t FRAGMENT_OVERHEAD = OSCPP::Size::bundle(2) + MetaMessage::size() +
+                                 OSCPP::Size::string(std::char_traits<char>::length(oscAddress::fragment)) +
+                                 OSCPP::align(5 + 2) + OSCPP::Size::int32(4) + OSCPP::Size::int32();
+
+float hzToMel(float hz) {
+  return 2595 * std::log10(1 + hz / 700);
+}
+
+float melToHz(float mel) {
+  return 700 * (std::pow(10.0f, mel / 2595) - 1);
+}
+
+// Bands from their edges: rectangular between each pair, or triangular
+// over each three with the peak in the middle. A band too narrow to cover
+// a bin's centre takes the nearest bin.
+template <typename Band>
+std::vector<Band> makeBands(const std::vector<float>& edges, bool triangular, float binHz, size_t bins) {
+  const size_t count = edges.size() - (triangular ? 2 : 1);
+  std::vector<Band> bands(count);
+  for (size_t b = 0; b < count; b++) {
+    const float low = edges[b], high = edges[b + (triangular ? 2 : 1)];
+    const float centre = triangular ? edges[b + 1] : std::sqrt(low * high);
+    const size_t first = std::min<size_t>(std::ceil(low / binHz), bins - 1);
+    const size_t last = std::min<size_t>(std::max<float>(std::ceil(high / binHz), 1) - 1, bins - 1);
+    std::vector<float> weights;
+    float sum = 0;
+    for (size_t k = first; k <= last; k++) {
+      const float hz = k * binHz;
+      float weight = 1;
+      if (triangular) weight = hz < centre ? (hz - low) / (centre - low) : (high - hz) / (high - centre);
+      weights.push_back(std::max(weight, 0.0f));
+      sum += weights.back();
+    }
+    if (sum > 0) {
+      for (float& weight : weights) weight /= sum;
+      bands[b] = { first, weights };
+    } else {
+      bands[b] = { std::min<size_t>(std::lround(centre / binHz), bins - 1), { 1.0f } };
+    }
+  }
+  return bands;
+}
+
+} // namespace
+
+spectrumConfig_t spectrumConfigFromEnv(size_t maxPacketSize) {
+  spectrumConfig_t config;
+  std::istringstream names(envString("ANALYSER_SPECTRUM", ""));
+  std::string name;
+  while (std::getline(names, name, ',')) {
+    if (name == "spectrum") {
+      config.streams |= SPECTRUM_STREAM;
+    } else if (name == "mel") {
+      config.streams |= MEL_STREAM;
+    } else {
+      std::cerr << "ignoring unknown spectrum stream '" << name << "'" << std::endl;
+    }
+  }
+  config.bands = std::clamp<long>(envLong("ANALYSER_SPECTRUM_BANDS", config.bands), 0, MAX_BANDS);
+  config.melBands = std::clamp<long>(envLong("ANALYSER_MEL_BANDS", config.melBands), 1, MAX_BANDS);
+  config.lowHz = std::max(1.0, envDouble("ANALYSER_SPECTRUM_LOW_HZ", config.lowHz));
+  config.highHz = envDouble("ANALYSER_SPECTRUM_HIGH_HZ", config.highHz);
+  config.bits = envLong("ANALYSER_SPECTRUM_BITS", config.bits);
+  if (config.bits != 8 && config.bits != 16 && config.bits != 32) {
+    std::cerr << "ANALYSER_SPECTRUM_BITS must be 8, 16 or 32, using 16" << std::endl;
+    config.bits = 16;
+  }
+  config.floorDb = envDouble("ANALYSER_SPECTRUM_FLOOR_DB", config.floorDb);
+  config.ceilingDb = std::max<double>(config.floorDb + 1, envDouble("ANALYSER_SPECTRUM_CEILING_DB", config.ceilingDb));
+  // whole int32s, so each packet in SpectrumStreamer stays aligned
+  const long mtu = envLong("ANALYSER_SPECTRUM_MTU", maxPacketSize);
+  config.mtu = std::clamp<long>(mtu, MIN_MTU, maxPacketSize) / 4 * 4;
+  return config;
+}
+
+SpectrumStreamer::SpectrumStreamer(const spectrumConfig_t& config, int sampleRate, size_t windowSize)
+  : config(config), windowSize(windowSize), bins(windowSize / 2 + 1) {
+  const size_t half = windowSize / 2;
+  fft = kiss_fft_alloc(half, 0, nullptr, nullptr);
+  window.resize(windowSize);
+  for (size_t i = 0; i < windowSize; i++) window[i] = 0.5 * (1 - std::cos(2 * M_PI * i / (windowSize - 1.0)));
+  cosines.resize(bins);
+  sines.resize(bins);
+  for (size_t k = 0; k < bins; k++) {
+    cosines[k] = std::cos(2 * M_PI * k / windowSize);
+    sines[k] = std::sin(2 * M_PI * k / windowSize);
+  }
+  packed.resize(half);
+  transformed.resize(half);
+  // a full scale sine's bin is 32768 x the window's sum / 2
+  const float fullScale = 32768.0f * windowSize / 4;
+  powerScale = 1 / (fullScale * fullScale);
+  power.resize(bins);
+
+  const float nyquist = sampleRate / 2.0f;
+  const float binHz = static_cast<float>(sampleRate) / windowSize;
+  const float highHz = config.highHz > 0 ? std::min(config.highHz, nyquist) : nyquist;
+  const float lowHz = std::min(config.lowHz, highHz / 2);
+  if (config.streams & SPECTRUM_STREAM) {
+    if (config.bands > 0) {
+      std::vector<float> edges(config.bands + 1);
+      for (size_t b = 0; b <= config.bands; b++) {
+        edges[b] = lowHz * std::pow(highHz / lowHz, static_cast<float>(b) / config.bands);
+      }
+      logBands = makeBands<band_t>(edges, false, binHz, bins);
+      streams.push_back({ oscAddress::spectrum, SPECTRUM_LOG, lowHz, highHz, &spectrumDb });
+    } else {
+      streams.push_back({ oscAddress::spectrum, SPECTRUM_LINEAR, 0, nyquist, &spectrumDb });
+    }
+    spectrumDb.resize(config.bands > 0 ? config.bands : bins);
+  }
+  if (config.streams & MEL_STREAM) {
+    std::vector<float> edges(config.melBands + 2);
+    const float lowMel = hzToMel(lowHz), highMel = hzToMel(highHz);
+    for (size_t b = 0; b < edges.size(); b++) {
+      edges[b] = melToHz(lowMel + (highMel - lowMel) * b / (config.melBands + 1));
+    }
+    melBands = makeBands<band_t>(edges, true, binHz, bins);
+    streams.push_back({ oscAddress::mel, SPECTRUM_MEL, lowHz, highHz, &melDb });
+    melDb.resize(config.melBands);
+  }
+
+  // room for every stream's packets, fragmented or not
+  size_t maxPackets = 0, maxMessage = 0;
+  for (const stream_t& stream : streams) {
+    const size_t size = messageSize(stream);
+    maxPackets += (size + fragmentChunk() - 1) / fragmentChunk();
+    maxMessage = std::max(maxMessage, size);
+  }
+  packets.resize(maxPackets * config.mtu);
+  sizes.reserve(maxPackets);
+  message.resize(maxMessage);
+  codes.resize(std::max(spectrumDb.size(), melDb.size()) * 2);
+}
+
+SpectrumStreamer::~SpectrumStreamer() {
+  kiss_fft_free(fft);
+}
+
+// Power per bin, as OnsetDetector::flux does it
+void SpectrumStreamer::transform(const float* samples) {
+  const size_t half = windowSize / 2;
+  for (size_t m = 0; m < half; m++) {
+    packed[m].r = samples[2 * m] * window[2 * m];
+    packed[m].i = samples[2 * m + 1] * window[2 * m + 1];
+  }
+  kiss_fft(fft, packed.data(), transformed.data());
+  for (size_t k = 0; k < bins; k++) {
+    const kiss_fft_cpx& z = transformed[k % half];
+    const kiss_fft_cpx& mirror = transformed[(half - k) % half];
+    const float evenR = 0.5f * (z.r + mirror.r), evenI = 0.5f * (z.i - mirror.i);
+    const float oddR = 0.5f * (z.i + mirror.i), oddI = -0.5f * (z.r - mirror.r);
+    const float r = evenR + cosines[k] * oddR + sines[k] * oddI;
+    const float i = evenI + cosines[k] * oddI - sines[k] * oddR;
+    power[k] = (r * r + i * i) * powerScale;
+  }
+}
+
+// Each bin, or each band's mean, in dB down to the floor
+void SpectrumStreamer::toDb(const std::vector<band_t>* bands, std::vector<float>& db) const {
+  const float floorPower = std::pow(10.0f, config.floorDb / 10);
+  for (size_t b = 0; b < db.size(); b++) {
+    float sum = power[b];
+    if (bands) {
+      const band_t& band = (*bands)[b];
+      sum = 0;
+      for (size_t k = 0; k < band.weights.size(); k++) sum += band.weights[k] * power[band.first + k];
+    }
+    db[b] = 10 * std::log10(std::max(sum, floorPower));
+  }
+}
+
+size_t SpectrumStreamer::messageSize(const stream_t& stream) const {
+  const size_t count = stream.values->size();
+  const size_t valueTags = config.bits == 32 ? count : 1;
+  const size_t values = config.bits == 32 ? OSCPP::Size::float32(count) : OSCPP::Size::blob(count * config.bits / 8);
+  return OSCPP::Size::string(std::strlen(stream.address)) + OSCPP::align(HEADER_ARGS + valueTags + 2) +
+         OSCPP::Size::int32(HEADER_ARGS) + values;
+}
+
+size_t SpectrumStreamer::fragmentChunk() const {
+  return (config.mtu - FRAGMENT_OVERHEAD) / 4 * 4;
+}
+
+template <typename Packet>
+void SpectrumStreamer::writeMessage(Packet& packet, const stream_t& stream) {
+  const std::vector<float>& values = *stream.values;
+  packet.openMessage(stream.address, HEADER_ARGS + (config.bits == 32 ? values.size() : 1))
+    .int32(config.bits)
+    .int32(stream.scale)
+    .float32(stream.lowHz)
+    .float32(stream.highHz)
+    .float32(config.floorDb)
+    .float32(config.ceilingDb);
+  if (config.bits == 32) {
+    packet.float32Array(values.data(), values.size());
+  } else {
+    const float levels = (1 << config.bits) - 1;
+    const float perDb = levels / (config.ceilingDb - config.floorDb);
+    for (size_t i = 0; i < values.size(); i++) {
+      const uint32_t code = std::lround(std::clamp((values[i] - config.floorDb) * perDb, 0.0f, levels));
+      if (config.bits == 8) {
+        codes[i] = code;
+      } else {
+        codes[2 * i] = code >> 8;
+        codes[2 * i + 1] = code & 0xff;
+      }
+    }
+    packet.blob(OSCPP::Blob(codes.data(), values.size() * config.bits / 8));
+  }
+  packet.closeMessage();
+}
+
+char* SpectrumStreamer::addPacket() {
+  assert((sizes.size() + 1) * config.mtu <= packets.size());
+  return packets.data() + sizes.size() * config.mtu;
+}
+
+void SpectrumStreamer::analyse(const float* samples, int channelId, uint64_t frameSequence, int degradation) {
+  transform(samples);
+  if (config.streams & SPECTRUM_STREAM) toDb(config.bands > 0 ? &logBands : nullptr, spectrumDb);
+  if (config.streams & MEL_STREAM) toDb(&melBands, melDb);
+
+  // as many messages to a bundle as fit, the sizes planned so nothing past reserve is checked
+  sizes.clear();
+  taken = 0;
+  oscMeta_t meta;
+  meta.channelId = channelId;
+  meta.degradation = degradation;
+  OSCPP::Client::UncheckedPacket packet;
+  size_t planned = 0;
+  for (const stream_t& stream : streams) {
+    const size_t size = messageSize(stream);
+    if (planned > 0 && planned + OSCPP::Size::bundle(1) + size > config.mtu) {
+      packet.closeBundle();
+      sizes.push_back(packet.size());
+      planned = 0;
+    }
+    if (OSCPP::Size::bundle(2) + MetaMessage::size() + size > config.mtu) {
+      fragment(stream, channelId, frameSequence, degradation);
+      continue;
+    }
+    if (planned == 0) {
+      packet.reset(addPacket(), config.mtu);
+      if (packet.reserve(config.mtu) != OSCPP::Status::Ok) return;
+      packet.openBundle(frameSequence);
+      MetaMessage::write(packet, meta);
+      planned = OSCPP::Size::bundle(1) + MetaMessage::size();
+    }
+    writeMessage(packet, stream);
+    planned += OSCPP::Size::bundle(1) + size;
+  }
+  if (planned > 0) {
+    packet.closeBundle();
+    sizes.push_back(packet.size());
+  }
+}
+
+// Cut the stream's message into as few fragment bundles as the mtu allows
+void SpectrumStreamer::fragment(const stream_t& stream, int channelId, uint64_t frameSequence, int degradation) {
+  const size_t size = messageSize(stream);
+  OSCPP::Client::UncheckedPacket whole(message.data(), message.size());
+  if (whole.reserve(size) != OSCPP::Status::Ok) return;
+  writeMessage(whole, stream);
+
+  oscMeta_t meta;
+  meta.channelId = channelId;
+  meta.degradation = degradation;
+  const size_t chunk = fragmentChunk();
+  const uint32_t count = (size + chunk - 1) / chunk;
+  for (uint32_t index = 0; index < count; index++) {
+    const size_t offset = index * chunk;
+    OSCPP::Client::UncheckedPacket packet(addPacket(), config.mtu);
+    if (packet.reserve(config.mtu) != OSCPP::Status::Ok) return;
+    packet.openBundle(frameSequence);
+    MetaMessage::write(packet, meta);
+    packet.openMessage(oscAddress::fragment, 5)
+      .int32(fragmentSequence)
+      .int32(index)
+      .int32(count)
+      .int32(offset)
+      .blob(OSCPP::Blob(message.data() + offset, std::min(chunk, size - offset)))
+      .closeMessage();
+    packet.closeBundle();
+    sizes.push_back(packet.size());
+  }
+  fragmentSequence++;
+}
+
+size_t SpectrumStreamer::nextPacket(char* oscBuffer) {
+  if (taken == sizes.size()) return 0;
+  std::memcpy(oscBuffer, packets.data() + taken * config.mtu, sizes[taken]);
+  return sizes[taken++];
+}
+
+bool decodeSpectrum(const OSCPP::Server::Message& message, spectrumFrame_t& frame) {
+  if (std::strcmp(message.address(), oscAddress::spectrum) != 0 && std::strcmp(message.address(), oscAddress::mel) != 0) {
+    return false;
+  }
+  try {
+    OSCPP::Server::ArgStream args(message.args());
+    frame.bits = args.int32();
+    frame.scale = static_cast<spectrumScale_t>(args.int32());
+    frame.lowHz = args.float32();
+    frame.highHz = args.float32();
+    frame.floorDb = args.float32();
+    frame.ceilingDb = args.float32();
+    if (frame.bits == 32) {
+      frame.values.resize(std::get<0>(args.state()).consumable());
+      args.float32Array(frame.values.data(), frame.values.size());
+      return true;
+    }
+    if (frame.bits != 8 && frame.bits != 16) return false;
+    const OSCPP::Blob blob = args.blob();
+    const uint8_t* codes = static_cast<const uint8_t*>(blob.data());
+    const size_t bytes = frame.bits / 8;
+    const float dbPerCode = (frame.ceilingDb - frame.floorDb) / ((1 << frame.bits) - 1);
+    frame.values.resize(blob.size() / bytes);
+    for (size_t i = 0; i < frame.values.size(); i++) {
+      const uint32_t code = bytes == 1 ? codes[i] : codes[2 * i] << 8 | codes[2 * i + 1];
+      frame.values[i] = frame.floorDb + code * dbPerCode;
+    }
+    return true;
+  } catch (const OSCPP::Error&) {
+    return false;
+  }
+}
+
+bool FragmentReassembler::add(int channelId, const OSCPP::Server::Message& fragment) {
+  if (std::strcmp(fragment.address(), oscAddress::fragment) != 0) return false;
+  try {
+    OSCPP::Server::ArgStream args(fragment.args());
+    const uint32_t sequence = args.int32();
+    const uint32_t index = args.int32();
+    const uint32_t count = args.int32();
+    const uint32_t offset = args.int32();
+    const OSCPP::Blob bytes = args.blob();
+    if (count == 0 || count > MAX_FRAGMENTS || index >= count || offset + bytes.size() > MAX_MESSAGE_SIZE) {
+      return false;
+    }
+    partial_t& partial = partials[channelId];
+    if (partial.received.empty() || partial.sequence != sequence) {
+      if (partial.remaining > 0) droppedMessages++;
+      partial.sequence = sequence;
+      partial.received.assign(count, false);
+      partial.remaining = count;
+      partial.size = 0;
+      partial.bytes.clear();
+    }
+    if (partial.received.size() != count || partial.received[index]) return false; // a duplicate
+    if (partial.bytes.size() < offset + bytes.size()) partial.bytes.resize(offset + bytes.size());
+    std::memcpy(partial.bytes.data() + offset, bytes.data(), bytes.size());
+    partial.received[index] = true;
+    partial.remaining--;
+    if (index == count - 1) partial.size = offset + bytes.size();
+    if (partial.remaining > 0) return false;
+    complete.assign(partial.bytes.begin(), partial.bytes.begin() + partial.size);
+    return true;
+  } catch (const OSCPP::Error&) {
+    return false;
+  }
+}
+
+OSCPP::Server::Message FragmentReassembler::message() const {
+  return OSCPP::Server::Message(OSCPP::Server::Packet(complete.data(), complete.size()));
+}
+
+bool readSpectra(const std::string& oscsPath) {
+  std::vector<char> oscs;
+  if (!readWholeFile(oscsPath, oscs)) {
+    std::cerr << "can't read '" << oscsPath << "'" << std::endl;
+    return false;
+  }
+  FragmentReassembler reassembler;
+  spectrumFrame_t frame;
+  size_t spectra = 0, mels = 0, reassembled = 0, malformed = 0;
+  size_t spectrumValues = 0, melValues = 0;
+  double sumDb = 0;
+  auto decode = [&](const OSCPP::Server::Message& message) {
+    if (!decodeSpectrum(message, frame)) {
+      malformed++;
+      return;
+    }
+    const bool mel = frame.scale == SPECTRUM_MEL;
+    (mel ? mels : spectra)++;
+    (mel ? melValues : spectrumValues) = frame.values.size();
+    for (float db : frame.values) sumDb += db;
+  };
+  forEachOscsBundle(oscs.data(), oscs.size(), [&](const char* data, size_t size) {
+    try {
+      OSCPP::Server::Bundle bundle(OSCPP::Server::Packet(data, size));
+      OSCPP::Server::PacketStream packets(bundle.packets());
+      oscMeta_t meta;
+      while (!packets.atEnd()) {
+        OSCPP::Server::Packet element = packets.next();
+        if (!element.isMessage()) continue;
+        OSCPP::Server::Message message(element);
+        const char* address = message.address();
+        if (std::strcmp(address, oscAddress::meta) == 0) {
+          MetaMessage::decode(message, meta);
+        } else if (std::strcmp(address, oscAddress::fragment) == 0) {
+          if (!reassembler.add(meta.channelId, message)) continue;
+          reassembled++;
+          decode(reassembler.message());
+        } else if (std::strcmp(address, oscAddress::spectrum) == 0 || std::strcmp(address, oscAddress::mel) == 0) {
+          decode(message);
+        }
+      }
+    } catch (const OSCPP::Error&) {
+      malformed++;
+    }
+  });
+
+  std::cout << oscsPath << ": " << spectra << " /spectrum frames of " << spectrumValues << " values, " << mels
+            << " /mel frames of " << melValues << ", " << reassembled << " reassembled from fragments, "
+            << reassembler.dropped() << " lost to missing fragments, " << malformed << " malformed";
+  if (spectra + mels > 0) std::cout << ", mean " << sumDb / (spectra * spectrumValues + mels * melValues) << "dB";
+  std::cout << std::endl;
+  return malformed == 0;
+}
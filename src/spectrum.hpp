@@ -0,0 +1,149 @@
+#ifndef ANALYSER_SPECTRUM_HPP
+#define ANALYSER_SPECTRUM_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <oscpp/server.hpp>
+#include "kiss_fft.h"
+
+// Spectrum and mel band streaming, for visualisers that want more than the
+// summary features. Each analysed window, Hann windowed, gives a power
+// spectrum in dBFS (a full scale sine's bin is about 0), sent as
+//   /spectrum bits scale lowHz highHz floorDb ceilingDb values...
+//   /mel      bits scale lowHz highHz floorDb ceilingDb values...
+// scale is how the values are spaced: SPECTRUM_LINEAR, every FFT bin from 0
+// to Nyquist; SPECTRUM_LOG, bands geometrically spaced from lowHz to highHz;
+// SPECTRUM_MEL, triangular bands evenly spaced in mel. Log and mel bands are
+// the mean power of the bins they cover. With 32 bits the values are float
+// dB arguments; with 8 or 16 they are one blob of big endian unsigned codes,
+// 0 at floorDb up to the largest at ceilingDb, linear in dB between.
+//
+// Messages go, after /meta, in bundles of up to the MTU. One that can't fit
+// even alone is cut into fragments, each a bundle of /meta and
+//   /fragment sequence index count offset bytes
+// with sequence counting the channel's fragmented messages; the bytes at
+// offset are part of the whole OSC message. FragmentReassembler puts them
+// back together. .osca archives (archive.hpp) keep the blobs as sent.
+
+enum spectrumStream_t : unsigned {
+  SPECTRUM_STREAM = 1,
+  MEL_STREAM = 2,
+};
+
+enum spectrumScale_t : int32_t {
+  SPECTRUM_LINEAR = 0,
+  SPECTRUM_LOG = 1,
+  SPECTRUM_MEL = 2,
+};
+
+struct spectrumConfig_t {
+  unsigned streams = 0;    // ANALYSER_SPECTRUM, spectrum, mel or spectrum,mel; none by default
+  size_t bands = 0;        // ANALYSER_SPECTRUM_BANDS, log bands for /spectrum; 0 sends every bin
+  size_t melBands = 40;    // ANALYSER_MEL_BANDS
+  float lowHz = 40;        // ANALYSER_SPECTRUM_LOW_HZ, of the log and mel bands
+  float highHz = 0;        // ANALYSER_SPECTRUM_HIGH_HZ, 0 for Nyquist
+  int bits = 16;           // ANALYSER_SPECTRUM_BITS, 8, 16 or 32 (float)
+  float floorDb = -100;    // ANALYSER_SPECTRUM_FLOOR_DB, the quantised range
+  float ceilingDb = 0;     // ANALYSER_SPECTRUM_CEILING_DB
+  size_t mtu = 0;          // ANALYSER_SPECTRUM_MTU, largest packet, by default (and at most) MAX_OSC_PACKET_SIZE
+};
+// From the environment, with mtu at most maxPacketSize
+spectrumConfig_t spectrumConfigFromEnv(size_t maxPacketSize);
+
+// Keeps the packets of the latest window until they're taken, so use one per channel
+class SpectrumStreamer {
+public:
+  SpectrumStreamer(const spectrumConfig_t& config, int sampleRate, size_t windowSize);
+  ~SpectrumStreamer();
+  SpectrumStreamer(const SpectrumStreamer&) = delete;
+  SpectrumStreamer& operator=(const SpectrumStreamer&) = delete;
+  // Analyse a window (windowSize samples at int16 scale) into packets,
+  // replacing any of the last window's not yet taken
+  void analyse(const float* window, int channelId, uint64_t frameSequence, int degradation);
+  // Copy the next packet into oscBuffer (the config's mtu) and return its size, or 0 when there are no more
+  size_t nextPacket(char* oscBuffer);
+  // The latest window's values in dB, for the benchmarks
+  const std::vector<float>& spectrum() const { return spectrumDb; }
+  const std::vector<float>& mel() const { return melDb; }
+
+private:
+  struct band_t {
+    size_t first;               // bin
+    std::vector<float> weights; // of first and the bins after it, summing to 1
+  };
+  struct stream_t {
+    const char* address;
+    spectrumScale_t scale;
+    float lowHz, highHz;
+    std::vector<float>* values;
+  };
+
+  spectrumConfig_t config;
+  size_t windowSize, bins;
+  kiss_fft_cfg fft; // half size, as in onset.cpp
+  std::vector<float> window, cosines, sines;
+  std::vector<kiss_fft_cpx> packed, transformed;
+  float powerScale;           // to full scale
+  std::vector<float> power;   // per bin, scaled
+  std::vector<band_t> logBands, melBands;
+  std::vector<float> spectrumDb, melDb;
+  std::vector<stream_t> streams;
+  std::vector<uint8_t> codes;   // quantised values, for the blob
+  std::vector<char> message;    // scratch for one that needs fragmenting
+  std::vector<char> packets;    // the latest window's, each at a multiple of the mtu
+  std::vector<size_t> sizes;
+  size_t taken = 0;
+  uint32_t fragmentSequence = 0;
+
+  void transform(const float* samples);
+  void toDb(const std::vector<band_t>* bands, std::vector<float>& db) const;
+  size_t messageSize(const stream_t& stream) const;
+  size_t fragmentChunk() const; // bytes of the message in each fragment
+  template <typename Packet> void writeMessage(Packet& packet, const stream_t& stream);
+  char* addPacket();
+  void fragment(const stream_t& stream, int channelId, uint64_t frameSequence, int degradation);
+};
+
+// A /spectrum or /mel message decoded, values in dB
+struct spectrumFrame_t {
+  int bits = 0;
+  spectrumScale_t scale = SPECTRUM_LINEAR;
+  float lowHz = 0, highHz = 0;
+  float floorDb = 0, ceilingDb = 0;
+  std::vector<float> values;
+};
+
+// Whether message is a /spectrum or /mel one, decoded into frame
+bool decodeSpectrum(const OSCPP::Server::Message& message, spectrumFrame_t& frame);
+
+// Puts fragmented messages back together, per channel. A message's
+// fragments may arrive in any order, but one from a newer message drops an
+// unfinished one, whose fragments were lost.
+class FragmentReassembler {
+public:
+  // Add a /fragment from a bundle of channelId's. Returns true when that
+  // completed a message, which message() gives until the next add.
+  bool add(int channelId, const OSCPP::Server::Message& fragment);
+  OSCPP::Server::Message message() const;
+  size_t dropped() const { return droppedMessages; }
+
+private:
+  struct partial_t {
+    uint32_t sequence = 0;
+    std::vector<bool> received; // per index
+    size_t remaining = 0;
+    size_t size = 0;            // known once the last arrives
+    std::vector<char> bytes;
+  };
+  std::unordered_map<int, partial_t> partials;
+  std::vector<char> complete;
+  size_t droppedMessages = 0;
+};
+
+// analyser spectra: decode every spectrum and mel frame in an .oscs file, reassembling fragments
+bool readSpectra(const std::string& oscsPath);
+
+#endif // ANALYSER_SPECTRUM_HPP
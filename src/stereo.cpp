@@ -0,0 +1,210 @@
+#include "stereo.hpp"
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <sstream>
+#include <vector>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+#include "Gist.h"
+#include "kiss_fft.h"
+#include "trace.hpp"
+
+unsigned stereoTargetsFromSpec(const std::string& spec) {
+  if (spec == "all") return (1u << STEREO_TARGET_COUNT) - 1;
+  unsigned targets = 0;
+  std::istringstream names(spec);
+  std::string name;
+  while (std::getline(names, name, ',')) {
+    auto found = std::find(std::begin(STEREO_TARGET_NAMES), std::end(STEREO_TARGET_NAMES), name);
+    if (found == std::end(STEREO_TARGET_NAMES)) {
+      std::cerr << "ignoring unknown stereo target '" << name << "'" << std::endl;
+      continue;
+    }
+    targets |= 1u << (found - std::begin(STEREO_TARGET_NAMES));
+  }
+  return targets;
+}
+
+void deinterleave(const int16_t* interleaved, float* left, float* right, size_t frames) {
+  size_t i = 0;
+#if defined(__SSE2__)
+  // each pair is an int32 with L in the low half, so shifts split them
+  for (; i + 4 <= frames; i += 4) {
+    __m128i pairs = _mm_loadu_si128(reinterpret_cast<const __m128i*>(interleaved + 2 * i));
+    _mm_storeu_ps(left + i, _mm_cvtepi32_ps(_mm_srai_epi32(_mm_slli_epi32(pairs, 16), 16)));
+    _mm_storeu_ps(right + i, _mm_cvtepi32_ps(_mm_srai_epi32(pairs, 16)));
+  }
+#elif defined(__ARM_NEON)
+  for (; i + 4 <= frames; i += 4) {
+    int16x4x2_t pairs = vld2_s16(interleaved + 2 * i);
+    vst1q_f32(left + i, vcvtq_f32_s32(vmovl_s16(pairs.val[0])));
+    vst1q_f32(right + i, vcvtq_f32_s32(vmovl_s16(pairs.val[1])));
+  }
+#endif
+  for (; i < frames; i++) {
+    left[i] = interleaved[2 * i];
+    right[i] = interleaved[2 * i + 1];
+  }
+}
+
+namespace {
+
+class GistStereoEngine : public StereoFeatureEngine {
+public:
+  explicit GistStereoEngine(int sampleRate) : sampleRate(sampleRate), yin(sampleRate) {}
+  ~GistStereoEngine() override {
+    if (fft) kiss_fft_free(fft);
+  }
+
+  void analyse(const float* left, const float* right, int sampleCount, unsigned groups, unsigned targets,
+               stereoFeatures_t& features) override {
+    if (targets == 0) return;
+    if (sampleCount != frameSize) resize(sampleCount);
+    const size_t n = sampleCount;
+    auto wanted = [&](int t) { return (targets & (1u << t)) != 0; };
+
+    // time domain, as Gist's features see it
+    if (wanted(TARGET_LEFT)) std::copy_n(left, n, signals[TARGET_LEFT].begin());
+    if (wanted(TARGET_RIGHT)) std::copy_n(right, n, signals[TARGET_RIGHT].begin());
+    if (wanted(TARGET_MID) || wanted(TARGET_SIDE)) {
+      float* mid = signals[TARGET_MID].data();
+      float* side = signals[TARGET_SIDE].data();
+      for (size_t i = 0; i < n; i++) {
+        mid[i] = 0.5f * (left[i] + right[i]);
+        side[i] = 0.5f * (left[i] - right[i]);
+      }
+    }
+    for (int t = 0; t < STEREO_TARGET_COUNT; t++) {
+      if (!wanted(t) || !(groups & TIME_FEATURES)) continue;
+      features[t][RMS] = time.rootMeanSquare(signals[t]);
+      features[t][PEAK_ENERGY] = time.peakEnergy(signals[t]);
+      features[t][ZERO_CROSSING_RATE] = time.zeroCrossingRate(signals[t]);
+    }
+    if (!(groups & SPECTRAL_FEATURES)) return;
+
+    // one FFT for up to two targets, or for L and R to derive the rest from
+    {
+      TraceScope trace(TraceStage::fft);
+      int first = -1, second = -1;
+      for (int t = 0; t < STEREO_TARGET_COUNT; t++) {
+        if (!wanted(t)) continue;
+        if (first < 0) first = t;
+        else if (second < 0) second = t;
+        else first = TARGET_LEFT, second = TARGET_RIGHT;
+      }
+      if (first == TARGET_LEFT && second == TARGET_RIGHT) {
+        transformPair(left, right, TARGET_LEFT, TARGET_RIGHT);
+      } else {
+        transformPair(signals[first].data(), second < 0 ? nullptr : signals[second].data(), first, second);
+      }
+      for (int t : { TARGET_MID, TARGET_SIDE }) {
+        if (!wanted(t) || t == first || t == second) continue;
+        const float sign = t == TARGET_MID ? 1.0f : -1.0f;
+        for (size_t k = 0; k < n; k++) {
+          real[t][k] = 0.5f * (real[TARGET_LEFT][k] + sign * real[TARGET_RIGHT][k]);
+          imag[t][k] = 0.5f * (imag[TARGET_LEFT][k] + sign * imag[TARGET_RIGHT][k]);
+        }
+        magnitudes(t);
+      }
+    }
+
+    for (int t = 0; t < STEREO_TARGET_COUNT; t++) {
+      if (!wanted(t)) continue;
+      features_t& f = features[t];
+      const std::vector<float>& magnitude = magnitudeSpectra[t];
+      if (groups & FREQ_FEATURES) {
+        f[SPECTRAL_CENTROID] = frequency.spectralCentroid(magnitude);
+        f[SPECTRAL_CREST] = frequency.spectralCrest(magnitude);
+        f[SPECTRAL_FLATNESS] = frequency.spectralFlatness(magnitude);
+        f[SPECTRAL_ROLLOFF] = frequency.spectralRolloff(magnitude);
+        f[SPECTRAL_KURTOSIS] = frequency.spectralKurtosis(magnitude);
+      }
+      if (groups & ONSET_FEATURES) {
+        OnsetDetectionFunction<float>& onset = *onsets[t];
+        f[ENERGY_DIFFERENCE] = onset.energyDifference(signals[t]);
+        f[SPECTRAL_DIFFERENCE] = onset.spectralDifference(magnitude);
+        f[SPECTRAL_DIFFERENCE_HWR] = onset.spectralDifferenceHWR(magnitude);
+        f[COMPLEX_SPECTRAL_DIFFERENCE] = onset.complexSpectralDifference(real[t], imag[t]);
+        f[HIGH_FREQUENCY_CONTENT] = onset.highFrequencyContent(magnitude);
+      }
+      if (groups & PITCH_FEATURES) {
+        f[PITCH] = yin.pitchYin(signals[t]);
+      }
+      if (groups & MFCC_FEATURES) {
+        const auto& coefficients = mfcc->calculateMelFrequencyCepstralCoefficients(magnitude);
+        std::fill(f.begin() + MFCC_0, f.end(), 0.0f);
+        std::copy_n(coefficients.begin(), std::min(coefficients.size(), MFCC_COUNT), f.begin() + MFCC_0);
+      }
+    }
+  }
+
+private:
+  int sampleRate;
+  int frameSize = 0;
+  kiss_fft_cfg fft = nullptr;
+  std::vector<float> window;
+  std::vector<kiss_fft_cpx> fftIn, fftOut;
+  // per target: time domain, the whole FFT as Gist keeps it, and its first half's magnitudes
+  std::array<std::vector<float>, STEREO_TARGET_COUNT> signals, real, imag, magnitudeSpectra;
+  std::array<std::unique_ptr<OnsetDetectionFunction<float>>, STEREO_TARGET_COUNT> onsets;
+  CoreTimeDomainFeatures<float> time;
+  CoreFrequencyDomainFeatures<float> frequency;
+  Yin<float> yin;
+  std::unique_ptr<MFCC<float>> mfcc;
+
+  void resize(int n) {
+    frameSize = n;
+    if (fft) kiss_fft_free(fft);
+    fft = kiss_fft_alloc(n, 0, nullptr, nullptr);
+    // Hann, as Gist windows its frames
+    window.resize(n);
+    for (int i = 0; i < n; i++) window[i] = 0.5 * (1 - std::cos(2 * M_PI * i / (n - 1.0)));
+    fftIn.resize(n);
+    fftOut.resize(n);
+    for (int t = 0; t < STEREO_TARGET_COUNT; t++) {
+      signals[t].assign(n, 0.0f);
+      real[t].assign(n, 0.0f);
+      imag[t].assign(n, 0.0f);
+      magnitudeSpectra[t].assign(n / 2, 0.0f);
+      onsets[t] = std::make_unique<OnsetDetectionFunction<float>>(n);
+    }
+    mfcc = std::make_unique<MFCC<float>>(n, sampleRate);
+  }
+
+  // a + ib through one FFT, then split: A[k] = (Z[k] + conj Z[n-k]) / 2, B[k] = (Z[k] - conj Z[n-k]) / 2i
+  void transformPair(const float* a, const float* b, int ta, int tb) {
+    const size_t n = frameSize;
+    for (size_t i = 0; i < n; i++) {
+      fftIn[i].r = a[i] * window[i];
+      fftIn[i].i = b ? b[i] * window[i] : 0.0f;
+    }
+    kiss_fft(fft, fftIn.data(), fftOut.data());
+    for (size_t k = 0; k < n; k++) {
+      const kiss_fft_cpx& z = fftOut[k];
+      const kiss_fft_cpx& mirror = fftOut[k == 0 ? 0 : n - k];
+      real[ta][k] = 0.5f * (z.r + mirror.r);
+      imag[ta][k] = 0.5f * (z.i - mirror.i);
+      if (tb < 0) continue;
+      real[tb][k] = 0.5f * (z.i + mirror.i);
+      imag[tb][k] = 0.5f * (mirror.r - z.r);
+    }
+    magnitudes(ta);
+    if (tb >= 0) magnitudes(tb);
+  }
+
+  void magnitudes(int t) {
+    for (size_t k = 0; k < magnitudeSpectra[t].size(); k++) {
+      magnitudeSpectra[t][k] = std::sqrt(real[t][k] * real[t][k] + imag[t][k] * imag[t][k]);
+    }
+  }
+};
+
+} // namespace
+
+std::unique_ptr<StereoFeatureEngine> makeStereoFeatureEngine(int sampleRate) {
+  return std::make_unique<GistStereoEngine>(sampleRate);
+}
@@ -0,0 +1,43 @@
+#ifndef ANALYSER_STEREO_HPP
+#define ANALYSER_STEREO_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include "features.hpp"
+
+// Jamulus stereo channels send interleaved L/R int16 frames
+// (META_TYPE::stereoAudioFrame). They're deinterleaved into a pair of
+// windows and analysed for each of the targets in ANALYSER_STEREO_TARGETS:
+// L, R, mid ((L+R)/2) and side ((L-R)/2), comma separated, or all.
+
+enum StereoTarget { TARGET_LEFT = 0, TARGET_RIGHT, TARGET_MID, TARGET_SIDE, STEREO_TARGET_COUNT };
+using stereoFeatures_t = std::array<features_t, STEREO_TARGET_COUNT>;
+
+inline constexpr const char* STEREO_TARGET_NAMES[STEREO_TARGET_COUNT] = { "L", "R", "mid", "side" };
+constexpr const char* stereoTargetName(size_t target) {
+  return STEREO_TARGET_NAMES[target];
+}
+// A mask of 1 << StereoTarget; unknown names are reported and left out
+unsigned stereoTargetsFromSpec(const std::string& spec);
+
+// Interleaved int16 pairs to float, four frames at a time with SSE2 or NEON
+void deinterleave(const int16_t* interleaved, float* left, float* right, size_t frames);
+
+// Gist's features for each target from one pair of windows, sharing a
+// single complex FFT between them: two signals go in as its real and
+// imaginary parts and are separated by conjugate symmetry, and with more
+// than two targets those are L and R, with mid and side following by
+// linearity. Onset functions keep history per target, so use one per channel.
+class StereoFeatureEngine {
+public:
+  virtual ~StereoFeatureEngine() = default;
+  virtual void analyse(const float* left, const float* right, int sampleCount, unsigned groups, unsigned targets,
+                       stereoFeatures_t& features) = 0;
+};
+
+std::unique_ptr<StereoFeatureEngine> makeStereoFeatureEngine(int sampleRate);
+
+#endif // ANALYSER_STEREO_HPP
@@ -0,0 +1,203 @@
+#include "tempo.hpp"
+#include <algorithm>
+#include <cmath>
+#include "config.hpp"
+#include "onset.hpp"
+
+namespace {
+
+const size_t DECIMATION = 2;        // hops per tempo sample
+const float MEAN_SECONDS = 0.5f;    // of the flux, taken off each sample
+const size_t PICK_SAMPLES = 16;     // tempo samples between picks, about 85ms
+const float PRIOR_BPM = 120, PRIOR_OCTAVES = 1; // log normal centre and deviation
+const float PHASE_MEMORY_SECONDS = 4; // of where in the beat the samples land
+const float ENSEMBLE_AGREEMENT = 0.04f; // tempo within which a tracker's phase counts
+
+typedef float floatx4 __attribute__((vector_size(16)));
+typedef float unalignedFloatx4 __attribute__((vector_size(16), aligned(4)));
+
+// Rather than decaying every value each sample, new samples are weighted up
+// by a growing gain and the values scaled back when it gets large, which
+// also keeps silence from decaying them into (slow) denormals
+const float MAX_GAIN = 1e12f;
+
+void rescale(float* values, size_t count, float& gain) {
+  for (size_t i = 0; i < count; i++) {
+    values[i] /= gain;
+    if (values[i] < 1e-20f) values[i] = 0;
+  }
+  gain = 1;
+}
+
+float wrap(float phase) {
+  return phase - std::floor(phase);
+}
+
+// The period (refined between lags) that best combines each lag's
+// autocorrelation with twice its own, less half its own (so half the beat
+// isn't taken for it when nothing lands between beats), over the mean
+// across the range, under the prior
+bool pickPeriod(const float* acf, size_t minLag, size_t maxLag, const float* prior, float& period,
+                float& confidence) {
+  float mean = 0;
+  for (size_t l = minLag; l <= maxLag; l++) mean += acf[l];
+  mean /= maxLag - minLag + 1;
+  if (acf[0] <= mean) return false;
+  auto score = [&](size_t l) { return prior[l] * (acf[l] + 0.5f * (acf[2 * l] - acf[l / 2]) - mean); };
+  size_t best = minLag;
+  float bestScore = score(minLag);
+  for (size_t l = minLag + 1; l <= maxLag; l++) {
+    const float s = score(l);
+    if (s > bestScore) {
+      best = l;
+      bestScore = s;
+    }
+  }
+  if (bestScore <= 0) return false;
+  period = best;
+  if (best > minLag && best < maxLag) {
+    const float before = score(best - 1), after = score(best + 1);
+    const float curvature = before - 2 * bestScore + after;
+    if (curvature < 0) period += 0.5f * (before - after) / curvature;
+  }
+  confidence = std::clamp((acf[best] - mean) / (acf[0] - mean), 0.0f, 1.0f);
+  return true;
+}
+
+} // namespace
+
+tempoConfig_t tempoConfigFromEnv() {
+  tempoConfig_t config;
+  config.minBpm = std::max(10.0, envDouble("ANALYSER_TEMPO_MIN_BPM", config.minBpm));
+  config.maxBpm = std::max<double>(config.minBpm + 1, envDouble("ANALYSER_TEMPO_MAX_BPM", config.maxBpm));
+  config.memorySeconds = std::max(0.5, envDouble("ANALYSER_TEMPO_MEMORY_S", config.memorySeconds));
+  return config;
+}
+
+TempoTracker::TempoTracker(const tempoConfig_t& config, int sampleRate) {
+  rate = static_cast<float>(sampleRate) / (ONSET_HOP * DECIMATION);
+  decay = std::exp(-1.0f / (config.memorySeconds * rate));
+  phaseDecay = std::exp(-1.0f / (PHASE_MEMORY_SECONDS * rate));
+  minLag = std::max<size_t>(2, std::floor(60 * rate / config.maxBpm));
+  maxLag = std::max<size_t>(minLag + 2, std::ceil(60 * rate / config.minBpm));
+  lags = (2 * maxLag + 1 + 3) / 4 * 4;
+  prior.resize(maxLag + 1);
+  for (size_t l = 1; l <= maxLag; l++) {
+    const float octaves = std::log2(60 * rate / l / PRIOR_BPM) / PRIOR_OCTAVES;
+    prior[l] = std::exp(-0.5f * octaves * octaves);
+  }
+  reset();
+}
+
+void TempoTracker::reset() {
+  history.assign(2 * lags, 0.0f);
+  position = 0;
+  autocorrelation.assign(lags, 0.0f);
+  pending = 0;
+  paired = false;
+  mean = 0;
+  untilPick = PICK_SAMPLES;
+  period = confidence = oscillator = 0;
+  phaseBins.fill(0.0f);
+  gain = phaseGain = 1;
+}
+
+void TempoTracker::process(const float* fluxes, size_t count) {
+  for (size_t i = 0; i < count; i++) {
+    if (!paired) {
+      pending = fluxes[i];
+      paired = true;
+      continue;
+    }
+    paired = false;
+    add(pending + fluxes[i]);
+  }
+}
+
+void TempoTracker::add(float flux) {
+  mean += (flux - mean) / (MEAN_SECONDS * rate);
+  const float sample = std::max(0.0f, flux - mean);
+
+  // newest first, and again a lags on, so every lag's partner is contiguous
+  position = (position == 0 ? lags : position) - 1;
+  history[position] = history[position + lags] = sample;
+  floatx4* acf = reinterpret_cast<floatx4*>(autocorrelation.data());
+  const float* partners = history.data() + position;
+  const float weighted = gain * sample;
+  for (size_t v = 0; v < lags / 4; v++) {
+    acf[v] += weighted * *reinterpret_cast<const unalignedFloatx4*>(partners + 4 * v);
+  }
+  gain /= decay;
+  if (gain > MAX_GAIN) rescale(autocorrelation.data(), lags, gain);
+
+  if (--untilPick == 0) {
+    pick();
+    untilPick = PICK_SAMPLES;
+  }
+  if (period > 0) {
+    // the sample goes in the bin of the oscillator's phase; a steady beat piles up in one
+    oscillator = wrap(oscillator + 1 / period);
+    phaseBins[std::min<size_t>(oscillator * TEMPO_PHASE_BINS, TEMPO_PHASE_BINS - 1)] += phaseGain * sample;
+    phaseGain /= phaseDecay;
+    if (phaseGain > MAX_GAIN) rescale(phaseBins.data(), TEMPO_PHASE_BINS, phaseGain);
+  }
+}
+
+void TempoTracker::pick() {
+  float picked, pickedConfidence;
+  if (pickPeriod(autocorrelation.data(), minLag, maxLag, prior.data(), picked, pickedConfidence)) {
+    period = picked;
+    confidence = pickedConfidence;
+  } else {
+    confidence = 0;
+  }
+}
+
+tempo_t TempoTracker::read() const {
+  tempo_t tempo;
+  if (period <= 0) return tempo;
+  tempo.bpm = 60 * rate / period;
+  tempo.confidence = confidence;
+  // the flux peaks ONSET_PEAK_DELAY after its onset, and a hop may be waiting for its pair
+  const float behind = static_cast<float>(ONSET_PEAK_DELAY) / (ONSET_HOP * DECIMATION) + (paired ? 0.5f : 0.0f);
+  // the fullest bin, refined between its neighbours, is where the beat falls on the oscillator
+  const size_t peak = std::max_element(phaseBins.begin(), phaseBins.end()) - phaseBins.begin();
+  const float before = phaseBins[(peak + TEMPO_PHASE_BINS - 1) % TEMPO_PHASE_BINS], after = phaseBins[(peak + 1) % TEMPO_PHASE_BINS];
+  const float curvature = before - 2 * phaseBins[peak] + after;
+  const float offset = curvature < 0 ? 0.5f * (before - after) / curvature : 0.0f;
+  const float beat = (peak + 0.5f + offset) / TEMPO_PHASE_BINS;
+  tempo.phase = wrap(oscillator - beat + behind / period);
+  return tempo;
+}
+
+tempo_t ensembleTempo(const std::vector<const TempoTracker*>& trackers) {
+  tempo_t tempo;
+  if (trackers.empty()) return tempo;
+  const TempoTracker& first = *trackers.front();
+  // each normalised by its own autocorrelation at 0, less its mean, so the loudest doesn't decide
+  std::vector<float> sum(first.lags, 0.0f);
+  for (const TempoTracker* tracker : trackers) {
+    if (tracker->lags != first.lags) continue;
+    const float energy = tracker->autocorrelation[0];
+    if (energy <= 0) continue;
+    for (size_t l = 0; l < sum.size(); l++) sum[l] += tracker->autocorrelation[l] / energy;
+  }
+  float period, confidence;
+  if (!pickPeriod(sum.data(), first.minLag, first.maxLag, first.prior.data(), period, confidence)) return tempo;
+  tempo.bpm = 60 * first.rate / period;
+  tempo.confidence = confidence;
+
+  float x = 0, y = 0;
+  for (const TempoTracker* tracker : trackers) {
+    const tempo_t own = tracker->read();
+    if (own.bpm <= 0 || std::fabs(own.bpm - tempo.bpm) > ENSEMBLE_AGREEMENT * tempo.bpm) continue;
+    x += own.confidence * std::cos(2 * static_cast<float>(M_PI) * own.phase);
+    y += own.confidence * std::sin(2 * static_cast<float>(M_PI) * own.phase);
+  }
+  if (x == 0 && y == 0) {
+    tempo.confidence = 0; // no one's phase to go on
+    return tempo;
+  }
+  tempo.phase = wrap(std::atan2(y, x) / (2 * static_cast<float>(M_PI)));
+  return tempo;
+}
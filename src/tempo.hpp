@@ -0,0 +1,72 @@
+#ifndef ANALYSER_TEMPO_HPP
+#define ANALYSER_TEMPO_HPP
+
+#include <array>
+#include <cstddef>
+#include <vector>
+
+// Tempo and beat phase from the onset detector's flux (onset.hpp), updated
+// as each hop arrives rather than over a window. Pairs of hops make one
+// tempo sample (about 5ms); less its running mean and half-wave rectified,
+// that goes into a running autocorrelation over up to two beat periods at
+// the slowest tempo, every lag decaying by e over memorySeconds, so each
+// sample costs one multiply-add per lag. The beat period is the lag that
+// best combines its own autocorrelation with twice its, less half its,
+// under a log normal prior around 120bpm, refined between lags. For the beat phase, an
+// oscillator runs at that period and each sample is added to a decaying
+// histogram over the oscillator's phase: where onsets keep landing is the
+// beat, and offbeats pile up elsewhere rather than pulling it off.
+
+constexpr size_t TEMPO_PHASE_BINS = 32;
+
+struct tempoConfig_t {
+  float minBpm = 60;         // ANALYSER_TEMPO_MIN_BPM
+  float maxBpm = 200;        // ANALYSER_TEMPO_MAX_BPM
+  float memorySeconds = 6;   // ANALYSER_TEMPO_MEMORY_S, how long the autocorrelation remembers
+};
+tempoConfig_t tempoConfigFromEnv();
+
+struct tempo_t {
+  float bpm = 0;        // 0 until there's a beat to go on
+  float confidence = 0; // 0 to 1, the autocorrelation at the beat period over that at 0
+  float phase = 0;      // 0 to 1 through the beat, 0 on it, at the end of the latest input
+};
+
+class TempoTracker {
+public:
+  TempoTracker(const tempoConfig_t& config, int sampleRate);
+  // The flux of each ONSET_HOP, as OnsetDetector::hopFluxes gives it
+  void process(const float* fluxes, size_t count);
+  tempo_t read() const;
+  void reset();
+private:
+  float rate;  // tempo samples per second
+  float decay; // of each lag per tempo sample
+  float phaseDecay; // of each phase bin
+  size_t minLag, maxLag, lags; // beat periods in tempo samples; autocorrelation of 0 to 2 maxLag, padded
+  std::vector<float> prior;    // per lag up to maxLag
+  std::vector<float> history;  // the latest lags samples, newest first from position, stored twice
+  size_t position = 0;
+  std::vector<float> autocorrelation; // scaled by gain
+  float gain = 1;
+  float pending = 0;           // the first of a pair of hops
+  bool paired = false;
+  float mean = 0;              // running mean of the flux
+  size_t untilPick = 0;
+  float period = 0, confidence = 0; // in tempo samples, 0 until picked
+  float oscillator = 0;        // 0 to 1 at the period
+  std::array<float, TEMPO_PHASE_BINS> phaseBins; // rectified samples by the oscillator's phase, decaying, scaled by phaseGain
+  float phaseGain = 1;
+
+  void add(float sample);
+  void pick();
+
+  friend tempo_t ensembleTempo(const std::vector<const TempoTracker*>& trackers);
+};
+
+// The ensemble's tempo, from the sum of the trackers' normalised
+// autocorrelations, so it needs no alignment between their streams, and its
+// phase the confidence weighted circular mean of the trackers' that agree.
+tempo_t ensembleTempo(const std::vector<const TempoTracker*>& trackers);
+
+#endif // ANALYSER_TEMPO_HPP
@@ -0,0 +1,140 @@
+#include "trace.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <vector>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+#include "config.hpp"
+
+const bool traceEnabled = envFlag("ANALYSER_TRACE");
+
+namespace {
+
+const size_t TRACE_EVENTS = std::max(1024L, envLong("ANALYSER_TRACE_EVENTS", 1 << 16));
+
+const char* STAGE_NAMES[] = {
+  "convert", "features", "fft", "loudness", "onset", "spectrum", "encode", "send", "write", "openOutput", "startSession", "endSession", "upload"
+};
+static_assert(sizeof(STAGE_NAMES) / sizeof(STAGE_NAMES[0]) == static_cast<size_t>(TraceStage::count),
+              "a name for every stage");
+
+struct traceRecord_t {
+  uint64_t begin;
+  uint64_t end;
+  uint64_t frameSequence;
+  int32_t channelId;
+  TraceStage stage;
+};
+
+// Single writer (the owning thread), read by writeTrace. Slots are published
+// by the release store of head; a slot being overwritten while it's dumped
+// can only be one the writer has lapped, and writeTrace skips those.
+struct traceRing_t {
+  std::vector<traceRecord_t> records;
+  std::atomic<uint64_t> head{ 0 };
+  uint64_t dumped = 0; // only touched by writeTrace
+  int tid;
+  std::string name;
+};
+
+std::mutex ringsMutex;
+std::vector<std::unique_ptr<traceRing_t>> rings; // never shrinks, so thread rings stay valid
+
+// TSC to microseconds, calibrated against the steady clock between the first event and the dump
+uint64_t startTicks;
+std::chrono::steady_clock::time_point startTime;
+
+traceRing_t* threadRing() {
+  thread_local traceRing_t* ring = nullptr;
+  if (ring == nullptr) {
+    std::lock_guard<std::mutex> lock(ringsMutex);
+    if (rings.empty()) {
+      startTime = std::chrono::steady_clock::now();
+      startTicks = traceClock();
+    }
+    rings.push_back(std::make_unique<traceRing_t>());
+    ring = rings.back().get();
+    ring->records.resize(TRACE_EVENTS);
+    ring->tid = rings.size();
+  }
+  return ring;
+}
+
+} // namespace
+
+uint64_t traceClock() {
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+void traceEvent(TraceStage stage, int channelId, uint64_t frameSequence, uint64_t begin, uint64_t end) {
+  traceRing_t* ring = threadRing();
+  uint64_t head = ring->head.load(std::memory_order_relaxed);
+  ring->records[head % ring->records.size()] = { begin, end, frameSequence, channelId, stage };
+  ring->head.store(head + 1, std::memory_order_release);
+}
+
+void traceThreadName(const std::string& name) {
+  if (!traceEnabled) return;
+  traceRing_t* ring = threadRing();
+  std::lock_guard<std::mutex> lock(ringsMutex);
+  ring->name = name;
+}
+
+void reportStageCounters(std::ostream& out) {
+  perfReport(out, STAGE_NAMES, static_cast<size_t>(TraceStage::count));
+}
+
+bool writeTrace(const std::string& path) {
+  if (!traceEnabled) return true;
+  std::lock_guard<std::mutex> lock(ringsMutex);
+  if (rings.empty()) return true;
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+  uint64_t ticks = traceClock() - startTicks;
+  double microsPerTick = ticks > 0 ? seconds * 1e6 / ticks : 0;
+
+  std::ofstream out(path, std::ios::trunc);
+  out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+  out << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"analyser\"}}";
+  size_t events = 0, lost = 0;
+  for (auto& ring : rings) {
+    if (!ring->name.empty()) {
+      out << ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << ring->tid
+          << ",\"args\":{\"name\":\"" << ring->name << "\"}}";
+    }
+    uint64_t head = ring->head.load(std::memory_order_acquire);
+    uint64_t size = ring->records.size();
+    // leave a margin for slots the writer may be lapping as we read
+    uint64_t first = std::max(ring->dumped, head > size / 2 ? head - size / 2 : 0);
+    lost += first - ring->dumped;
+    for (uint64_t i = first; i < head; i++) {
+      const traceRecord_t& r = ring->records[i % size];
+      out << ",\n{\"name\":\"" << STAGE_NAMES[static_cast<size_t>(r.stage)] << "\",\"cat\":\"analyser\",\"ph\":\"X\""
+          << ",\"pid\":1,\"tid\":" << ring->tid
+          << ",\"ts\":" << static_cast<int64_t>(r.begin - startTicks) * microsPerTick
+          << ",\"dur\":" << (r.end - r.begin) * microsPerTick
+          << ",\"args\":{\"channel\":" << r.channelId << ",\"frame\":" << r.frameSequence << "}}";
+      events++;
+    }
+    ring->dumped = head;
+  }
+  out << "\n]}\n";
+  out.close();
+  if (!out) {
+    std::cerr << "can't write trace '" << path << "'" << std::endl;
+    return false;
+  }
+  std::cout << "analyser: wrote " << events << " trace events to '" << path << "'";
+  if (lost > 0) std::cout << ", " << lost << " overwritten";
+  std::cout << std::endl;
+  return true;
+}
@@ -0,0 +1,61 @@
+#ifndef ANALYSER_TRACE_HPP
+#define ANALYSER_TRACE_HPP
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include "perfcounters.hpp"
+
+// Event trace of the pipeline stages, to see which channel and stage made a
+// particular frame late. With ANALYSER_TRACE=1 each thread records into its
+// own fixed ring (ANALYSER_TRACE_EVENTS, oldest overwritten) using the TSC,
+// so recording takes no locks and doesn't allocate. writeTrace dumps what's
+// been recorded since the last dump as Chrome trace event JSON, for
+// chrome://tracing or ui.perfetto.dev. Off, a TraceScope is one branch.
+// TraceScope also feeds the per-stage hardware counters (perfcounters.hpp).
+
+enum class TraceStage : uint8_t {
+  convert, features, fft, loudness, onset, spectrum, encode, send, write, openOutput, startSession, endSession, upload, count
+};
+
+extern const bool traceEnabled;
+
+void traceEvent(TraceStage stage, int channelId, uint64_t frameSequence, uint64_t begin, uint64_t end);
+uint64_t traceClock();
+
+// Records the enclosing block as one event. Scopes may nest (fft is inside
+// features), in which case the outer stage's counters include the inner's.
+class TraceScope {
+public:
+  TraceScope(TraceStage stage, int channelId = -1, uint64_t frameSequence = 0)
+    : stage(stage), channelId(channelId), frameSequence(frameSequence), begin(traceEnabled ? traceClock() : 0) {
+    if (perfCountersEnabled) perfRead(counters);
+  }
+  ~TraceScope() {
+    if (perfCountersEnabled) {
+      perfSample_t end;
+      perfRead(end);
+      perfAccumulate(static_cast<size_t>(stage), counters, end);
+    }
+    if (traceEnabled) traceEvent(stage, channelId, frameSequence, begin, traceClock());
+  }
+  TraceScope(const TraceScope&) = delete;
+  TraceScope& operator=(const TraceScope&) = delete;
+private:
+  TraceStage stage;
+  int channelId;
+  uint64_t frameSequence;
+  uint64_t begin;
+  perfSample_t counters;
+};
+
+// Name this thread in the trace
+void traceThreadName(const std::string& name);
+
+// Per-stage hardware counters since the last report, if ANALYSER_PERF_COUNTERS is on
+void reportStageCounters(std::ostream& out);
+
+// Write events recorded since the last dump to path. Returns false on failure.
+bool writeTrace(const std::string& path);
+
+#endif // ANALYSER_TRACE_HPP
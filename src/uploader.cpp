@@ -0,0 +1,279 @@
+#include "uploader.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <fcntl.h>
+#include <unistd.h>
+#include "trace.hpp"
+
+namespace fs = std::filesystem;
+
+static constexpr size_t COPY_CHUNK_SIZE = 64 * 1024;
+static constexpr int MAX_BACKOFF_SECONDS = 60;
+
+void BandwidthLimiter::acquire(uint64_t n) {
+  if (bytesPerSecond == 0) return;
+  std::chrono::steady_clock::time_point start;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    start = std::max(std::chrono::steady_clock::now(), nextFree);
+    nextFree = start + std::chrono::microseconds(n * 1000000 / bytesPerSecond);
+  }
+  std::this_thread::sleep_until(start);
+}
+
+bool LocalDirectoryTarget::put(const std::string& localPath, const std::string& key, BandwidthLimiter& limiter) {
+  fs::path destination = fs::path(root) / key;
+  fs::path partial = destination.string() + ".part";
+  std::error_code error;
+  fs::create_directories(destination.parent_path(), error);
+  std::ifstream in(localPath, std::ios::binary);
+  std::ofstream out(partial, std::ios::binary | std::ios::trunc);
+  if (!in || !out) return false;
+  std::vector<char> chunk(COPY_CHUNK_SIZE);
+  while (in) {
+    in.read(chunk.data(), chunk.size());
+    limiter.acquire(in.gcount());
+    out.write(chunk.data(), in.gcount());
+  }
+  out.close();
+  if (!out || in.bad()) return false;
+  fs::rename(partial, destination, error);
+  return !error;
+}
+
+static std::string shellQuote(const std::string& s) {
+  std::string quoted("'");
+  for (char c : s) {
+    if (c == '\'') quoted += "'\\''";
+    else quoted += c;
+  }
+  return quoted + "'";
+}
+
+bool S3Target::put(const std::string& localPath, const std::string& key, BandwidthLimiter& limiter) {
+  std::error_code error;
+  uintmax_t size = fs::file_size(localPath, error);
+  if (error) return false;
+  limiter.acquire(size); // the cli can't be throttled mid-file, so pace whole files
+  std::string cmd("aws s3 cp --only-show-errors " + shellQuote(localPath) + " " + shellQuote(url + "/" + key));
+  if (!endpoint.empty()) cmd += " --endpoint-url " + shellQuote(endpoint);
+  return std::system(cmd.c_str()) == 0;
+}
+
+std::unique_ptr<UploadTarget> makeUploadTarget(const std::string& target, const std::string& endpoint) {
+  if (target.rfind("s3://", 0) == 0) {
+    return std::make_unique<S3Target>(target, endpoint);
+  }
+  if (target.rfind("file://", 0) == 0) {
+    return std::make_unique<LocalDirectoryTarget>(target.substr(7));
+  }
+  return std::make_unique<LocalDirectoryTarget>(target);
+}
+
+Uploader::Uploader(std::unique_ptr<UploadTarget> target, const uploaderConfig_t& config)
+  : target(std::move(target)), config(config), limiter(config.bytesPerSecond) {
+  std::error_code error;
+  fs::create_directories(config.queueDirectory, error);
+  if (error) {
+    std::cerr << "can't create upload queue '" << config.queueDirectory << "': " << error.message() << std::endl;
+  }
+  recoverJobs();
+  for (size_t i = 0; i < std::max<size_t>(config.concurrency, 1); i++) {
+    workers.emplace_back(&Uploader::work, this);
+  }
+  std::cout << "analyser: uploading to " << this->target->describe() << ", " << jobs.size() << " queued" << std::endl;
+}
+
+Uploader::~Uploader() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  wakeup.notify_all();
+  for (auto& worker : workers) {
+    worker.join();
+  }
+  for (auto& job : jobs) {
+    if (!job.persisted) persist(job);
+  }
+}
+
+void Uploader::enqueue(const std::string& localPath, const std::string& key) {
+  job_t job;
+  job.localPath = localPath;
+  job.key = key;
+  auto now = std::chrono::system_clock::now().time_since_epoch();
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    char name[64];
+    std::snprintf(name, sizeof(name), "%013lld-%06llu.job",
+                  static_cast<long long>(std::chrono::duration_cast<std::chrono::milliseconds>(now).count()),
+                  static_cast<unsigned long long>(jobCounter++ % 1000000));
+    job.jobFile = (fs::path(config.queueDirectory) / name).string();
+    jobs.push_back(std::move(job));
+  }
+  wakeup.notify_one();
+}
+
+// Write the job file, on a worker. Write, fsync then rename so that a crash
+// leaves either the whole job or none of it.
+bool Uploader::persist(job_t& job) {
+  std::error_code error;
+  job.directory = fs::is_directory(job.localPath, error);
+  const std::string contents = job.localPath + '\n' + job.key + '\n';
+  const std::string temporary = job.jobFile + ".tmp";
+  int fd = ::open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  bool ok = fd >= 0 && ::write(fd, contents.data(), contents.size()) == static_cast<ssize_t>(contents.size());
+  ok = fd >= 0 && ::fsync(fd) == 0 && ok;
+  if (fd >= 0) ::close(fd);
+  if (ok) fs::rename(temporary, job.jobFile, error);
+  if (!ok || error) {
+    std::cerr << "can't persist upload job for '" << job.localPath << "'" << std::endl;
+    return false;
+  }
+  // and the rename itself
+  fd = ::open(config.queueDirectory.c_str(), O_RDONLY | O_DIRECTORY);
+  if (fd >= 0) {
+    ::fsync(fd);
+    ::close(fd);
+  }
+  return true;
+}
+
+size_t Uploader::pending() {
+  std::lock_guard<std::mutex> lock(mutex);
+  return jobs.size() + inFlight.size();
+}
+
+void Uploader::recoverJobs() {
+  std::vector<std::string> jobFiles;
+  std::error_code error;
+  for (const auto& entry : fs::directory_iterator(config.queueDirectory, error)) {
+    if (entry.path().extension() == ".job") jobFiles.push_back(entry.path().string());
+  }
+  std::sort(jobFiles.begin(), jobFiles.end()); // names start with the enqueue time
+  for (const auto& jobFile : jobFiles) {
+    job_t job;
+    job.jobFile = jobFile;
+    std::ifstream in(jobFile);
+    if (std::getline(in, job.localPath) && std::getline(in, job.key)) {
+      job.directory = fs::is_directory(job.localPath, error);
+      job.persisted = true;
+      jobs.push_back(job);
+    } else {
+      std::cerr << "ignoring unreadable upload job '" << jobFile << "'" << std::endl;
+    }
+  }
+}
+
+// Called with the mutex held
+bool Uploader::blocked(const job_t& job) const {
+  if (!job.directory) return false;
+  std::string prefix = job.localPath + "/";
+  auto inside = [&](const std::string& path) { return path.compare(0, prefix.size(), prefix) == 0; };
+  return std::any_of(inFlight.begin(), inFlight.end(), inside) ||
+    std::any_of(jobs.begin(), jobs.end(), [&](const job_t& j) { return inside(j.localPath); });
+}
+
+void Uploader::work() {
+  traceThreadName("uploader");
+  std::unique_lock<std::mutex> lock(mutex);
+  while (!stopping) {
+    // persist new jobs first, leaving them queued so they still block directory jobs
+    auto added = std::find_if(jobs.begin(), jobs.end(), [](const job_t& j) { return !j.persisted && !j.persisting; });
+    if (added != jobs.end()) {
+      added->persisting = true;
+      job_t job = *added;
+      lock.unlock();
+      persist(job);
+      lock.lock();
+      // only persisted jobs are taken, so it's still queued
+      auto queued = std::find_if(jobs.begin(), jobs.end(), [&](const job_t& j) { return j.jobFile == job.jobFile; });
+      queued->directory = job.directory;
+      queued->persisted = true; // even if that failed, so it's still uploaded
+      queued->persisting = false;
+      wakeup.notify_all();
+      continue;
+    }
+
+    auto now = std::chrono::steady_clock::now();
+    auto ready = std::find_if(jobs.begin(), jobs.end(), [&](const job_t& j) { return j.persisted && j.notBefore <= now && !blocked(j); });
+    if (ready == jobs.end()) {
+      // sleep until the next backoff expires, or until woken by a new or finished job
+      auto waiting = jobs.end();
+      for (auto j = jobs.begin(); j != jobs.end(); j++) {
+        if (j->notBefore > now && (waiting == jobs.end() || j->notBefore < waiting->notBefore)) waiting = j;
+      }
+      if (waiting == jobs.end()) {
+        wakeup.wait(lock);
+      } else {
+        wakeup.wait_until(lock, waiting->notBefore);
+      }
+      continue;
+    }
+
+    job_t job = *ready;
+    jobs.erase(ready);
+    inFlight.push_back(job.localPath);
+    lock.unlock();
+    bool uploaded;
+    {
+      TraceScope trace(TraceStage::upload);
+      uploaded = upload(job);
+    }
+    std::error_code error;
+    if (uploaded) {
+      fs::remove(job.jobFile, error);
+      std::cout << "analyser: uploaded '" << job.localPath << "'" << std::endl;
+    } else if (++job.attempts >= config.maxAttempts) {
+      fs::rename(job.jobFile, job.jobFile + ".failed", error);
+      std::cerr << "giving up uploading '" << job.localPath << "' after " << job.attempts << " attempts" << std::endl;
+    }
+    lock.lock();
+    inFlight.erase(std::find(inFlight.begin(), inFlight.end(), job.localPath));
+    if (!uploaded && job.attempts < config.maxAttempts) {
+      int backoff = std::min(1 << std::min(job.attempts, 6), MAX_BACKOFF_SECONDS);
+      job.notBefore = std::chrono::steady_clock::now() + std::chrono::seconds(backoff);
+      std::cerr << "upload of '" << job.localPath << "' failed, retrying in " << backoff << "s" << std::endl;
+      jobs.push_back(job);
+    }
+    wakeup.notify_all(); // a directory job may have been waiting on this one
+  }
+}
+
+bool Uploader::upload(const job_t& job) {
+  std::error_code error;
+  fs::path local(job.localPath);
+  if (!fs::exists(local, error)) return true; // finished before a restart
+
+  if (!fs::is_directory(local, error)) {
+    if (!target->put(job.localPath, job.key, limiter)) return false;
+    fs::remove(local, error);
+    return true;
+  }
+
+  std::vector<fs::path> files;
+  for (const auto& entry : fs::recursive_directory_iterator(local, error)) {
+    if (entry.is_regular_file()) files.push_back(entry.path());
+  }
+  std::sort(files.begin(), files.end());
+  for (const auto& file : files) {
+    std::string key = job.key + "/" + fs::relative(file, local).generic_string();
+    if (!target->put(file.string(), key, limiter)) return false;
+    fs::remove(file, error);
+  }
+  // only removes directories that are now empty, like the old rmdir
+  std::vector<fs::path> directories;
+  for (const auto& entry : fs::recursive_directory_iterator(local, error)) {
+    if (entry.is_directory()) directories.push_back(entry.path());
+  }
+  std::sort(directories.rbegin(), directories.rend());
+  for (const auto& directory : directories) {
+    fs::remove(directory, error);
+  }
+  fs::remove(local, error);
+  return true;
+}
@@ -0,0 +1,121 @@
+#ifndef ANALYSER_UPLOADER_HPP
+#define ANALYSER_UPLOADER_HPP
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Shared token bucket so all upload workers together stay under a byte rate.
+// A rate of 0 means unlimited.
+class BandwidthLimiter {
+public:
+  explicit BandwidthLimiter(uint64_t bytesPerSecond) : bytesPerSecond(bytesPerSecond) {}
+  // Reserve bandwidth for n bytes, sleeping until the reservation starts
+  void acquire(uint64_t n);
+private:
+  const uint64_t bytesPerSecond;
+  std::mutex mutex;
+  std::chrono::steady_clock::time_point nextFree;
+};
+
+// Where sealed session files end up. put() copies one file to key (a
+// '/'-separated path below the target root) and returns false on failure so
+// the job can be retried. It must not delete localPath.
+class UploadTarget {
+public:
+  virtual ~UploadTarget() = default;
+  virtual bool put(const std::string& localPath, const std::string& key, BandwidthLimiter& limiter) = 0;
+  virtual std::string describe() const = 0;
+};
+
+// A plain directory (e.g. a mounted volume, or for testing)
+class LocalDirectoryTarget : public UploadTarget {
+public:
+  explicit LocalDirectoryTarget(const std::string& root) : root(root) {}
+  bool put(const std::string& localPath, const std::string& key, BandwidthLimiter& limiter) override;
+  std::string describe() const override { return root; }
+private:
+  std::string root;
+};
+
+// s3://bucket/prefix via the aws cli. An endpoint URL points it at any
+// S3-compatible stand-in (minio, localstack) instead of AWS.
+class S3Target : public UploadTarget {
+public:
+  S3Target(const std::string& url, const std::string& endpoint) : url(url), endpoint(endpoint) {}
+  bool put(const std::string& localPath, const std::string& key, BandwidthLimiter& limiter) override;
+  std::string describe() const override { return endpoint.empty() ? url : url + " via " + endpoint; }
+private:
+  std::string url;
+  std::string endpoint;
+};
+
+// "s3://..." gives an S3Target, "file://dir" or a plain path a LocalDirectoryTarget
+std::unique_ptr<UploadTarget> makeUploadTarget(const std::string& target, const std::string& endpoint);
+
+struct uploaderConfig_t {
+  std::string queueDirectory;
+  size_t concurrency = 1;
+  int maxAttempts = 5;
+  uint64_t bytesPerSecond = 0;
+};
+
+// Moves sealed files and directories to the target on background threads.
+//
+// enqueue() only queues the job in memory, so it can be called from the
+// analysis thread. A worker then persists it as a small file in the queue
+// directory (written, fsynced and renamed into place) before it can be
+// uploaded, and only removes that once the upload has finished, so jobs left
+// over from a crash or restart are picked up again at startup. Uploaded
+// files are deleted locally (like `aws s3 mv`), so a retried job only sends
+// what is left. Jobs that still fail after maxAttempts are renamed to
+// .failed and left for a human.
+//
+// A directory job waits until no earlier job for a path inside it is still
+// queued or uploading, so already enqueued chunks aren't sent twice.
+class Uploader {
+public:
+  Uploader(std::unique_ptr<UploadTarget> target, const uploaderConfig_t& config);
+  ~Uploader(); // waits for in-flight uploads, leaves queued jobs on disk (persisting any not yet)
+
+  // Hand over a file or directory; it must not be written to afterwards.
+  void enqueue(const std::string& localPath, const std::string& key);
+  size_t pending();
+
+private:
+  struct job_t {
+    std::string jobFile;
+    std::string localPath;
+    std::string key;
+    bool directory = false;
+    bool persisted = false;  // its job file has been written (or that failed), so it can be uploaded
+    bool persisting = false; // a worker is writing it
+    int attempts = 0;
+    std::chrono::steady_clock::time_point notBefore;
+  };
+
+  std::unique_ptr<UploadTarget> target;
+  const uploaderConfig_t config;
+  BandwidthLimiter limiter;
+  std::mutex mutex;
+  std::condition_variable wakeup;
+  std::deque<job_t> jobs;
+  std::vector<std::string> inFlight; // local paths being uploaded
+  uint64_t jobCounter = 0;
+  bool stopping = false;
+  std::vector<std::thread> workers;
+
+  void recoverJobs();
+  bool persist(job_t& job);
+  void work();
+  bool blocked(const job_t& job) const;
+  bool upload(const job_t& job);
+};
+
+#endif // ANALYSER_UPLOADER_HPP
@@ -0,0 +1,81 @@
+#include "wavfile.hpp"
+#include <cstring>
+#include <iostream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static uint64_t le64(const char* p) { uint64_t x; std::memcpy(&x, p, 8); return x; }
+static uint32_t le32(const char* p) { uint32_t x; std::memcpy(&x, p, 4); return x; }
+static uint16_t le16(const char* p) { uint16_t x; std::memcpy(&x, p, 2); return x; }
+
+MappedWav::~MappedWav() {
+  if (mapping) munmap(mapping, mappingSize);
+}
+
+bool MappedWav::open(const std::string& path) {
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd == -1) {
+    std::cerr << "can't open '" << path << "'" << std::endl;
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd, &st) == -1 || st.st_size < 12) {
+    std::cerr << "'" << path << "' is not a RIFF/WAVE file" << std::endl;
+    ::close(fd);
+    return false;
+  }
+  mappingSize = st.st_size;
+  mapping = mmap(nullptr, mappingSize, PROT_READ, MAP_PRIVATE, fd, 0);
+  posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+  ::close(fd); // the mapping keeps the file alive
+  if (mapping == MAP_FAILED) {
+    mapping = nullptr;
+    std::cerr << "can't mmap '" << path << "'" << std::endl;
+    return false;
+  }
+  madvise(mapping, mappingSize, MADV_SEQUENTIAL);
+
+  const char* data = static_cast<const char*>(mapping);
+  const char* end = data + mappingSize;
+  bool rf64 = std::memcmp(data, "RF64", 4) == 0;
+  if ((!rf64 && std::memcmp(data, "RIFF", 4) != 0) || std::memcmp(data + 8, "WAVE", 4) != 0) {
+    std::cerr << "'" << path << "' is not a RIFF/WAVE file" << std::endl;
+    return false;
+  }
+
+  uint64_t rf64DataSize = 0;
+  bool haveFormat = false;
+  const char* chunk = data + 12;
+  while (end - chunk >= 8) {
+    uint64_t size = le32(chunk + 4);
+    const char* body = chunk + 8;
+    if (std::memcmp(chunk, "ds64", 4) == 0 && size >= 16 && end - body >= 16) {
+      rf64DataSize = le64(body + 8);
+    } else if (std::memcmp(chunk, "fmt ", 4) == 0) {
+      if (size < 16 || end - body < 16) break;
+      uint16_t audioFormat = le16(body);
+      channelCount = le16(body + 2);
+      rate = le32(body + 4);
+      uint16_t bitsPerSample = le16(body + 14);
+      if ((audioFormat != 1 && audioFormat != 0xfffe) || bitsPerSample != 16 || channelCount < 1) {
+        std::cerr << "'" << path << "' is not 16 bit PCM" << std::endl;
+        return false;
+      }
+      haveFormat = true;
+    } else if (std::memcmp(chunk, "data", 4) == 0 && haveFormat) {
+      if (rf64 && size == 0xffffffff) size = rf64DataSize;
+      // a recorder killed mid-session can leave the size unset or too big, so take what's there
+      uint64_t available = end - body;
+      if (size == 0 || size > available) size = available;
+      samples = reinterpret_cast<const int16_t*>(body); // chunks are word aligned
+      frameCount = size / (sizeof(int16_t) * channelCount);
+      return true;
+    }
+    if (static_cast<uint64_t>(end - body) < size + (size & 1)) break;
+    chunk = body + size + (size & 1);
+  }
+  std::cerr << "'" << path << "' has no PCM data" << std::endl;
+  return false;
+}
@@ -0,0 +1,44 @@
+#ifndef ANALYSER_WAVFILE_HPP
+#define ANALYSER_WAVFILE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Read-only memory map of a 16 bit PCM WAV (or RF64, for recordings over
+// 4GB), as written by the Jamulus recorder. Samples are handed out as
+// pointers straight into the mapping, so nothing is copied on the way to the
+// int16 -> float conversion. The mapping is advised for sequential access so
+// the kernel reads ahead and drops pages behind us.
+class MappedWav {
+public:
+  MappedWav() = default;
+  ~MappedWav();
+  MappedWav(const MappedWav&) = delete;
+  MappedWav& operator=(const MappedWav&) = delete;
+
+  // Returns false (and reports on stderr) if the file isn't 16 bit PCM
+  bool open(const std::string& path);
+
+  int sampleRate() const { return rate; }
+  int channels() const { return channelCount; }
+  size_t frames() const { return frameCount; }
+
+  // Interleaved samples for frames [start, start + count), count clamped to the end
+  const int16_t* frameView(size_t start, size_t& count) const {
+    count = start >= frameCount ? 0 : min(count, frameCount - start);
+    return samples + start * channelCount;
+  }
+
+private:
+  void* mapping = nullptr;
+  size_t mappingSize = 0;
+  const int16_t* samples = nullptr;
+  size_t frameCount = 0;
+  int rate = 0;
+  int channelCount = 0;
+
+  static size_t min(size_t a, size_t b) { return a < b ? a : b; }
+};
+
+#endif // ANALYSER_WAVFILE_HPP